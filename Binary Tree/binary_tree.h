@@ -1,8 +1,42 @@
 #ifndef BINARY_TREE_H_
 #define BINARY_TREE_H_
 
+#include <cstddef>
 #include <iostream>
 #include <memory>
+#include <utility>
+#include <vector>
+#include "work_stealing_pool.h"
+
+/*
+ * Stack that keeps its first N entries inline and spills the rest to the
+ * heap, so walks of trees up to N deep never allocate
+ */
+template <typename T, std::size_t N = 64>
+class SmallStack {
+ public:
+  SmallStack() : count(0) {}
+
+  bool empty() const { return count == 0; }
+  void push(const T &x) {
+    if (count < N) {
+      inline_items[count] = x;
+    } else {
+      spill.push_back(x);
+    }
+    count++;
+  }
+  T& top() { return count <= N ? inline_items[count - 1] : spill.back(); }
+  void pop() {
+    if (count > N) spill.pop_back();
+    count--;
+  }
+
+ private:
+  T inline_items[N];
+  std::vector<T> spill;
+  std::size_t count;
+};
 
 /*
  * Class definition
@@ -20,10 +54,55 @@ class BinaryTree {
   void PreorderPrint();
   void InorderPrint();
   void PostorderPrint();
+  void LevelOrderPrint();
+
+  /*
+   * Call @visit on every item in the given order. The walks keep their own
+   * stack instead of recursing, so a tree of any depth is safe, and they
+   * allocate only on a path deeper than 64 nodes. Level order keeps two
+   * levels at a time, and allocates only when a level is the widest yet.
+   * @visit must not change the shape of the tree
+   */
+  template <typename Visit> void Preorder(Visit visit) const;
+  template <typename Visit> void Inorder(Visit visit) const;
+  template <typename Visit> void Postorder(Visit visit) const;
+  template <typename Visit> void LevelOrder(Visit visit) const;
+
+  /*
+   * Return fold of the tree: @combine(item, left, right) of the root, where
+   * left and right are the folds of its subtrees and @empty is the fold of
+   * a missing one. Uses no recursion, so a tree of any depth is safe
+   */
+  template <typename R, typename Combine>
+  R Fold(const R &empty, Combine combine) const;
+  /*
+   * Same as Fold, with subtrees folded side by side on @pool. A subtree is
+   * split off as a task only if it seems to have at least @grain nodes, so
+   * tasks are not too small to pay for themselves. @combine is called from
+   * many threads at once
+   */
+  template <typename R, typename Combine>
+  R ParallelFold(WorkStealingPool &pool, const R &empty, Combine combine,
+                 std::size_t grain = kDefaultGrain) const;
 
  private:
-  void PreorderRecur(Node *n);
-  void InorderRecur(Node *n);
+  static const std::size_t kDefaultGrain = 4096;
+  /* Recursion depth at which ParallelFold stops splitting */
+  static const int kMaxSplitDepth = 64;
+
+  /*
+   * Guess size of the subtree of @n by walking its leftmost and rightmost
+   * paths: if both are d nodes long, count it as full to depth d. A subtree
+   * with a short path on either side is a long chain or is small, and in
+   * both cases has little to split. Stops once the guess reaches @cap
+   */
+  static std::size_t EstimateSize(const Node *n, std::size_t cap);
+  template <typename R, typename Combine>
+  static R FoldSubtree(const Node *n, const R &empty, Combine &combine);
+  template <typename R, typename Combine>
+  static R ParallelFoldSubtree(WorkStealingPool &pool, const Node *n,
+                               const R &empty, Combine &combine,
+                               std::size_t grain, int depth);
 };
 
 /*
@@ -32,31 +111,187 @@ class BinaryTree {
 template <typename T>
 void BinaryTree<T>::PreorderPrint() {
   std::cout << "Preorder: ";
-  PreorderRecur(root.get());
+  Preorder([](const T &item) { std::cout << item << ' '; });
   std::cout << std::endl;
 }
 
 template <typename T>
 void BinaryTree<T>::InorderPrint() {
   std::cout << "Inorder: ";
-  InorderRecur(root.get());
+  Inorder([](const T &item) { std::cout << item << ' '; });
   std::cout << std::endl;
 }
 
 template <typename T>
-void BinaryTree<T>::PreorderRecur(Node *n) {
-  if (!n) return;
-  std::cout << n->item << ' ';
-  PreorderRecur(n->left.get());
-  PreorderRecur(n->right.get());
+void BinaryTree<T>::PostorderPrint() {
+  std::cout << "Postorder: ";
+  Postorder([](const T &item) { std::cout << item << ' '; });
+  std::cout << std::endl;
+}
+
+template <typename T>
+void BinaryTree<T>::LevelOrderPrint() {
+  std::cout << "Level order: ";
+  LevelOrder([](const T &item) { std::cout << item << ' '; });
+  std::cout << std::endl;
 }
 
 template <typename T>
-void BinaryTree<T>::InorderRecur(Node *n) {
-  if (!n) return;
-  InorderRecur(n->left.get());
-  std::cout << n->item << ' ';
-  InorderRecur(n->right.get());
+template <typename Visit>
+void BinaryTree<T>::Preorder(Visit visit) const {
+  SmallStack<const Node*> stack;
+  const Node *n = root.get();
+  while (n || !stack.empty()) {
+    if (!n) {
+      n = stack.top();
+      stack.pop();
+    }
+    visit(n->item);
+    /* Go left, and come back for the right subtree later */
+    if (n->right) stack.push(n->right.get());
+    n = n->left.get();
+  }
+}
+
+template <typename T>
+template <typename Visit>
+void BinaryTree<T>::Inorder(Visit visit) const {
+  SmallStack<const Node*> stack;
+  const Node *n = root.get();
+  while (n || !stack.empty()) {
+    /* Stack the path down to the leftmost node not yet visited */
+    for (; n; n = n->left.get()) stack.push(n);
+    n = stack.top();
+    stack.pop();
+    visit(n->item);
+    n = n->right.get();
+  }
+}
+
+template <typename T>
+template <typename Visit>
+void BinaryTree<T>::Postorder(Visit visit) const {
+  SmallStack<const Node*> stack;
+  const Node *n = root.get();
+  const Node *last = nullptr;
+  while (n || !stack.empty()) {
+    for (; n; n = n->left.get()) stack.push(n);
+    const Node *top = stack.top();
+    /* Visit a node once its right subtree is done, or if it has none */
+    if (top->right && top->right.get() != last) {
+      n = top->right.get();
+    } else {
+      visit(top->item);
+      last = top;
+      stack.pop();
+    }
+  }
+}
+
+template <typename T>
+template <typename Visit>
+void BinaryTree<T>::LevelOrder(Visit visit) const {
+  if (!root) return;
+  std::vector<const Node*> level(1, root.get()), next;
+  while (!level.empty()) {
+    next.clear();
+    for (const Node *n : level) {
+      visit(n->item);
+      if (n->left) next.push_back(n->left.get());
+      if (n->right) next.push_back(n->right.get());
+    }
+    /* Swap keeps the capacity of both, so they stop growing */
+    std::swap(level, next);
+  }
+}
+
+template <typename T>
+template <typename R, typename Combine>
+R BinaryTree<T>::Fold(const R &empty, Combine combine) const {
+  return FoldSubtree(root.get(), empty, combine);
+}
+
+template <typename T>
+template <typename R, typename Combine>
+R BinaryTree<T>::ParallelFold(WorkStealingPool &pool, const R &empty,
+                              Combine combine, std::size_t grain) const {
+  return ParallelFoldSubtree(pool, root.get(), empty, combine, grain, 0);
+}
+
+template <typename T>
+std::size_t BinaryTree<T>::EstimateSize(const Node *n, std::size_t cap) {
+  std::size_t size = 0;
+  for (const Node *l = n, *r = n; l && r && size < cap;
+       l = l->left.get(), r = r->right.get())
+    size = 2 * size + 1;
+  return size;
+}
+
+template <typename T>
+template <typename R, typename Combine>
+R BinaryTree<T>::FoldSubtree(const Node *n, const R &empty,
+                             Combine &combine) {
+  if (!n) return empty;
+  /* Walk in postorder, keeping the folds of the subtrees not yet used */
+  SmallStack<const Node*> stack;
+  std::vector<R> folds;
+  const Node *last = nullptr;
+  while (n || !stack.empty()) {
+    for (; n; n = n->left.get()) stack.push(n);
+    const Node *top = stack.top();
+    if (top->right && top->right.get() != last) {
+      n = top->right.get();
+      continue;
+    }
+    R right = empty, left = empty;
+    if (top->right) {
+      right = std::move(folds.back());
+      folds.pop_back();
+    }
+    if (top->left) {
+      left = std::move(folds.back());
+      folds.pop_back();
+    }
+    folds.push_back(combine(top->item, left, right));
+    last = top;
+    stack.pop();
+  }
+  return std::move(folds.back());
+}
+
+template <typename T>
+template <typename R, typename Combine>
+R BinaryTree<T>::ParallelFoldSubtree(WorkStealingPool &pool, const Node *n,
+                                     const R &empty, Combine &combine,
+                                     std::size_t grain, int depth) {
+  if (!n) return empty;
+  bool split_left = EstimateSize(n->left.get(), grain) >= grain;
+  bool split_right = EstimateSize(n->right.get(), grain) >= grain;
+  if (depth >= kMaxSplitDepth || (!split_left && !split_right))
+    return FoldSubtree(n, empty, combine);
+
+  R left = empty, right = empty;
+  if (split_left && split_right) {
+    /* Hand the left subtree to the pool and fold the right one here */
+    TaskGroup group(pool);
+    group.Run([&]() {
+      left = ParallelFoldSubtree(pool, n->left.get(), empty, combine, grain,
+                                 depth + 1);
+    });
+    right = ParallelFoldSubtree(pool, n->right.get(), empty, combine, grain,
+                                depth + 1);
+    group.Wait();
+  } else if (split_left) {
+    /* Only one side is worth splitting further; go down it */
+    right = FoldSubtree(n->right.get(), empty, combine);
+    left = ParallelFoldSubtree(pool, n->left.get(), empty, combine, grain,
+                               depth + 1);
+  } else {
+    left = FoldSubtree(n->left.get(), empty, combine);
+    right = ParallelFoldSubtree(pool, n->right.get(), empty, combine, grain,
+                                depth + 1);
+  }
+  return combine(n->item, left, right);
 }
 
 #endif /* BINARY_TREE_H_ */
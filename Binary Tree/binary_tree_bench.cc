@@ -0,0 +1,103 @@
+// Folds a random-shaped BinaryTree with Fold and with ParallelFold on pools
+// of 1, 2, 4, ... threads, and reports the time and the speedup over Fold.
+// Each node does @work rounds of arithmetic, standing in for evaluating an
+// expression node, so the split cost can be seen against real work.
+//
+// Usage: binary_tree_bench [nodes] [work] [max_threads]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include "binary_tree.h"
+
+typedef BinaryTree<uint32_t> Tree;
+
+// Return tree of @size nodes, each subtree split at a random point, which
+// gives the shape of a random search tree, about 3 log2 n deep
+std::unique_ptr<Tree::Node> Build(unsigned int size, std::mt19937 *rng) {
+  if (size == 0) return nullptr;
+  unsigned int left = (*rng)() % size;
+  uint32_t item = (*rng)();
+  std::unique_ptr<Tree::Node> n(new Tree::Node{item, nullptr, nullptr});
+  n->left = Build(left, rng);
+  n->right = Build(size - 1 - left, rng);
+  return n;
+}
+
+// Return seconds taken by @op, best of three
+template <typename Op>
+double Seconds(Op op) {
+  double best = 0;
+  for (int i = 0; i < 3; i++) {
+    auto start = std::chrono::steady_clock::now();
+    op();
+    auto stop = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(stop - start).count();
+    if (i == 0 || seconds < best) best = seconds;
+  }
+  return best;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int nodes = argc > 1 ? std::atoi(argv[1]) : 1 << 21;
+  int work = argc > 2 ? std::atoi(argv[2]) : 64;
+  unsigned int max_threads = argc > 3 ? std::atoi(argv[3])
+                                      : std::thread::hardware_concurrency();
+  if (nodes == 0 || work < 0 || max_threads == 0) {
+    std::cerr << "Usage: " << argv[0] << " [nodes] [work] [max_threads]"
+              << std::endl;
+    return 1;
+  }
+
+  std::mt19937 rng(1);
+  Tree tree;
+  tree.root = Build(nodes, &rng);
+  // Hash each item @work times and sum the hashes up the tree
+  auto combine = [work](uint32_t item, uint64_t left, uint64_t right) {
+    uint64_t h = item;
+    for (int i = 0; i < work; i++) h = h * 0x9E3779B97F4A7C15ull + (h >> 29);
+    return h + left + right;
+  };
+
+  uint64_t expected = 0;
+  double serial = Seconds([&]() {
+    expected = tree.Fold<uint64_t>(0, combine);
+  });
+  std::cout << nodes << " nodes, " << work << " rounds per node" << std::endl;
+  std::cout << std::left << std::setw(14) << "threads" << std::right
+            << std::setw(12) << "ms" << std::setw(12) << "speedup"
+            << std::endl;
+  std::cout << std::left << std::setw(14) << "Fold" << std::right
+            << std::fixed << std::setprecision(1) << std::setw(12)
+            << serial * 1e3 << std::setprecision(2) << std::setw(12) << 1.0
+            << std::endl;
+
+  std::vector<unsigned int> thread_counts;
+  for (unsigned int t = 1; t < max_threads; t *= 2) thread_counts.push_back(t);
+  thread_counts.push_back(max_threads);
+  for (unsigned int num_threads : thread_counts) {
+    WorkStealingPool pool(num_threads);
+    uint64_t sum = 0;
+    double parallel = Seconds([&]() {
+      sum = tree.ParallelFold<uint64_t>(pool, 0, combine);
+    });
+    if (sum != expected) {
+      std::cerr << "Error: ParallelFold on " << num_threads
+                << " threads gave " << sum << ", not " << expected
+                << std::endl;
+      return 1;
+    }
+    std::cout << std::left << std::setw(14) << pool.Size() << std::right
+              << std::setprecision(1) << std::setw(12) << parallel * 1e3
+              << std::setprecision(2) << std::setw(12) << serial / parallel
+              << std::endl;
+  }
+  return 0;
+}
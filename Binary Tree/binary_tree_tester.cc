@@ -0,0 +1,185 @@
+// Checks Fold and ParallelFold of BinaryTree against a plain recursive fold
+// on random trees, for pools of 1 to 8 threads and grains from 1 node up,
+// and checks WorkStealingPool and TaskGroup on their own. Prints every
+// failed check and exits with 1 if there are any.
+//
+// Usage: binary_tree_tester
+
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "binary_tree.h"
+
+namespace {
+
+typedef BinaryTree<int> Tree;
+
+int failures = 0;
+
+void Check(bool ok, const std::string& what) {
+  if (ok) return;
+  std::cerr << "FAILED: " << what << std::endl;
+  failures++;
+}
+
+// Return tree of @size nodes, each subtree split at a random point
+std::unique_ptr<Tree::Node> Build(unsigned int size, std::mt19937 *rng) {
+  if (size == 0) return nullptr;
+  unsigned int left = (*rng)() % size;
+  std::unique_ptr<Tree::Node> n(
+      new Tree::Node{static_cast<int>((*rng)() % 100), nullptr, nullptr});
+  n->left = Build(left, rng);
+  n->right = Build(size - 1 - left, rng);
+  return n;
+}
+
+// Fold that tells the left subtree from the right, so a fold that swaps or
+// drops a side gives another answer
+long long Combine(int item, long long left, long long right) {
+  return item * 3 + left - right / 2;
+}
+
+const long long kEmpty = 7;
+
+long long RecursiveFold(const Tree::Node *n) {
+  if (!n) return kEmpty;
+  return Combine(n->item, RecursiveFold(n->left.get()),
+                 RecursiveFold(n->right.get()));
+}
+
+// Free a tree that is a chain of right children without the recursion of
+// the unique_ptr destructors
+void FreeChain(Tree *tree) {
+  std::unique_ptr<Tree::Node> n = std::move(tree->root);
+  while (n) n = std::move(n->right);
+}
+
+// ParallelFold of random trees must match Fold and the recursive fold for
+// every pool size and grain
+void CheckParallelFold(int trees) {
+  std::mt19937 rng(1);
+  for (unsigned int num_threads : {1u, 2u, 3u, 8u}) {
+    WorkStealingPool pool(num_threads);
+    std::string threads = std::to_string(num_threads) + " threads";
+    for (int i = 0; i < trees; i++) {
+      Tree tree;
+      tree.root = Build(rng() % 20000, &rng);
+      long long expected = RecursiveFold(tree.root.get());
+      Check(tree.Fold<long long>(kEmpty, Combine) == expected, "Fold");
+      for (std::size_t grain : {1, 2, 16, 4096}) {
+        long long sum =
+            tree.ParallelFold<long long>(pool, kEmpty, Combine, grain);
+        Check(sum == expected, "ParallelFold on " + threads + ", grain " +
+                                   std::to_string(grain));
+      }
+    }
+
+    // An exception thrown by combine on any thread comes out of the fold
+    Tree tree;
+    tree.root = Build(50000, &rng);
+    bool threw = false;
+    try {
+      tree.ParallelFold<long long>(
+          pool, 0,
+          [](int item, long long left, long long right) -> long long {
+            if (item == 42 && left > 1000)
+              throw std::runtime_error("combine failed");
+            return left + right + item;
+          }, 1);
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    Check(threw, "ParallelFold on " + threads + " passes on an exception");
+  }
+
+  // A chain far deeper than any recursion could go
+  Tree chain;
+  Tree::Node *last = nullptr;
+  for (int i = 0; i < 300000; i++) {
+    Tree::Node *n = new Tree::Node{1, nullptr, nullptr};
+    if (last)
+      last->right.reset(n);
+    else
+      chain.root.reset(n);
+    last = n;
+  }
+  WorkStealingPool pool(4);
+  auto sum = [](int item, long long left, long long right) {
+    return item + left + right;
+  };
+  Check(chain.ParallelFold<long long>(pool, 0, sum, 1) == 300000,
+        "ParallelFold of a deep chain");
+  FreeChain(&chain);
+}
+
+// Tasks on the pool directly and through groups, nested groups included
+void CheckPool() {
+  for (unsigned int num_threads : {1u, 2u, 4u}) {
+    std::string threads = std::to_string(num_threads) + " threads";
+    std::atomic<int> done(0);
+    {
+      WorkStealingPool pool(num_threads);
+      Check(pool.Size() >= 1 && pool.Size() <= num_threads,
+            "pool size for " + threads);
+      // Tasks nobody waits for still run before the pool goes
+      for (int i = 0; i < 100; i++) pool.Submit([&done]() { done++; });
+    }
+    Check(done.load() == 100, "pool of " + threads + " drains on exit");
+
+    WorkStealingPool pool(num_threads);
+    done = 0;
+    TaskGroup outer(pool);
+    for (int i = 0; i < 8; i++) {
+      outer.Run([&pool, &done]() {
+        TaskGroup inner(pool);
+        for (int j = 0; j < 8; j++) inner.Run([&done]() { done++; });
+        inner.Wait();
+      });
+    }
+    outer.Wait();
+    Check(done.load() == 64, "nested groups on " + threads);
+
+    // Wait rethrows the first exception, after every task has finished
+    TaskGroup group(pool);
+    done = 0;
+    for (int i = 0; i < 20; i++) {
+      group.Run([i, &done]() {
+        done++;
+        if (i % 5 == 0) throw std::runtime_error("task failed");
+      });
+    }
+    bool threw = false;
+    try {
+      group.Wait();
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    Check(threw && done.load() == 20, "group on " + threads + " rethrows");
+    // The error is handed out once
+    group.Run([]() {});
+    threw = false;
+    try {
+      group.Wait();
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    Check(!threw, "group on " + threads + " rethrows only once");
+  }
+}
+
+}  // namespace
+
+int main() {
+  CheckParallelFold(30);
+  CheckPool();
+  if (failures > 0) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "binary_tree_tester: all checks passed" << std::endl;
+  return 0;
+}
@@ -2,24 +2,77 @@
 #define BST_H_
 
 #include <algorithm>
+#include <cmath>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <utility>
 #include <stdexcept>
 #include <string>
 #include <sstream>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "frozen_bst.h"
+/*
+ * Balancing policies, given as the second template parameter of BST. With
+ * NoBalance keys stay where they are inserted, so sorted input makes a list.
+ * AVLBalance keeps the heights of sibling subtrees within one of each other.
+ * WeightBalance keeps the sizes of sibling subtrees within a factor of three
+ * of each other. Both bound the height by O(log n) with rotations made on
+ * the way back up from insert and remove
+ */
+struct NoBalance {};
+struct AVLBalance {};
+struct WeightBalance {};
+
 /*
  * Class definition
  */
-template <typename T>
+template <typename T, typename Balance = NoBalance>
 class BST {
  public:
   /* Return floor key in tree */
   const T& floor(const T &key);
   /* Return ceil key in tree */
   const T& ceil(const T &key);
-  /* Return k-th smallest key in tree; acts as helper function to recur */
+  /*
+   * Return floor, or ceil, of every key in @queries, in the same order, null
+   * for a query that has none. The queries are sorted, unless they already
+   * are, and go down the tree together, split at every Node into those on
+   * its left and those on its right. No Node is visited twice, so q queries
+   * on a balanced tree of n keys take O(q log(n / q)) steps rather than
+   * O(q log n). Parts of the walk run on up to @num_threads threads, 0
+   * meaning one per hardware thread
+   */
+  std::vector<const T*> floor(const std::vector<T> &queries,
+                              unsigned int num_threads = 0);
+  std::vector<const T*> ceil(const std::vector<T> &queries,
+                             unsigned int num_threads = 0);
+  /*
+   * Return k-th smallest key in tree, counting from 1, in O(height). Throws
+   * std::runtime_error if @kth is not between 1 and the size of the tree
+   */
   const T& kth_small(const int kth);
+  /*
+   * Return the k-th smallest key for every k in @kths, in the same order.
+   * Descends once for the whole batch, so the paths the ranks share are
+   * walked only once
+   */
+  std::vector<T> kth_small(const std::vector<int> &kths);
+  /*
+   * Return the nearest-rank percentile for every percent in @percents, each
+   * from 0 to 100, with a single descent as above
+   */
+  std::vector<T> percentiles(const std::vector<double> &percents);
+  /* Return number of keys in tree less than @key */
+  int rank(const T &key);
+  /* Return number of keys in tree from @lo to @hi, both included */
+  int count_range(const T &lo, const T &hi);
+  /* Return number of keys in tree */
+  int size();
+  /* Return number of Nodes on the longest path from the root */
+  int height();
   /* Return whether @key is found in tree */
   bool contains(const T& key);
 
@@ -33,6 +86,12 @@ class BST {
   /* Remove @key from tree */
   void remove(const T &key);
 
+  /*
+   * Return read-only copy of tree laid out for fast floor, ceil and contains,
+   * see frozen_bst.h. Later changes to the tree do not reach it
+   */
+  FrozenBST<T> freeze();
+
   /* Print tree in-order */
   void print();
 
@@ -41,6 +100,10 @@ class BST {
   T key;
   std::unique_ptr<Node> left;
   std::unique_ptr<Node> right;
+  /* Number of keys in the subtree rooted here, this one included */
+  int size;
+  /* Number of Nodes on the longest path down from here, this one included */
+  int height;
   };
   std::unique_ptr<Node> root;
 
@@ -50,8 +113,47 @@ class BST {
   void remove(std::unique_ptr<Node> &n, const T &key);
   void print(Node *n, int level);
 
-  /* Recursively find kth_small element */
-  bool recur_kth_small(int& k, const int& kth, Node** kth_small, Node* n);
+  /* Return number of keys under @n */
+  static int size(Node *n);
+  /* Return height of subtree @n */
+  static int height(Node *n);
+  /* Recompute size and height of @n from its children */
+  static void update(Node *n);
+
+  /* Rotate @n with its right or left child, which takes its place */
+  static void rotate_left(std::unique_ptr<Node> &n);
+  static void rotate_right(std::unique_ptr<Node> &n);
+  /*
+   * Update @n after a change below it and restore the balance at it, as the
+   * policy says. Its children are balanced already
+   */
+  static void rebalance(std::unique_ptr<Node> &n, NoBalance);
+  static void rebalance(std::unique_ptr<Node> &n, AVLBalance);
+  static void rebalance(std::unique_ptr<Node> &n, WeightBalance);
+  /* Return number of keys less than @key, or not greater if @inclusive */
+  int count_below(const T &key, bool inclusive);
+  /* A split sends one side to another thread if both have this many */
+  static const std::size_t kMinForkQueries = 4096;
+  /*
+   * Answer floor, or ceil if not @floor, for queries[order[i]] for every i in
+   * [@first, @last), which are sorted by query and all fall in subtree @n.
+   * @best is the answer any of them gets if nothing below @n is better.
+   * @forks is how many more levels may hand half the queries to a thread
+   */
+  void batch_search(Node *n, const T *best, const std::vector<T> &queries,
+                    const std::size_t *first, const std::size_t *last,
+                    bool floor, int forks, std::vector<const T*> *out);
+  /* Run batch_search for every query of @queries */
+  std::vector<const T*> batch_search(const std::vector<T> &queries,
+                                     bool floor, unsigned int num_threads);
+
+  /*
+   * Put the key of rank ranks[i].first into (*out)[ranks[i].second] for every
+   * i in [@first, @last), whose ranks are sorted and fall in the subtree @n.
+   * @offset is the number of keys in tree before that subtree
+   */
+  void select(Node *n, int offset, const std::pair<int, int> *first,
+              const std::pair<int, int> *last, std::vector<T> *out);
 };
 
 /*
@@ -59,10 +161,10 @@ class BST {
  */
 
 /* Find floor of tree given key iteratively */
-template <typename T>
-const T& BST<T>::floor(const T &key) {
+template <typename T, typename Balance>
+const T& BST<T, Balance>::floor(const T &key) {
   /* Init ret val and vars for loop */
-  T* floor;
+  T* floor = nullptr;
   bool floor_found = false;
   Node *n = root.get();
 
@@ -108,14 +210,14 @@ const T& BST<T>::floor(const T &key) {
 }
 
 /* Find ceiling of tree given key iteratively */
-template <typename T>
-const T& BST<T>::ceil(const T &key) {
+template <typename T, typename Balance>
+const T& BST<T, Balance>::ceil(const T &key) {
   /*
    * Very similar implementation to floor method given above. Major difference
    * is the subtree that is traversed. For in depth explanation, see floor
    * method. Commenting here will only note differences between floor.
    */
-  T* ceil;
+  T* ceil = nullptr;
   bool ceil_found = false;
   Node *n = root.get();
 
@@ -147,52 +249,334 @@ const T& BST<T>::ceil(const T &key) {
   return *ceil;
 }
 
-/* User/helper method to find kth smallest value in tree */
-template <typename T>
-const T& BST<T>::kth_small(const int kth) {
-  /* Init vars for recursion */
-  int k = 0;
-  Node* kth_small = root.get();
-  /* Run recursion */
-  recur_kth_small(k, kth, &kth_small, root.get());
+template <typename T, typename Balance>
+std::vector<const T*> BST<T, Balance>::floor(const std::vector<T> &queries,
+                                             unsigned int num_threads) {
+  return batch_search(queries, true, num_threads);
+}
 
-  /* Return value found from recursion */
-  return kth_small->key;
+template <typename T, typename Balance>
+std::vector<const T*> BST<T, Balance>::ceil(const std::vector<T> &queries,
+                                            unsigned int num_threads) {
+  return batch_search(queries, false, num_threads);
 }
 
-/*
- * Recursively find kth smallest value in tree. Each call returns a bool.
- * Returns false if this call or a call that returned into this call has reached
- * k elements. Otherwise, return true. This makes sure that the recursion ends
- * once k elements have been checked. Other than that check, simple LNR
- * (in order) traversal.
- */
-template <typename T>
-bool BST<T>::recur_kth_small(int& k, const int& kth,
-  Node** kth_small, Node* n) {
-  /* If this Node is a NIL Node, return true and continue recursion */
-  if (!n) return true;
- 
+template <typename T, typename Balance>
+std::vector<const T*> BST<T, Balance>::batch_search(
+    const std::vector<T> &queries, bool floor, unsigned int num_threads) {
+  std::vector<const T*> out(queries.size(), nullptr);
+  if (queries.empty()) return out;
+
+  /* Walk the queries in key order, by index so answers land in place */
+  std::vector<std::size_t> order(queries.size());
+  for (std::size_t i = 0; i < order.size(); i++) order[i] = i;
+  if (!std::is_sorted(queries.begin(), queries.end())) {
+    std::sort(order.begin(), order.end(),
+              [&queries](std::size_t a, std::size_t b) {
+                return queries[a] < queries[b];
+              });
+  }
+
+  /* Halves are rarely even, so fork one level more than the threads need */
+  if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+  int forks = 0;
+  for (unsigned int tasks = 1; tasks < num_threads; tasks *= 2) forks++;
+  if (forks) forks++;
+
+  batch_search(root.get(), nullptr, queries, &order[0],
+               &order[0] + order.size(), floor, forks, &out);
+  return out;
+}
+
+template <typename T, typename Balance>
+void BST<T, Balance>::batch_search(Node *n, const T *best,
+                                   const std::vector<T> &queries,
+                                   const std::size_t *first,
+                                   const std::size_t *last, bool floor,
+                                   int forks, std::vector<const T*> *out) {
+  /* Past a leaf, the best key met on the way down is the answer */
+  if (!n) {
+    for (; first != last; first++) (*out)[*first] = best;
+    return;
+  }
+
   /*
-   * Recur the left subtree. If the left subtree returns false, also return
-   * false and end recursion.
+   * For floor, queries below the key of this Node go left; the rest have it
+   * as a floor and go right looking for a greater one. For ceil, queries up
+   * to the key go left with it as a ceil, the rest go right.
    */
-  if (!recur_kth_small(k, kth, kth_small, n->left.get())) return false;
-  /* If k has reached kth, return false and end recursion */
-  if (k >= kth) return false;
-  
-  /* 
-   * If k has not reached kth, process Node. Meaning, update kth_smallest and
-   * inc k.
+  const std::size_t *mid;
+  if (floor) {
+    mid = std::lower_bound(first, last, n->key,
+                           [&queries](std::size_t i, const T &key) {
+                             return queries[i] < key;
+                           });
+  } else {
+    mid = std::upper_bound(first, last, n->key,
+                           [&queries](const T &key, std::size_t i) {
+                             return key < queries[i];
+                           });
+  }
+  const T *left_best = floor ? best : &n->key;
+  const T *right_best = floor ? &n->key : best;
+
+  auto left = [&]() {
+    if (first != mid)
+      batch_search(n->left.get(), left_best, queries, first, mid, floor,
+                   forks - 1, out);
+  };
+  auto right = [&]() {
+    if (mid != last)
+      batch_search(n->right.get(), right_best, queries, mid, last, floor,
+                   forks - 1, out);
+  };
+
+  /* The two sides write to different answers, so they can run at once */
+  std::size_t left_count = mid - first;
+  std::size_t right_count = last - mid;
+  bool fork = forks > 0 && left_count >= kMinForkQueries &&
+    right_count >= kMinForkQueries;
+  std::future<void> task;
+  if (fork) {
+    try {
+      task = std::async(std::launch::async, left);
+    } catch (const std::system_error&) {
+      /* No thread to be had, do the work here */
+      fork = false;
+    }
+  }
+  if (!fork) left();
+  right();
+  if (fork) task.get();
+}
+
+/* Find kth smallest key by walking down on subtree sizes */
+template <typename T, typename Balance>
+const T& BST<T, Balance>::kth_small(const int kth) {
+  if (kth < 1 || kth > size(root.get())) {
+    std::string err = "Cannot find kth smallest key for k = " +
+      std::to_string(kth);
+    throw std::runtime_error(err);
+  }
+
+  /*
+   * At each Node, the left subtree holds the keys ranked below it. Go left if
+   * the rank falls there, stop if it is this Node, else go right looking for
+   * the rank among the keys after this Node.
+   */
+  Node *n = root.get();
+  int k = kth;
+  while (true) {
+    int left_size = size(n->left.get());
+    if (k <= left_size) {
+      n = n->left.get();
+    } else if (k == left_size + 1) {
+      return n->key;
+    } else {
+      k -= left_size + 1;
+      n = n->right.get();
+    }
+  }
+}
+
+template <typename T, typename Balance>
+std::vector<T> BST<T, Balance>::kth_small(const std::vector<int> &kths) {
+  /* Check every rank before descending, and sort them with their slots */
+  std::vector<std::pair<int, int>> ranks;
+  for (std::size_t i = 0; i < kths.size(); i++) {
+    if (kths[i] < 1 || kths[i] > size(root.get())) {
+      std::string err = "Cannot find kth smallest key for k = " +
+        std::to_string(kths[i]);
+      throw std::runtime_error(err);
+    }
+    ranks.push_back(std::make_pair(kths[i], static_cast<int>(i)));
+  }
+  std::sort(ranks.begin(), ranks.end());
+
+  std::vector<T> out(kths.size());
+  if (!ranks.empty())
+    select(root.get(), 0, &ranks[0], &ranks[0] + ranks.size(), &out);
+  return out;
+}
+
+template <typename T, typename Balance>
+void BST<T, Balance>::select(Node *n, int offset,
+                             const std::pair<int, int> *first,
+                             const std::pair<int, int> *last,
+                             std::vector<T> *out) {
+  /*
+   * Split the sorted ranks into those in the left subtree, those equal to
+   * this Node's rank and those in the right subtree. Each part goes down its
+   * own side, so ranks that share a path share one walk down it.
+   */
+  int here = offset + size(n->left.get()) + 1;
+  const std::pair<int, int> *mid = first;
+  while (mid != last && mid->first < here) mid++;
+  if (first != mid) select(n->left.get(), offset, first, mid, out);
+  for (; mid != last && mid->first == here; mid++)
+    (*out)[mid->second] = n->key;
+  if (mid != last) select(n->right.get(), here, mid, last, out);
+}
+
+template <typename T, typename Balance>
+std::vector<T> BST<T, Balance>::percentiles(
+    const std::vector<double> &percents) {
+  int n = size(root.get());
+  if (n == 0) {
+    throw std::runtime_error("Empty tree");
+  }
+
+  /*
+   * Nearest rank: the p-th percentile is the smallest key with at least p
+   * percent of the keys at or below it, and the 0th is the min key. The
+   * rank is worked out on integers, with the percent in millionths, as
+   * percent / 100 * n in floating point can land just above a whole rank
+   * and round up past it.
+   */
+  const long long kScale = 1000000;
+  std::vector<int> kths;
+  for (double percent : percents) {
+    if (!(percent >= 0 && percent <= 100)) {
+      std::string err = "Cannot find percentile " + std::to_string(percent);
+      throw std::runtime_error(err);
+    }
+    long long scaled = std::llround(percent * kScale);
+    long long kth = (scaled * n + 100 * kScale - 1) / (100 * kScale);
+    kths.push_back(std::max(1, static_cast<int>(kth)));
+  }
+  return kth_small(kths);
+}
+
+template <typename T, typename Balance>
+int BST<T, Balance>::rank(const T &key) {
+  return count_below(key, false);
+}
+
+template <typename T, typename Balance>
+int BST<T, Balance>::count_range(const T &lo, const T &hi) {
+  if (hi < lo) return 0;
+  return count_below(hi, true) - count_below(lo, false);
+}
+
+template <typename T, typename Balance>
+int BST<T, Balance>::count_below(const T &key, bool inclusive) {
+  /*
+   * Every time the walk goes right, the Node it leaves and its left subtree
+   * are all below @key.
+   */
+  int count = 0;
+  Node *n = root.get();
+  while (n) {
+    if (n->key < key || (inclusive && n->key == key)) {
+      count += size(n->left.get()) + 1;
+      n = n->right.get();
+    } else {
+      n = n->left.get();
+    }
+  }
+  return count;
+}
+
+template <typename T, typename Balance>
+int BST<T, Balance>::size() {
+  return size(root.get());
+}
+
+template <typename T, typename Balance>
+int BST<T, Balance>::size(Node *n) {
+  return n ? n->size : 0;
+}
+
+template <typename T, typename Balance>
+int BST<T, Balance>::height() {
+  return height(root.get());
+}
+
+template <typename T, typename Balance>
+int BST<T, Balance>::height(Node *n) {
+  return n ? n->height : 0;
+}
+
+template <typename T, typename Balance>
+void BST<T, Balance>::update(Node *n) {
+  n->size = 1 + size(n->left.get()) + size(n->right.get());
+  n->height = 1 + std::max(height(n->left.get()), height(n->right.get()));
+}
+
+template <typename T, typename Balance>
+void BST<T, Balance>::rotate_left(std::unique_ptr<Node> &n) {
+  std::unique_ptr<Node> child = std::move(n->right);
+  n->right = std::move(child->left);
+  update(n.get());
+  child->left = std::move(n);
+  n = std::move(child);
+  update(n.get());
+}
+
+template <typename T, typename Balance>
+void BST<T, Balance>::rotate_right(std::unique_ptr<Node> &n) {
+  std::unique_ptr<Node> child = std::move(n->left);
+  n->left = std::move(child->right);
+  update(n.get());
+  child->right = std::move(n);
+  n = std::move(child);
+  update(n.get());
+}
+
+template <typename T, typename Balance>
+void BST<T, Balance>::rebalance(std::unique_ptr<Node> &n, NoBalance) {
+  update(n.get());
+}
+
+template <typename T, typename Balance>
+void BST<T, Balance>::rebalance(std::unique_ptr<Node> &n, AVLBalance) {
+  update(n.get());
+  /*
+   * One insert or remove below changes a height by at most one, so the
+   * subtrees differ by at most two here. If the taller child leans the
+   * other way, straighten it first so one rotation evens the heights.
+   */
+  int lean = height(n->left.get()) - height(n->right.get());
+  if (lean > 1) {
+    if (height(n->left->left.get()) < height(n->left->right.get()))
+      rotate_left(n->left);
+    rotate_right(n);
+  } else if (lean < -1) {
+    if (height(n->right->right.get()) < height(n->right->left.get()))
+      rotate_right(n->right);
+    rotate_left(n);
+  }
+}
+
+template <typename T, typename Balance>
+void BST<T, Balance>::rebalance(std::unique_ptr<Node> &n, WeightBalance) {
+  update(n.get());
+  /*
+   * Weights are sizes plus one. A side more than three times as heavy as
+   * the other gives Nodes to it: one rotation if its outer grandchild is
+   * more than half as heavy as the inner one, else two. These are the
+   * parameters known to keep the balance with one step per Node after any
+   * single insert or remove.
    */
-  *kth_small = n;
-  k++;
-  /* Recur right subtree and return its return value */
-  return (recur_kth_small(k, kth, kth_small, n->right.get()));
+  const int delta = 3;
+  const int ratio = 2;
+  int left_weight = size(n->left.get()) + 1;
+  int right_weight = size(n->right.get()) + 1;
+  if (right_weight > delta * left_weight) {
+    Node *r = n->right.get();
+    if (size(r->left.get()) + 1 >= ratio * (size(r->right.get()) + 1))
+      rotate_right(n->right);
+    rotate_left(n);
+  } else if (left_weight > delta * right_weight) {
+    Node *l = n->left.get();
+    if (size(l->right.get()) + 1 >= ratio * (size(l->left.get()) + 1))
+      rotate_left(n->left);
+    rotate_right(n);
+  }
 }
 
-template <typename T>
-bool BST<T>::contains(const T &key) {
+template <typename T, typename Balance>
+bool BST<T, Balance>::contains(const T &key) {
   Node *n = root.get();
 
   while (n) {
@@ -208,51 +592,53 @@ bool BST<T>::contains(const T &key) {
   return false;
 }
 
-template <typename T>
-const T& BST<T>::max(void) {
+template <typename T, typename Balance>
+const T& BST<T, Balance>::max(void) {
   if (!root) throw std::runtime_error("Empty tree");
   Node *n = root.get();
   while (n->right) n = n->right.get();
   return n->key;
 }
 
-template <typename T>
-const T& BST<T>::min(void) {
+template <typename T, typename Balance>
+const T& BST<T, Balance>::min(void) {
   return min(root.get())->key;
 }
 
-template <typename T>
-typename BST<T>::Node* BST<T>::min(Node *n) {
+template <typename T, typename Balance>
+typename BST<T, Balance>::Node* BST<T, Balance>::min(Node *n) {
   if (n->left)
   return min(n->left.get());
   else
   return n;
 }
 
-template <typename T>
-void BST<T>::insert(const T &key) {
+template <typename T, typename Balance>
+void BST<T, Balance>::insert(const T &key) {
   insert(root, key);
 }
 
-template <typename T>
-void BST<T>::insert(std::unique_ptr<Node> &n, const T &key) {
+template <typename T, typename Balance>
+void BST<T, Balance>::insert(std::unique_ptr<Node> &n, const T &key) {
   if (!n)
-  n = std::unique_ptr<Node>(new Node{key});
+  n = std::unique_ptr<Node>(new Node{key, nullptr, nullptr, 1, 1});
   else if (key < n->key)
   insert(n->left, key);
   else if (key > n->key)
   insert(n->right, key);
   else
   std::cerr << "Key " << key << " already inserted!\n";
+  /* Only the path changed, so fix it on the way back up */
+  rebalance(n, Balance());
 }
 
-template <typename T>
-void BST<T>::remove(const T &key) {
+template <typename T, typename Balance>
+void BST<T, Balance>::remove(const T &key) {
   remove(root, key);
 }
 
-template <typename T>
-void BST<T>::remove(std::unique_ptr<Node> &n, const T &key) {
+template <typename T, typename Balance>
+void BST<T, Balance>::remove(std::unique_ptr<Node> &n, const T &key) {
   /* Key not found */
   if (!n) return;
 
@@ -271,17 +657,38 @@ void BST<T>::remove(std::unique_ptr<Node> &n, const T &key) {
     n = std::move((n->left) ? n->left : n->right);
   }
   }
+  if (n) rebalance(n, Balance());
+}
+
+template <typename T, typename Balance>
+FrozenBST<T> BST<T, Balance>::freeze() {
+  /*
+   * Collect the keys in order with an explicit stack of the Nodes still to
+   * visit, since an unbalanced tree may be too deep to recurse down.
+   */
+  std::vector<T> sorted;
+  sorted.reserve(size());
+  std::vector<Node*> stack;
+  Node *n = root.get();
+  while (n || !stack.empty()) {
+    for (; n; n = n->left.get()) stack.push_back(n);
+    n = stack.back();
+    stack.pop_back();
+    sorted.push_back(n->key);
+    n = n->right.get();
+  }
+  return FrozenBST<T>(sorted);
 }
 
-template <typename T>
-void BST<T>::print() {
+template <typename T, typename Balance>
+void BST<T, Balance>::print() {
   if (!root) return;
   print(root.get(), 1);
   std::cout << std::endl;
 }
 
-template <typename T>
-void BST<T>::print(Node *n, int level) {
+template <typename T, typename Balance>
+void BST<T, Balance>::print(Node *n, int level) {
   if (!n) return;
 
   print(n->left.get(), level + 1);
@@ -0,0 +1,210 @@
+// Builds BST with each balancing policy from sorted, zigzag and random keys
+// at growing sizes, and reports the height and the time per insert, contains
+// and floor. Zigzag input (0, n - 1, 1, n - 2, ...) is as bad as sorted
+// input for an unbalanced tree; the balanced ones should stay near log2 n
+// on every input. Then compares floor on a balanced tree against its frozen
+// copy, one query at a time and in batches, and the tree's own batch floor
+// against one query at a time.
+//
+// Usage: bst_bench [max_keys]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bst.h"
+
+// An unbalanced tree on sorted input takes O(n) per insert and recurses as
+// deep as it has keys, so it stops growing here
+const unsigned int kMaxUnbalancedKeys = 16000;
+
+// Return nanoseconds per key taken by @op over @keys
+template <typename Op>
+double NsPerKey(const std::vector<int>& keys, Op op) {
+  auto start = std::chrono::steady_clock::now();
+  for (int key : keys) op(key);
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() /
+         keys.size();
+}
+
+std::vector<int> MakeKeys(const std::string& input, unsigned int num_keys) {
+  std::vector<int> keys;
+  if (input == "zigzag") {
+    for (unsigned int lo = 0, hi = num_keys; lo < hi;) {
+      keys.push_back(lo++);
+      if (lo < hi) keys.push_back(--hi);
+    }
+    return keys;
+  }
+  for (unsigned int i = 0; i < num_keys; i++) keys.push_back(i);
+  if (input == "random")
+    std::shuffle(keys.begin(), keys.end(), std::mt19937(num_keys));
+  return keys;
+}
+
+template <typename Tree>
+void Run(const std::string& policy, const std::string& input,
+  unsigned int num_keys) {
+  std::vector<int> keys = MakeKeys(input, num_keys);
+  // Look keys up in random order, so no run of them shares a path
+  std::vector<int> queries = MakeKeys("random", num_keys);
+
+  Tree tree;
+  double insert = NsPerKey(keys, [&](int key) { tree.insert(key); });
+  unsigned int found = 0;
+  double contains = NsPerKey(queries, [&](int key) {
+    found += tree.contains(key);
+  });
+  long long sum = 0;
+  double floor = NsPerKey(queries, [&](int key) { sum += tree.floor(key); });
+  long long n = num_keys;
+  if (found != num_keys || sum != n * (n - 1) / 2) {
+    std::cerr << "Error: " << policy << " lost keys" << std::endl;
+    std::exit(1);
+  }
+
+  std::cout << std::left << std::setw(16) << policy << std::setw(10) << input
+            << std::right << std::setw(10) << num_keys
+            << std::setw(10) << tree.height()
+            << std::fixed << std::setprecision(1)
+            << std::setw(10) << std::log2(static_cast<double>(num_keys))
+            << std::setw(12) << insert << std::setw(12) << contains
+            << std::setw(12) << floor << std::endl;
+}
+
+// Time floor of random queries on an AVL tree of @num_keys random keys and on
+// its frozen copy
+void RunFrozen(unsigned int num_keys) {
+  std::mt19937 rng(1);
+  std::vector<int> keys(num_keys);
+  for (unsigned int i = 0; i < num_keys; i++) keys[i] = 2 * i;
+  std::shuffle(keys.begin(), keys.end(), rng);
+  std::vector<int> queries(num_keys);
+  for (unsigned int i = 0; i < num_keys; i++)
+    queries[i] = rng() % (2 * num_keys);
+
+  BST<int, AVLBalance> tree;
+  for (int key : keys) tree.insert(key);
+  FrozenBST<int> frozen = tree.freeze();
+
+  // Every query has a floor, the even number at or below it
+  long long expected = 0;
+  for (int query : queries) expected += query & ~1;
+  long long tree_sum = 0, frozen_sum = 0, batch_sum = 0;
+  double tree_ns = NsPerKey(queries, [&](int key) {
+    tree_sum += tree.floor(key);
+  });
+  double frozen_ns = NsPerKey(queries, [&](int key) {
+    frozen_sum += frozen.floor(key);
+  });
+  auto start = std::chrono::steady_clock::now();
+  std::vector<const int*> floors = frozen.floor(queries);
+  auto stop = std::chrono::steady_clock::now();
+  for (const int *floor : floors) batch_sum += *floor;
+  double batch_ns =
+      std::chrono::duration<double, std::nano>(stop - start).count() /
+      num_keys;
+  if (tree_sum != expected || frozen_sum != expected ||
+      batch_sum != expected) {
+    std::cerr << "Error: floor gave wrong keys" << std::endl;
+    std::exit(1);
+  }
+
+  std::cout << std::endl << num_keys << " random keys, ns per floor"
+            << std::endl;
+  std::cout << std::fixed << std::setprecision(1)
+            << std::left << std::setw(26) << "BST<AVLBalance>"
+            << std::right << std::setw(10) << tree_ns << std::endl
+            << std::left << std::setw(26) << "FrozenBST"
+            << std::right << std::setw(10) << frozen_ns << std::endl
+            << std::left << std::setw(26) << "FrozenBST, batch"
+            << std::right << std::setw(10) << batch_ns << std::endl;
+}
+
+// Time floor of @num_keys random queries, one at a time and in a batch on
+// one thread and on every hardware thread, on an AVL tree of @num_keys keys
+void RunBatch(unsigned int num_keys) {
+  std::mt19937 rng(2);
+  std::vector<int> keys(num_keys);
+  for (unsigned int i = 0; i < num_keys; i++) keys[i] = 2 * i;
+  std::shuffle(keys.begin(), keys.end(), rng);
+  BST<int, AVLBalance> tree;
+  for (int key : keys) tree.insert(key);
+
+  std::vector<int> queries(num_keys);
+  for (unsigned int i = 0; i < num_keys; i++)
+    queries[i] = rng() % (2 * num_keys);
+  std::vector<int> sorted(queries);
+  std::sort(sorted.begin(), sorted.end());
+  long long expected = 0;
+  for (int query : queries) expected += query & ~1;
+
+  std::cout << std::endl << num_keys << " queries on " << num_keys
+            << " keys, ns per floor" << std::endl;
+  auto row = [&](const std::string& name, double ns) {
+    std::cout << std::fixed << std::setprecision(1) << std::left
+              << std::setw(26) << name << std::right << std::setw(10) << ns
+              << std::endl;
+  };
+  long long sum = 0;
+  row("one at a time", NsPerKey(queries, [&](int key) {
+    sum += tree.floor(key);
+  }));
+  std::vector<unsigned int> thread_counts = {1};
+  if (std::thread::hardware_concurrency() > 1)
+    thread_counts.push_back(std::thread::hardware_concurrency());
+  const std::vector<int>* inputs[] = {&queries, &sorted};
+  long long runs = 1;
+  for (const std::vector<int>* input : inputs) {
+    for (unsigned int num_threads : thread_counts) {
+      runs++;
+      auto start = std::chrono::steady_clock::now();
+      std::vector<const int*> floors = tree.floor(*input, num_threads);
+      auto stop = std::chrono::steady_clock::now();
+      for (const int *floor : floors) sum += *floor;
+      row(std::string("batch, ") + (input == &sorted ? "sorted" : "random") +
+            ", " + std::to_string(num_threads) + " thread" +
+            (num_threads > 1 ? "s" : ""),
+          std::chrono::duration<double, std::nano>(stop - start).count() /
+            num_keys);
+    }
+  }
+  if (sum != runs * expected) {
+    std::cerr << "Error: batch floor gave wrong keys" << std::endl;
+    std::exit(1);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int max_keys = argc > 1 ? std::atoi(argv[1]) : 256000;
+  if (max_keys == 0) {
+    std::cerr << "Usage: " << argv[0] << " [max_keys]" << std::endl;
+    return 1;
+  }
+
+  std::cout << "height and ns per operation" << std::endl;
+  std::cout << std::left << std::setw(16) << "policy" << std::setw(10)
+            << "input" << std::right << std::setw(10) << "keys"
+            << std::setw(10) << "height" << std::setw(10) << "log2 n"
+            << std::setw(12) << "insert" << std::setw(12) << "contains"
+            << std::setw(12) << "floor" << std::endl;
+  const char *inputs[] = {"sorted", "zigzag", "random"};
+  for (const char *input : inputs) {
+    for (unsigned int n = 1000; n <= max_keys; n *= 4) {
+      if (n <= kMaxUnbalancedKeys || std::string(input) == "random")
+        Run<BST<int>>("NoBalance", input, n);
+      Run<BST<int, AVLBalance>>("AVLBalance", input, n);
+      Run<BST<int, WeightBalance>>("WeightBalance", input, n);
+    }
+  }
+  RunFrozen(4 * max_keys);
+  RunBatch(4 * max_keys);
+  return 0;
+}
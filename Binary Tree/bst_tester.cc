@@ -0,0 +1,91 @@
+// Checks the order statistics of BST: kth_small, rank, count_range and
+// percentiles, against answers worked out directly from the sorted keys.
+// Prints every failed check and exits with 1 if there are any.
+//
+// Usage: bst_tester
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "bst.h"
+
+namespace {
+
+int failures = 0;
+
+void Check(bool ok, const std::string& what) {
+  if (ok) return;
+  std::cerr << "FAILED: " << what << std::endl;
+  failures++;
+}
+
+// Nearest-rank percentile of the keys 1 to @n, by integer arithmetic
+int ExpectedPercentile(int percent, int n) {
+  int kth = (percent * n + 99) / 100;
+  return kth < 1 ? 1 : kth;
+}
+
+// Percentiles of keys 1 to n at every whole percent, for every n up to
+// @max_keys. Floating point once put the 7th percentile of 100 keys at 8
+void CheckPercentiles(int max_keys) {
+  std::vector<double> percents;
+  for (int p = 0; p <= 100; p++) percents.push_back(p);
+
+  BST<int, AVLBalance> tree;
+  for (int n = 1; n <= max_keys; n++) {
+    tree.insert(n);
+    std::vector<int> got = tree.percentiles(percents);
+    for (int p = 0; p <= 100; p++) {
+      if (got[p] == ExpectedPercentile(p, n)) continue;
+      std::ostringstream what;
+      what << "percentile " << p << " of " << n << " keys is " << got[p]
+           << ", not " << ExpectedPercentile(p, n);
+      Check(false, what.str());
+    }
+  }
+
+  BST<int> hundred;
+  for (int key = 1; key <= 100; key++) hundred.insert(key);
+  std::vector<int> got = hundred.percentiles({7, 14, 28});
+  Check(got == std::vector<int>({7, 14, 28}),
+        "percentiles 7, 14 and 28 of keys 1 to 100");
+}
+
+// Ranks and counts on the even keys 0 to 2 * (@n - 1), inserted out of order
+void CheckRanks(int n) {
+  BST<int, WeightBalance> tree;
+  for (int i = 0; i < n; i++) tree.insert(2 * ((i * 7919) % n));
+  Check(tree.size() == n, "size");
+  for (int k = 1; k <= n; k++)
+    Check(tree.kth_small(k) == 2 * (k - 1), "kth_small " + std::to_string(k));
+  for (int key = -1; key <= 2 * n; key++) {
+    int below = key <= 0 ? 0 : std::min(n, (key + 1) / 2);
+    Check(tree.rank(key) == below, "rank " + std::to_string(key));
+  }
+  Check(tree.count_range(3, 9) == 3, "count_range 3 to 9");
+  Check(tree.count_range(9, 3) == 0, "count_range 9 to 3");
+
+  bool threw = false;
+  try {
+    tree.kth_small(n + 1);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  Check(threw, "kth_small past the last key throws");
+}
+
+}  // namespace
+
+int main() {
+  CheckPercentiles(2000);
+  CheckRanks(1000);
+  if (failures > 0) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "bst_tester: all checks passed" << std::endl;
+  return 0;
+}
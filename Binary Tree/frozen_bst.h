@@ -0,0 +1,220 @@
+#ifndef FROZEN_BST_H_
+#define FROZEN_BST_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * Searches over keys in Eytzinger order: keys[1] is the root and the
+ * children of keys[k] are keys[2k] and keys[2k + 1], so a search is a walk
+ * down one array with no pointers. Each step appends the result of one
+ * comparison to the index as a bit, and the answer is read back from those
+ * bits at the end. The first levels - 1 steps never leave the array; the
+ * last one may, as the bottom level need not be full.
+ *
+ * @floor picks the search: the greatest key not greater than @query if set,
+ * else the least key not less. Returns the index of that key, 0 if none.
+ */
+template <typename T>
+std::size_t FrozenSearch(const T *keys, std::size_t n, int levels,
+                         const T &query, bool floor) {
+  /* Fetch the line holding the Nodes four levels down, 16 keys of 4 bytes */
+  const std::size_t stride = std::max<std::size_t>(1, 64 / sizeof(T));
+  std::size_t k = 1;
+  for (int level = 1; level < levels; level++) {
+    __builtin_prefetch(keys + std::min(k * stride, n));
+    k = 2 * k + (floor ? !(query < keys[k]) : keys[k] < query);
+  }
+  std::size_t last = 2 * k + (floor ? !(query < keys[std::min(k, n)])
+                                    : keys[std::min(k, n)] < query);
+  k = k <= n ? last : k;
+  /*
+   * The answer is where the walk last turned the other way: right for floor,
+   * left for ceil. Drop the trailing run of the other turn and that turn.
+   */
+  if (floor) return k >> (__builtin_ctzll(k) + 1);
+  return k >> (__builtin_ctzll(~k) + 1);
+}
+
+/*
+ * Same as FrozenSearch for @count queries at once, putting the indices in
+ * @out. Queries go down in groups that step in lock step, so the cache
+ * misses of a group overlap instead of waiting on each other.
+ */
+template <typename T>
+void FrozenSearchBatch(const T *keys, std::size_t n, int levels,
+                       const T *queries, std::size_t count, bool floor,
+                       std::size_t *out) {
+  const std::size_t kLanes = 16;
+  for (std::size_t first = 0; first < count; first += kLanes) {
+    std::size_t lanes = std::min(kLanes, count - first);
+    const T *q = queries + first;
+    std::size_t k[kLanes];
+    for (std::size_t i = 0; i < lanes; i++) k[i] = 1;
+    for (int level = 1; level < levels; level++) {
+      for (std::size_t i = 0; i < lanes; i++)
+        k[i] = 2 * k[i] + (floor ? !(q[i] < keys[k[i]])
+                                 : keys[k[i]] < q[i]);
+    }
+    for (std::size_t i = 0; i < lanes; i++) {
+      const T &key = keys[std::min(k[i], n)];
+      std::size_t last = 2 * k[i] + (floor ? !(q[i] < key) : key < q[i]);
+      k[i] = k[i] <= n ? last : k[i];
+      out[first + i] = floor ? k[i] >> (__builtin_ctzll(k[i]) + 1)
+                             : k[i] >> (__builtin_ctzll(~k[i]) + 1);
+    }
+  }
+}
+
+/*
+ * Read-only copy of a BST laid out for searching, made by BST::freeze(). The
+ * keys sit in one array in Eytzinger (breadth-first) order, so the first
+ * levels of every search share a few cache lines, and each search is a
+ * fixed number of branch-free steps with the next levels prefetched. The
+ * batch versions answer many queries at once for more throughput.
+ */
+template <typename T>
+class FrozenBST {
+ public:
+  /* Make empty tree */
+  FrozenBST();
+  /* Make tree of @sorted, which must be in strictly increasing order */
+  explicit FrozenBST(const std::vector<T> &sorted);
+
+  /* Return number of keys in tree */
+  int size() const;
+  /* Return whether @key is found in tree */
+  bool contains(const T &key) const;
+  /* Return floor key in tree. Throws std::runtime_error if none */
+  const T& floor(const T &key) const;
+  /* Return ceil key in tree. Throws std::runtime_error if none */
+  const T& ceil(const T &key) const;
+
+  /*
+   * Batch versions: the answer for every key in @queries, in the same order.
+   * Floor and ceil give null for a query that has none
+   */
+  std::vector<bool> contains(const std::vector<T> &queries) const;
+  std::vector<const T*> floor(const std::vector<T> &queries) const;
+  std::vector<const T*> ceil(const std::vector<T> &queries) const;
+
+ private:
+  /* keys[1..n] in Eytzinger order; keys[0] is unused */
+  std::vector<T> keys;
+  std::size_t n;
+  /* Number of levels, that is the bit width of n */
+  int levels;
+
+  /* Fill keys[k] and its subtree from @sorted in order, starting at @pos */
+  void fill(const std::vector<T> &sorted, std::size_t k, std::size_t *pos);
+  /* Return index of each answer for @queries, 0 where there is none */
+  std::vector<std::size_t> search(const std::vector<T> &queries,
+                                  bool floor) const;
+};
+
+template <typename T>
+FrozenBST<T>::FrozenBST() : keys(1), n(0), levels(0) {}
+
+template <typename T>
+FrozenBST<T>::FrozenBST(const std::vector<T> &sorted)
+    : keys(sorted.size() + 1), n(sorted.size()), levels(0) {
+  for (std::size_t i = 1; i < n; i++) {
+    if (!(sorted[i - 1] < sorted[i]))
+      throw std::runtime_error("Keys are not strictly increasing");
+  }
+  while ((n >> levels) != 0) levels++;
+  std::size_t pos = 0;
+  fill(sorted, 1, &pos);
+}
+
+template <typename T>
+void FrozenBST<T>::fill(const std::vector<T> &sorted, std::size_t k,
+                        std::size_t *pos) {
+  /* An in-order walk of the implicit tree visits the keys sorted */
+  if (k > n) return;
+  fill(sorted, 2 * k, pos);
+  keys[k] = sorted[(*pos)++];
+  fill(sorted, 2 * k + 1, pos);
+}
+
+template <typename T>
+int FrozenBST<T>::size() const {
+  return n;
+}
+
+template <typename T>
+bool FrozenBST<T>::contains(const T &key) const {
+  if (n == 0) return false;
+  std::size_t k = FrozenSearch(keys.data(), n, levels, key, false);
+  return k != 0 && !(key < keys[k]);
+}
+
+template <typename T>
+const T& FrozenBST<T>::floor(const T &key) const {
+  if (n == 0) {
+    throw std::runtime_error("Empty tree");
+  }
+  std::size_t k = FrozenSearch(keys.data(), n, levels, key, true);
+  if (k == 0) {
+    std::string err = "Cannot find floor for key " + std::to_string(key);
+    throw std::runtime_error(err);
+  }
+  return keys[k];
+}
+
+template <typename T>
+const T& FrozenBST<T>::ceil(const T &key) const {
+  if (n == 0) {
+    throw std::runtime_error("Empty tree");
+  }
+  std::size_t k = FrozenSearch(keys.data(), n, levels, key, false);
+  if (k == 0) {
+    std::string err = "Cannot find ceil for key " + std::to_string(key);
+    throw std::runtime_error(err);
+  }
+  return keys[k];
+}
+
+template <typename T>
+std::vector<std::size_t> FrozenBST<T>::search(const std::vector<T> &queries,
+                                              bool floor) const {
+  std::vector<std::size_t> found(queries.size(), 0);
+  if (n > 0 && !queries.empty())
+    FrozenSearchBatch(keys.data(), n, levels, queries.data(), queries.size(),
+                      floor, found.data());
+  return found;
+}
+
+template <typename T>
+std::vector<bool> FrozenBST<T>::contains(const std::vector<T> &queries) const {
+  std::vector<std::size_t> found = search(queries, false);
+  std::vector<bool> out(queries.size());
+  for (std::size_t i = 0; i < queries.size(); i++)
+    out[i] = found[i] != 0 && !(queries[i] < keys[found[i]]);
+  return out;
+}
+
+template <typename T>
+std::vector<const T*> FrozenBST<T>::floor(
+    const std::vector<T> &queries) const {
+  std::vector<std::size_t> found = search(queries, true);
+  std::vector<const T*> out(queries.size());
+  for (std::size_t i = 0; i < queries.size(); i++)
+    out[i] = found[i] ? &keys[found[i]] : nullptr;
+  return out;
+}
+
+template <typename T>
+std::vector<const T*> FrozenBST<T>::ceil(
+    const std::vector<T> &queries) const {
+  std::vector<std::size_t> found = search(queries, false);
+  std::vector<const T*> out(queries.size());
+  for (std::size_t i = 0; i < queries.size(); i++)
+    out[i] = found[i] ? &keys[found[i]] : nullptr;
+  return out;
+}
+
+#endif  // FROZEN_BST_H_
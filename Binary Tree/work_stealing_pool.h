@@ -0,0 +1,221 @@
+#ifndef WORK_STEALING_POOL_H_
+#define WORK_STEALING_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+ * Thread pool for fork-join work. Every worker has its own queue: it pushes
+ * the tasks it makes to the back and takes its next task from the back too,
+ * so it stays on the subtree it just split. An idle worker steals from the
+ * front of another queue, where the oldest and so largest tasks are. Tasks
+ * from threads outside the pool go on one shared queue.
+ *
+ * A thread waiting in TaskGroup::Wait() runs tasks instead of sleeping, so a
+ * pool of @num_threads starts one thread fewer and counts the waiting
+ * thread as the last.
+ */
+class WorkStealingPool {
+ public:
+  /* Make pool for @num_threads threads, 0 meaning one per hardware thread */
+  explicit WorkStealingPool(unsigned int num_threads = 0);
+  /* Finish every queued task, then stop the workers */
+  ~WorkStealingPool();
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  /* Return number of threads, counting the one that waits */
+  unsigned int Size() const;
+  /*
+   * Queue @task. It runs on a worker, or on a thread waiting in
+   * TaskGroup::Wait(). It must not throw; use a TaskGroup for tasks that may
+   */
+  void Submit(std::function<void()> task);
+  /* Run one queued task on this thread. Return false if none was queued */
+  bool RunOne();
+
+ private:
+  struct Queue {
+    std::mutex lock;
+    std::deque<std::function<void()>> tasks;
+  };
+  /* Pool and queue of the worker running on this thread, if any */
+  struct Worker {
+    const WorkStealingPool *pool;
+    std::size_t queue;
+  };
+
+  /* One queue per worker, then the shared one */
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+  /* Tasks queued and not yet taken */
+  std::atomic<int> pending;
+  std::mutex sleep_lock;
+  std::condition_variable wake;
+  bool stop;
+
+  static Worker& ThisThread();
+  /* Return index of the queue this thread pushes to and pops from */
+  std::size_t OwnQueue() const;
+  void WorkerLoop(std::size_t queue);
+};
+
+/*
+ * Tasks run on a pool that can be waited for together. Wait() runs queued
+ * tasks while it waits, so tasks may make groups of their own and wait on
+ * them without tying up a thread.
+ */
+class TaskGroup {
+ public:
+  explicit TaskGroup(WorkStealingPool &pool) : pool(pool), pending(0) {}
+  /* Wait for the tasks left, dropping any exception they threw */
+  ~TaskGroup();
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  /* Queue @task on the pool */
+  template <typename Task> void Run(Task task);
+  /* Wait for every task. Rethrows the first exception one of them threw */
+  void Wait();
+
+ private:
+  WorkStealingPool &pool;
+  std::atomic<int> pending;
+  std::mutex error_lock;
+  std::exception_ptr error;
+
+  void Drain();
+};
+
+inline WorkStealingPool::WorkStealingPool(unsigned int num_threads)
+    : pending(0), stop(false) {
+  if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+  unsigned int workers = num_threads > 1 ? num_threads - 1 : 0;
+  for (unsigned int i = 0; i <= workers; i++)
+    queues.emplace_back(new Queue);
+  for (unsigned int i = 0; i < workers; i++) {
+    try {
+      threads.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+    } catch (const std::system_error&) {
+      /* No thread to be had, run with the workers started so far */
+      break;
+    }
+  }
+}
+
+inline WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    stop = true;
+  }
+  wake.notify_all();
+  for (std::thread &t : threads) t.join();
+  /* With no workers, tasks nobody waited for are still queued */
+  while (RunOne()) {}
+}
+
+inline unsigned int WorkStealingPool::Size() const {
+  return threads.size() + 1;
+}
+
+inline WorkStealingPool::Worker& WorkStealingPool::ThisThread() {
+  static thread_local Worker worker = {nullptr, 0};
+  return worker;
+}
+
+inline std::size_t WorkStealingPool::OwnQueue() const {
+  const Worker &worker = ThisThread();
+  return worker.pool == this ? worker.queue : queues.size() - 1;
+}
+
+inline void WorkStealingPool::Submit(std::function<void()> task) {
+  Queue &queue = *queues[OwnQueue()];
+  pending.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> guard(queue.lock);
+    queue.tasks.push_back(std::move(task));
+  }
+  /* Take the lock so a worker between its check and its wait sees this */
+  { std::lock_guard<std::mutex> guard(sleep_lock); }
+  wake.notify_one();
+}
+
+inline bool WorkStealingPool::RunOne() {
+  if (pending.load() == 0) return false;
+  std::function<void()> task;
+  std::size_t own = OwnQueue();
+  for (std::size_t i = 0; i < queues.size() && !task; i++) {
+    /* Own queue first from the back, then the others from the front */
+    Queue &queue = *queues[(own + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(queue.lock);
+    if (queue.tasks.empty()) continue;
+    if (i == 0) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+  }
+  if (!task) return false;
+  pending.fetch_sub(1);
+  task();
+  return true;
+}
+
+inline void WorkStealingPool::WorkerLoop(std::size_t queue) {
+  ThisThread().pool = this;
+  ThisThread().queue = queue;
+  while (true) {
+    if (RunOne()) continue;
+    std::unique_lock<std::mutex> guard(sleep_lock);
+    wake.wait(guard, [this]() { return stop || pending.load() > 0; });
+    if (stop && pending.load() == 0) return;
+  }
+}
+
+inline TaskGroup::~TaskGroup() {
+  Drain();
+}
+
+template <typename Task>
+void TaskGroup::Run(Task task) {
+  pending.fetch_add(1);
+  pool.Submit([this, task]() {
+    try {
+      task();
+    } catch (...) {
+      std::lock_guard<std::mutex> guard(error_lock);
+      if (!error) error = std::current_exception();
+    }
+    pending.fetch_sub(1);
+  });
+}
+
+inline void TaskGroup::Wait() {
+  Drain();
+  std::exception_ptr thrown;
+  {
+    std::lock_guard<std::mutex> guard(error_lock);
+    std::swap(thrown, error);
+  }
+  if (thrown) std::rethrow_exception(thrown);
+}
+
+inline void TaskGroup::Drain() {
+  while (pending.load() > 0) {
+    if (!pool.RunOne()) std::this_thread::yield();
+  }
+}
+
+#endif  // WORK_STEALING_POOL_H_
@@ -0,0 +1,732 @@
+#ifndef BTREE_MAP_H_
+#define BTREE_MAP_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include "llrb_iterator.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Return number of keys in sorted @keys[0, @n) less than @key
+template <typename K>
+int BTreeCountLess(const K *keys, int n, const K &key) {
+  return std::lower_bound(keys, keys + n, key) - keys;
+}
+
+// Return number of keys in sorted @keys[0, @n) not greater than @key
+template <typename K>
+int BTreeCountNotGreater(const K *keys, int n, const K &key) {
+  return std::upper_bound(keys, keys + n, key) - keys;
+}
+
+#ifdef __SSE2__
+// 32-bit keys are compared four at a time. Keys are sorted, so the first
+// block where not every lane matches is the last one to look at
+inline int BTreeCountLess(const int32_t *keys, int n, const int32_t &key) {
+  __m128i target = _mm_set1_epi32(key);
+  int count = 0;
+  for (; count + 4 <= n; count += 4) {
+    __m128i block = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(keys + count));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(
+      _mm_cmplt_epi32(block, target)));
+    if (mask != 0xf) return count + __builtin_popcount(mask);
+  }
+  while (count < n && keys[count] < key) count++;
+  return count;
+}
+
+inline int BTreeCountNotGreater(const int32_t *keys, int n,
+                                const int32_t &key) {
+  __m128i target = _mm_set1_epi32(key);
+  int count = 0;
+  for (; count + 4 <= n; count += 4) {
+    __m128i block = _mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(keys + count));
+    int mask = ~_mm_movemask_ps(_mm_castsi128_ps(
+      _mm_cmpgt_epi32(block, target))) & 0xf;
+    if (mask != 0xf) return count + __builtin_popcount(mask);
+  }
+  while (count < n && !(key < keys[count])) count++;
+  return count;
+}
+
+// Unsigned keys are compared as signed ones after flipping the top bit
+inline int BTreeCountLess(const uint32_t *keys, int n, const uint32_t &key) {
+  const __m128i flip = _mm_set1_epi32(INT32_MIN);
+  __m128i target = _mm_xor_si128(_mm_set1_epi32(key), flip);
+  int count = 0;
+  for (; count + 4 <= n; count += 4) {
+    __m128i block = _mm_xor_si128(_mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(keys + count)), flip);
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(
+      _mm_cmplt_epi32(block, target)));
+    if (mask != 0xf) return count + __builtin_popcount(mask);
+  }
+  while (count < n && keys[count] < key) count++;
+  return count;
+}
+
+inline int BTreeCountNotGreater(const uint32_t *keys, int n,
+                                const uint32_t &key) {
+  const __m128i flip = _mm_set1_epi32(INT32_MIN);
+  __m128i target = _mm_xor_si128(_mm_set1_epi32(key), flip);
+  int count = 0;
+  for (; count + 4 <= n; count += 4) {
+    __m128i block = _mm_xor_si128(_mm_loadu_si128(
+      reinterpret_cast<const __m128i*>(keys + count)), flip);
+    int mask = ~_mm_movemask_ps(_mm_castsi128_ps(
+      _mm_cmpgt_epi32(block, target))) & 0xf;
+    if (mask != 0xf) return count + __builtin_popcount(mask);
+  }
+  while (count < n && !(key < keys[count])) count++;
+  return count;
+}
+#endif  // __SSE2__
+
+// B+-tree map with the interface of LLRB_map. Nodes hold sorted key arrays
+// sized to a few cache lines, so a lookup touches about log_32(n) nodes
+// instead of log_2(n), and each node is searched with a linear SIMD scan for
+// 32-bit keys. All pairs live in the leaves, which are linked in key order
+// for scans. Keys and values must be default constructible
+template <typename K, typename V>
+class BTree_map {
+ public:
+  BTree_map();
+  BTree_map(BTree_map&& other);
+  BTree_map& operator=(BTree_map&& other);
+  BTree_map(const BTree_map&) = delete;
+  BTree_map& operator=(const BTree_map&) = delete;
+  ~BTree_map();
+
+  // Return size of tree
+  unsigned int Size();
+  // Return whether @key is found in tree
+  bool Contains(const K& key);
+  // Return max key in tree
+  const K& Max();
+  // Return min key in tree
+  const K& Min();
+  // Insert @key in tree
+  void Insert(const K &key, const V& value);
+  // Remove @key from tree
+  void Remove(const K &key);
+  // Remove every key from tree
+  void Clear();
+  // Print tree in-order
+  void Print();
+  // Get value given key
+  const V& Get(const K& key);
+
+  // Iterators visit <key, value> pairs in key order, handing out references
+  // into the tree. Insert, Remove and Clear invalidate them
+  class const_iterator;
+  typedef const_iterator iterator;
+  const_iterator begin() const;
+  const_iterator end() const;
+  // Return iterator to the first key not less than @key
+  const_iterator LowerBound(const K &key) const;
+  // Return iterator to the first key greater than @key
+  const_iterator UpperBound(const K &key) const;
+  // Return pairs with keys from @lo to @hi, both included
+  LLRBRange<const_iterator> Range(const K &lo, const K &hi) const;
+
+ private:
+  // Target size of a node's key and value arrays
+  static const int kNodeBytes = 512;
+  static const int kLeafSlots =
+    kNodeBytes / (sizeof(K) + sizeof(V)) > 4 ?
+      kNodeBytes / (sizeof(K) + sizeof(V)) : 4;
+  static const int kInnerSlots =
+    kNodeBytes / (sizeof(K) + sizeof(void*)) > 4 ?
+      kNodeBytes / (sizeof(K) + sizeof(void*)) : 4;
+  // Nodes other than the root never hold fewer keys than this
+  static const int kLeafMin = kLeafSlots / 2;
+  static const int kInnerMin = kInnerSlots / 2;
+  // Inner nodes have at least three children, so 2^32 keys fit in fewer
+  // levels than this
+  static const int kMaxDepth = 32;
+
+  struct Node {
+    bool leaf;
+    // Keys held
+    int count;
+  };
+  struct Leaf : Node {
+    Leaf *prev;
+    Leaf *next;
+    K keys[kLeafSlots];
+    V values[kLeafSlots];
+  };
+  // Child i holds the keys from keys[i - 1] up to, not including, keys[i]
+  struct Inner : Node {
+    K keys[kInnerSlots];
+    Node *children[kInnerSlots + 1];
+  };
+
+  Node *root;
+  // Ends of the leaf list
+  Leaf *head;
+  Leaf *tail;
+  unsigned int cur_size;
+
+  // Helper methods for node lifetime
+  static Leaf* NewLeaf();
+  static Inner* NewInner();
+  static void DeleteTree(Node *n);
+
+  // Return leaf whose key range holds @key
+  Leaf* FindLeaf(const K &key) const;
+  // Return iterator to the first key past @key, or not less than @key
+  const_iterator Seek(const K &key, bool strict) const;
+
+  // Insert @right as child @pos + 1 of @parent, split from child @pos at
+  // @separator. Return whether @parent had room
+  bool InsertChild(Inner *parent, int pos, K *separator, Node **right);
+  // Return whether @n, if not the root, holds too few keys
+  static bool Underfull(const Node *n);
+  // Fix node @pos of @parent after it fell below its minimum. Return
+  // whether @parent lost a key to a merge
+  bool Rebalance(Inner *parent, int pos);
+  void Unlink(Leaf *leaf);
+  static void RemoveChild(Inner *parent, int pos);
+};
+
+template <typename K, typename V>
+class BTree_map<K, V>::const_iterator {
+ public:
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef std::pair<K, V> value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef std::pair<const K&, const V&> reference;
+  typedef LLRBArrowProxy<reference> pointer;
+
+  const_iterator() : tree(nullptr), leaf(nullptr), index(0) {}
+
+  reference operator*() const {
+    return reference(leaf->keys[index], leaf->values[index]);
+  }
+  pointer operator->() const { return pointer(**this); }
+
+  const_iterator& operator++() {
+    if (++index == leaf->count) {
+      leaf = leaf->next;
+      index = 0;
+    }
+    return *this;
+  }
+  const_iterator operator++(int) {
+    const_iterator old(*this);
+    ++*this;
+    return old;
+  }
+  const_iterator& operator--() {
+    // Stepping back from end lands on the max key
+    if (!leaf || index == 0) {
+      leaf = leaf ? leaf->prev : tree->tail;
+      index = leaf->count;
+    }
+    index--;
+    return *this;
+  }
+  const_iterator operator--(int) {
+    const_iterator old(*this);
+    --*this;
+    return old;
+  }
+
+  bool operator==(const const_iterator &other) const {
+    return leaf == other.leaf && index == other.index;
+  }
+  bool operator!=(const const_iterator &other) const {
+    return !(*this == other);
+  }
+
+ private:
+  friend class BTree_map;
+  const_iterator(const BTree_map *tree, const Leaf *leaf, int index)
+      : tree(tree), leaf(leaf), index(index) {}
+
+  const BTree_map *tree;
+  const Leaf *leaf;
+  int index;
+};
+
+template <typename K, typename V>
+BTree_map<K, V>::BTree_map()
+    : root(nullptr), head(nullptr), tail(nullptr), cur_size(0) {}
+
+template <typename K, typename V>
+BTree_map<K, V>::BTree_map(BTree_map&& other)
+    : root(other.root),
+      head(other.head),
+      tail(other.tail),
+      cur_size(other.cur_size) {
+  other.root = nullptr;
+  other.head = other.tail = nullptr;
+  other.cur_size = 0;
+}
+
+template <typename K, typename V>
+BTree_map<K, V>& BTree_map<K, V>::operator=(BTree_map&& other) {
+  if (this != &other) {
+    Clear();
+    std::swap(root, other.root);
+    std::swap(head, other.head);
+    std::swap(tail, other.tail);
+    std::swap(cur_size, other.cur_size);
+  }
+  return *this;
+}
+
+template <typename K, typename V>
+BTree_map<K, V>::~BTree_map() {
+  Clear();
+}
+
+template <typename K, typename V>
+typename BTree_map<K, V>::Leaf* BTree_map<K, V>::NewLeaf() {
+  Leaf *leaf = new Leaf;
+  leaf->leaf = true;
+  leaf->count = 0;
+  leaf->prev = leaf->next = nullptr;
+  return leaf;
+}
+
+template <typename K, typename V>
+typename BTree_map<K, V>::Inner* BTree_map<K, V>::NewInner() {
+  Inner *inner = new Inner;
+  inner->leaf = false;
+  inner->count = 0;
+  return inner;
+}
+
+template <typename K, typename V>
+void BTree_map<K, V>::DeleteTree(Node *n) {
+  if (!n) return;
+  if (n->leaf) {
+    delete static_cast<Leaf*>(n);
+    return;
+  }
+  Inner *inner = static_cast<Inner*>(n);
+  for (int i = 0; i <= inner->count; i++)
+    DeleteTree(inner->children[i]);
+  delete inner;
+}
+
+template <typename K, typename V>
+void BTree_map<K, V>::Clear() {
+  DeleteTree(root);
+  root = nullptr;
+  head = tail = nullptr;
+  cur_size = 0;
+}
+
+template <typename K, typename V>
+unsigned int BTree_map<K, V>::Size() {
+  return cur_size;
+}
+
+template <typename K, typename V>
+typename BTree_map<K, V>::Leaf* BTree_map<K, V>::FindLeaf(
+    const K &key) const {
+  Node *n = root;
+  if (!n) return nullptr;
+  while (!n->leaf) {
+    Inner *inner = static_cast<Inner*>(n);
+    n = inner->children[BTreeCountNotGreater(inner->keys, inner->count, key)];
+  }
+  return static_cast<Leaf*>(n);
+}
+
+template <typename K, typename V>
+const V& BTree_map<K, V>::Get(const K& key) {
+  Leaf *leaf = FindLeaf(key);
+  if (leaf) {
+    int i = BTreeCountLess(leaf->keys, leaf->count, key);
+    if (i < leaf->count && leaf->keys[i] == key)
+      return leaf->values[i];
+  }
+  throw std::runtime_error("Error: Key not in map");
+}
+
+template <typename K, typename V>
+bool BTree_map<K, V>::Contains(const K &key) {
+  Leaf *leaf = FindLeaf(key);
+  if (!leaf) return false;
+  int i = BTreeCountLess(leaf->keys, leaf->count, key);
+  return i < leaf->count && leaf->keys[i] == key;
+}
+
+template <typename K, typename V>
+const K& BTree_map<K, V>::Max() {
+  if (!tail)
+    throw std::runtime_error("Error: Map is empty");
+  return tail->keys[tail->count - 1];
+}
+
+template <typename K, typename V>
+const K& BTree_map<K, V>::Min() {
+  if (!head)
+    throw std::runtime_error("Error: Map is empty");
+  return head->keys[0];
+}
+
+template <typename K, typename V>
+void BTree_map<K, V>::Insert(const K &key, const V& value) {
+  if (!root) {
+    Leaf *leaf = NewLeaf();
+    leaf->keys[0] = key;
+    leaf->values[0] = value;
+    leaf->count = 1;
+    root = head = tail = leaf;
+    cur_size = 1;
+    return;
+  }
+
+  // Inner nodes passed on the way down and the child taken in each
+  Inner *path[kMaxDepth];
+  int slot[kMaxDepth];
+  int depth = 0;
+  Node *n = root;
+  while (!n->leaf) {
+    Inner *inner = static_cast<Inner*>(n);
+    int i = BTreeCountNotGreater(inner->keys, inner->count, key);
+    path[depth] = inner;
+    slot[depth++] = i;
+    n = inner->children[i];
+  }
+
+  Leaf *leaf = static_cast<Leaf*>(n);
+  int i = BTreeCountLess(leaf->keys, leaf->count, key);
+  if (i < leaf->count && leaf->keys[i] == key)
+    throw std::runtime_error("Key already inserted");
+  // @key and @value may refer into the leaf, whose pairs move below
+  K new_key(key);
+  V new_value(value);
+
+  // A full leaf gives its upper half to a new leaf first
+  Node *right = nullptr;
+  K separator = K();
+  if (leaf->count == kLeafSlots) {
+    Leaf *sibling = NewLeaf();
+    int half = kLeafSlots / 2;
+    std::move(leaf->keys + half, leaf->keys + kLeafSlots, sibling->keys);
+    std::move(leaf->values + half, leaf->values + kLeafSlots,
+              sibling->values);
+    sibling->count = kLeafSlots - half;
+    leaf->count = half;
+    sibling->prev = leaf;
+    sibling->next = leaf->next;
+    if (leaf->next)
+      leaf->next->prev = sibling;
+    else
+      tail = sibling;
+    leaf->next = sibling;
+    if (i > half) {
+      leaf = sibling;
+      i -= half;
+    }
+    right = sibling;
+  }
+
+  std::move_backward(leaf->keys + i, leaf->keys + leaf->count,
+                     leaf->keys + leaf->count + 1);
+  std::move_backward(leaf->values + i, leaf->values + leaf->count,
+                     leaf->values + leaf->count + 1);
+  leaf->keys[i] = std::move(new_key);
+  leaf->values[i] = std::move(new_value);
+  leaf->count++;
+  cur_size++;
+  if (!right) return;
+
+  // Hand splits up the path until a parent has room
+  separator = static_cast<Leaf*>(right)->keys[0];
+  while (depth > 0) {
+    depth--;
+    if (InsertChild(path[depth], slot[depth], &separator, &right))
+      return;
+  }
+  // The root split: grow the tree by one level
+  Inner *new_root = NewInner();
+  new_root->keys[0] = separator;
+  new_root->children[0] = root;
+  new_root->children[1] = right;
+  new_root->count = 1;
+  root = new_root;
+}
+
+template <typename K, typename V>
+bool BTree_map<K, V>::InsertChild(Inner *parent, int pos, K *separator,
+                                  Node **right) {
+  if (parent->count < kInnerSlots) {
+    std::move_backward(parent->keys + pos, parent->keys + parent->count,
+                       parent->keys + parent->count + 1);
+    std::move_backward(parent->children + pos + 1,
+                       parent->children + parent->count + 1,
+                       parent->children + parent->count + 2);
+    parent->keys[pos] = std::move(*separator);
+    parent->children[pos + 1] = *right;
+    parent->count++;
+    return true;
+  }
+
+  // Full: lay out all keys and children in order, keep the lower half, move
+  // the upper half to a new node and pass the middle key up
+  K keys[kInnerSlots + 1];
+  Node *children[kInnerSlots + 2];
+  std::move(parent->keys, parent->keys + pos, keys);
+  keys[pos] = std::move(*separator);
+  std::move(parent->keys + pos, parent->keys + kInnerSlots, keys + pos + 1);
+  std::copy(parent->children, parent->children + pos + 1, children);
+  children[pos + 1] = *right;
+  std::copy(parent->children + pos + 1, parent->children + kInnerSlots + 1,
+            children + pos + 2);
+
+  int half = (kInnerSlots + 1) / 2;
+  Inner *sibling = NewInner();
+  std::move(keys, keys + half, parent->keys);
+  std::copy(children, children + half + 1, parent->children);
+  parent->count = half;
+  std::move(keys + half + 1, keys + kInnerSlots + 1, sibling->keys);
+  std::copy(children + half + 1, children + kInnerSlots + 2,
+            sibling->children);
+  sibling->count = kInnerSlots - half;
+
+  *separator = std::move(keys[half]);
+  *right = sibling;
+  return false;
+}
+
+template <typename K, typename V>
+void BTree_map<K, V>::Remove(const K &key) {
+  if (!root) return;
+
+  Inner *path[kMaxDepth];
+  int slot[kMaxDepth];
+  int depth = 0;
+  Node *n = root;
+  while (!n->leaf) {
+    Inner *inner = static_cast<Inner*>(n);
+    int i = BTreeCountNotGreater(inner->keys, inner->count, key);
+    path[depth] = inner;
+    slot[depth++] = i;
+    n = inner->children[i];
+  }
+
+  Leaf *leaf = static_cast<Leaf*>(n);
+  int i = BTreeCountLess(leaf->keys, leaf->count, key);
+  // Key not found
+  if (i == leaf->count || !(leaf->keys[i] == key)) return;
+
+  std::move(leaf->keys + i + 1, leaf->keys + leaf->count, leaf->keys + i);
+  std::move(leaf->values + i + 1, leaf->values + leaf->count,
+            leaf->values + i);
+  leaf->count--;
+  cur_size--;
+
+  // Refill underfull nodes bottom up while merges keep taking keys from
+  // the parent
+  while (depth > 0 && Underfull(n)) {
+    depth--;
+    if (!Rebalance(path[depth], slot[depth]))
+      break;
+    n = path[depth];
+  }
+
+  // The root keeps any number of keys, but not zero
+  if (root->count == 0) {
+    if (root->leaf) {
+      delete static_cast<Leaf*>(root);
+      root = nullptr;
+      head = tail = nullptr;
+    } else {
+      Inner *old_root = static_cast<Inner*>(root);
+      root = old_root->children[0];
+      delete old_root;
+    }
+  }
+}
+
+template <typename K, typename V>
+bool BTree_map<K, V>::Underfull(const Node *n) {
+  if (n->leaf)
+    return n->count < kLeafMin;
+  return n->count < kInnerMin;
+}
+
+template <typename K, typename V>
+bool BTree_map<K, V>::Rebalance(Inner *parent, int pos) {
+  Node *n = parent->children[pos];
+  Node *left = pos > 0 ? parent->children[pos - 1] : nullptr;
+  Node *right = pos < parent->count ? parent->children[pos + 1] : nullptr;
+
+  if (n->leaf) {
+    Leaf *leaf = static_cast<Leaf*>(n);
+    Leaf *l = static_cast<Leaf*>(left);
+    Leaf *r = static_cast<Leaf*>(right);
+    if (l && l->count > kLeafMin) {
+      // Borrow the max pair of the left sibling
+      std::move_backward(leaf->keys, leaf->keys + leaf->count,
+                         leaf->keys + leaf->count + 1);
+      std::move_backward(leaf->values, leaf->values + leaf->count,
+                         leaf->values + leaf->count + 1);
+      l->count--;
+      leaf->keys[0] = std::move(l->keys[l->count]);
+      leaf->values[0] = std::move(l->values[l->count]);
+      leaf->count++;
+      parent->keys[pos - 1] = leaf->keys[0];
+      return false;
+    }
+    if (r && r->count > kLeafMin) {
+      // Borrow the min pair of the right sibling
+      leaf->keys[leaf->count] = std::move(r->keys[0]);
+      leaf->values[leaf->count] = std::move(r->values[0]);
+      leaf->count++;
+      std::move(r->keys + 1, r->keys + r->count, r->keys);
+      std::move(r->values + 1, r->values + r->count, r->values);
+      r->count--;
+      parent->keys[pos] = r->keys[0];
+      return false;
+    }
+    // Merge with a sibling; the right one of the pair goes away
+    if (l) {
+      r = leaf;
+      pos--;
+    } else {
+      l = leaf;
+    }
+    std::move(r->keys, r->keys + r->count, l->keys + l->count);
+    std::move(r->values, r->values + r->count, l->values + l->count);
+    l->count += r->count;
+    Unlink(r);
+    delete r;
+    RemoveChild(parent, pos);
+    return true;
+  }
+
+  Inner *inner = static_cast<Inner*>(n);
+  Inner *l = static_cast<Inner*>(left);
+  Inner *r = static_cast<Inner*>(right);
+  if (l && l->count > kInnerMin) {
+    // Rotate the max child of the left sibling through the parent
+    std::move_backward(inner->keys, inner->keys + inner->count,
+                       inner->keys + inner->count + 1);
+    std::move_backward(inner->children, inner->children + inner->count + 1,
+                       inner->children + inner->count + 2);
+    inner->keys[0] = std::move(parent->keys[pos - 1]);
+    inner->children[0] = l->children[l->count];
+    inner->count++;
+    parent->keys[pos - 1] = std::move(l->keys[l->count - 1]);
+    l->count--;
+    return false;
+  }
+  if (r && r->count > kInnerMin) {
+    // Rotate the min child of the right sibling through the parent
+    inner->keys[inner->count] = std::move(parent->keys[pos]);
+    inner->children[inner->count + 1] = r->children[0];
+    inner->count++;
+    parent->keys[pos] = std::move(r->keys[0]);
+    std::move(r->keys + 1, r->keys + r->count, r->keys);
+    std::move(r->children + 1, r->children + r->count + 1, r->children);
+    r->count--;
+    return false;
+  }
+  // Merge with a sibling around the separator between them
+  if (l) {
+    r = inner;
+    pos--;
+  } else {
+    l = inner;
+  }
+  l->keys[l->count] = std::move(parent->keys[pos]);
+  std::move(r->keys, r->keys + r->count, l->keys + l->count + 1);
+  std::copy(r->children, r->children + r->count + 1,
+            l->children + l->count + 1);
+  l->count += 1 + r->count;
+  delete r;
+  RemoveChild(parent, pos);
+  return true;
+}
+
+template <typename K, typename V>
+void BTree_map<K, V>::RemoveChild(Inner *parent, int pos) {
+  // Drop separator @pos and the child right of it
+  std::move(parent->keys + pos + 1, parent->keys + parent->count,
+            parent->keys + pos);
+  std::move(parent->children + pos + 2, parent->children + parent->count + 1,
+            parent->children + pos + 1);
+  parent->count--;
+}
+
+template <typename K, typename V>
+void BTree_map<K, V>::Unlink(Leaf *leaf) {
+  if (leaf->prev)
+    leaf->prev->next = leaf->next;
+  else
+    head = leaf->next;
+  if (leaf->next)
+    leaf->next->prev = leaf->prev;
+  else
+    tail = leaf->prev;
+}
+
+template <typename K, typename V>
+void BTree_map<K, V>::Print() {
+  for (Leaf *leaf = head; leaf; leaf = leaf->next)
+    for (int i = 0; i < leaf->count; i++)
+      std::cout << "<" << leaf->keys[i] << "," << leaf->values[i] << "> ";
+  std::cout << std::endl;
+}
+
+template <typename K, typename V>
+typename BTree_map<K, V>::const_iterator BTree_map<K, V>::begin() const {
+  return const_iterator(this, head, 0);
+}
+
+template <typename K, typename V>
+typename BTree_map<K, V>::const_iterator BTree_map<K, V>::end() const {
+  return const_iterator(this, nullptr, 0);
+}
+
+template <typename K, typename V>
+typename BTree_map<K, V>::const_iterator BTree_map<K, V>::Seek(
+    const K &key, bool strict) const {
+  Leaf *leaf = FindLeaf(key);
+  if (!leaf) return end();
+  int i = strict ? BTreeCountNotGreater(leaf->keys, leaf->count, key)
+                 : BTreeCountLess(leaf->keys, leaf->count, key);
+  // Past the end of this leaf: the next leaf starts above @key
+  if (i == leaf->count)
+    return const_iterator(this, leaf->next, 0);
+  return const_iterator(this, leaf, i);
+}
+
+template <typename K, typename V>
+typename BTree_map<K, V>::const_iterator BTree_map<K, V>::LowerBound(
+    const K &key) const {
+  return Seek(key, false);
+}
+
+template <typename K, typename V>
+typename BTree_map<K, V>::const_iterator BTree_map<K, V>::UpperBound(
+    const K &key) const {
+  return Seek(key, true);
+}
+
+template <typename K, typename V>
+LLRBRange<typename BTree_map<K, V>::const_iterator> BTree_map<K, V>::Range(
+    const K &lo, const K &hi) const {
+  if (hi < lo)
+    return LLRBRange<const_iterator>(end(), end());
+  return LLRBRange<const_iterator>(LowerBound(lo), UpperBound(hi));
+}
+
+#endif  // BTREE_MAP_H_
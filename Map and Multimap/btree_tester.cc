@@ -0,0 +1,173 @@
+// Checks BTree_map against std::map under random inserts, removes and
+// lookups, walking it forward, backward from end() and over ranges as it
+// changes. Prints every failed check and exits with 1 if there are any.
+//
+// Usage: btree_tester
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "btree_map.h"
+
+namespace {
+
+int failures = 0;
+
+void Check(bool ok, const std::string& what) {
+  if (ok) return;
+  std::cerr << "FAILED: " << what << std::endl;
+  failures++;
+}
+
+// Return whether the pairs in [@first, @last) are those of [@want, @stop)
+template <typename It, typename WantIt>
+bool SamePairs(It first, It last, WantIt want, WantIt stop) {
+  for (; first != last; ++first, ++want) {
+    if (want == stop || first->first != want->first ||
+        first->second != want->second)
+      return false;
+  }
+  return want == stop;
+}
+
+// Compare every way of walking @tree with @expected
+template <typename V>
+void CheckWalks(BTree_map<int, V>& tree, const std::map<int, V>& expected,
+                int range, std::mt19937 *rng, const std::string& what) {
+  Check(tree.Size() == expected.size(), what + ": size");
+  Check(SamePairs(tree.begin(), tree.end(), expected.begin(),
+                  expected.end()), what + ": forward walk");
+
+  // Backward from end(), one step at a time
+  bool same = true;
+  auto want = expected.rbegin();
+  for (auto it = tree.end(); it != tree.begin() && same; ++want) {
+    --it;
+    same = want != expected.rend() && it->first == want->first &&
+           it->second == want->second;
+  }
+  Check(same && want == expected.rend(), what + ": backward walk");
+
+  if (expected.empty()) {
+    Check(tree.begin() == tree.end(), what + ": empty walk");
+    return;
+  }
+  Check(tree.Min() == expected.begin()->first, what + ": min");
+  Check(tree.Max() == expected.rbegin()->first, what + ": max");
+  Check((--tree.end())->first == expected.rbegin()->first,
+        what + ": last pair");
+
+  for (int i = 0; i < 20; i++) {
+    int lo = static_cast<int>((*rng)() % (range + 20)) - 10;
+    int hi = lo + static_cast<int>((*rng)() % (range / 4 + 2)) - 1;
+    auto range_pairs = tree.Range(lo, hi);
+    auto first = expected.lower_bound(lo);
+    auto last = lo <= hi ? expected.upper_bound(hi) : first;
+    Check(SamePairs(range_pairs.begin(), range_pairs.end(), first, last),
+          what + ": range " + std::to_string(lo) + " to " +
+              std::to_string(hi));
+    Check(SamePairs(tree.LowerBound(lo), tree.end(), first, expected.end()),
+          what + ": lower bound " + std::to_string(lo));
+  }
+}
+
+// Random inserts, removes and lookups on maps of keys 0 to a random bound.
+// Removes also pick keys past both ends, and some inserts copy the value of
+// a neighbouring key, which the insert may shift or split away
+template <typename V, typename MakeValue>
+void CheckMap(const std::string& name, int rounds, MakeValue make_value) {
+  std::mt19937 rng(1);
+  for (int round = 0; round < rounds; round++) {
+    int range = 1 + rng() % 5000;
+    BTree_map<int, V> tree;
+    std::map<int, V> expected;
+    std::string what = name + " round " + std::to_string(round);
+
+    tree.Remove(0);
+    for (int op = 0; op < 8000; op++) {
+      int key = static_cast<int>(rng() % (range + 20)) - 10;
+      int what_op = rng() % 5;
+      if (what_op < 2) {
+        auto near = expected.lower_bound(key);
+        if (what_op == 1 && near != expected.end() && near->first != key) {
+          tree.Insert(key, tree.Get(near->first));
+          expected.insert(std::make_pair(key, near->second));
+          continue;
+        }
+        V value = make_value(op);
+        bool threw = false;
+        try {
+          tree.Insert(key, value);
+        } catch (const std::runtime_error&) {
+          threw = true;
+        }
+        Check(threw == (expected.count(key) == 1),
+              what + ": insert of " + std::to_string(key));
+        expected.insert(std::make_pair(key, value));
+      } else if (what_op < 4) {
+        tree.Remove(key);
+        expected.erase(key);
+      } else {
+        auto found = expected.find(key);
+        bool contains = tree.Contains(key);
+        Check(contains == (found != expected.end()),
+              what + ": contains " + std::to_string(key));
+        if (contains && found != expected.end())
+          Check(tree.Get(key) == found->second,
+                what + ": get " + std::to_string(key));
+      }
+      if (op % 1000 == 0) CheckWalks(tree, expected, range, &rng, what);
+    }
+    CheckWalks(tree, expected, range, &rng, what);
+
+    std::vector<int> keys;
+    for (const auto& entry : expected) keys.push_back(entry.first);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      tree.Remove(keys[i]);
+      tree.Remove(keys[i]);
+      expected.erase(keys[i]);
+      if (i % 500 == 0) CheckWalks(tree, expected, range, &rng, what);
+    }
+    CheckWalks(tree, expected, range, &rng, what + " emptied");
+  }
+}
+
+// Keys inserted in order, each with a copy of the value of the key before
+// it, which sits at the end of the leaf the insert splits or shifts
+void CheckInsertOwnValue(int n) {
+  BTree_map<int, std::string> tree;
+  std::map<int, std::string> expected;
+  tree.Insert(0, std::string(30, 'v'));
+  expected[0] = std::string(30, 'v');
+  for (int i = 1; i < n; i++) {
+    int key = i % 2 ? -i : i;
+    int other = i % 2 ? expected.begin()->first : expected.rbegin()->first;
+    tree.Insert(key, tree.Get(other));
+    expected[key] = expected[other];
+  }
+  Check(SamePairs(tree.begin(), tree.end(), expected.begin(),
+                  expected.end()), "insert of a value the map holds");
+}
+
+}  // namespace
+
+int main() {
+  CheckMap<int>("int map", 60, [](int n) { return n; });
+  CheckMap<std::string>("string map", 30, [](int n) {
+    return std::string(24, 's') + std::to_string(n);
+  });
+  CheckInsertOwnValue(5000);
+  if (failures > 0) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "btree_tester: all checks passed" << std::endl;
+  return 0;
+}
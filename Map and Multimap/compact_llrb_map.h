@@ -0,0 +1,566 @@
+#ifndef COMPACT_LLRB_MAP_H_
+#define COMPACT_LLRB_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include "llrb_iterator.h"
+
+// Left-leaning red-black tree map for integral keys, laid out to keep nodes
+// small. Nodes live in one array and link to each other by 32-bit index
+// rather than by pointer, and the color is the top bit of the left link, so
+// a CompactLLRB_map<uint64_t, uint32_t> node takes 24 bytes where an
+// LLRB_map node takes 32 plus what malloc adds to it. The array doubles as
+// the map grows, moving the nodes but keeping their indexes. Holds up to
+// 2^31 - 2 keys
+template <typename K, typename V>
+class CompactLLRB_map {
+  static_assert(std::is_integral<K>::value,
+                "CompactLLRB_map needs integral keys");
+
+ public:
+  CompactLLRB_map() {}
+  CompactLLRB_map(CompactLLRB_map&& other);
+  CompactLLRB_map& operator=(CompactLLRB_map&& other);
+  CompactLLRB_map(const CompactLLRB_map&) = delete;
+  CompactLLRB_map& operator=(const CompactLLRB_map&) = delete;
+  ~CompactLLRB_map();
+
+  // Return size of tree
+  unsigned int Size() const { return cur_size; }
+  // Return bytes held for nodes, free or not
+  std::size_t BytesUsed() const;
+  // Return whether @key is found in tree
+  bool Contains(K key) const;
+  // Return max key in tree. Throws std::runtime_error if tree is empty
+  K Max() const;
+  // Return min key in tree. Throws std::runtime_error if tree is empty
+  K Min() const;
+  // Insert @key in tree. Throws std::runtime_error if it is already there
+  void Insert(K key, const V &value);
+  // Remove @key from tree
+  void Remove(K key);
+  // Remove every key from tree
+  void Clear();
+  // Get value given key. Throws std::runtime_error if @key is not in tree
+  const V& Get(K key) const;
+
+  // Iterators visit <key, value> pairs in key order, handing out references
+  // into the tree. Insert, Remove and Clear invalidate them
+  class const_iterator;
+  typedef const_iterator iterator;
+  const_iterator begin() const;
+  const_iterator end() const;
+
+ private:
+  struct Node {
+    K key;
+    V value;
+    // Indexes of the left and right children, 0 for none. The top bit of
+    // the left one is set if the node is red
+    uint32_t link[2];
+  };
+  // Slots hold a node or, once it is freed, the next free slot
+  union Slot {
+    Slot() {}
+    ~Slot() {}
+    Node node;
+    uint32_t next_free;
+  };
+
+  static const uint32_t kRed = 0x80000000u;
+  static const uint32_t kIndexMask = 0x7fffffffu;
+  static const uint32_t kMinCapacity = 64;
+  // Insert and Remove keep the nodes they pass on a fixed stack. A tree of
+  // 2^31 keys is at most 62 levels deep, the rest is slack for the red
+  // links Remove pushes down while descending
+  static const int kMaxDepth = 96;
+
+  std::unique_ptr<Slot[]> slots;
+  uint32_t capacity = 0;
+  // Index 0 stands for no node, so slot 0 is never handed out
+  uint32_t next_index = 1;
+  uint32_t free_list = 0;
+  uint32_t root = 0;
+  unsigned int cur_size = 0;
+
+  // Helper methods for node storage
+  Node& At(uint32_t i) { return slots[i].node; }
+  const Node& At(uint32_t i) const { return slots[i].node; }
+  uint32_t NewNode(K key, const V &value);
+  void DeleteNode(uint32_t i);
+  void DestroyTree(uint32_t i);
+  // Move nodes to an array twice the size, keeping their indexes
+  void Grow();
+  // Call @visit on the index of every node, in key order
+  template <typename Visit> void ForEachNode(Visit visit) const;
+
+  // Return <0, 0 or >0 as @a is less than, equal to or greater than @b,
+  // with no branches for integral keys
+  static int Compare(K a, K b) { return (a > b) - (a < b); }
+  // Return index of node of @key, 0 if there is none
+  uint32_t Find(K key) const;
+
+  // Helper methods for links and colors
+  uint32_t Left(uint32_t i) const { return At(i).link[0] & kIndexMask; }
+  uint32_t Right(uint32_t i) const { return At(i).link[1]; }
+  void SetLink(uint32_t i, int side, uint32_t child) {
+    uint32_t &link = At(i).link[side];
+    link = (link & kRed) | child;
+  }
+  bool IsRed(uint32_t i) const { return i && (At(i).link[0] & kRed); }
+  void SetRed(uint32_t i, bool red) {
+    At(i).link[0] = (At(i).link[0] & kIndexMask) | (red ? kRed : 0);
+  }
+
+  // Helper methods for the self-balancing, returning the new subtree root
+  void FlipColors(uint32_t h);
+  uint32_t RotateRight(uint32_t h);
+  uint32_t RotateLeft(uint32_t h);
+  uint32_t FixUp(uint32_t h);
+  uint32_t MoveRedRight(uint32_t h);
+  uint32_t MoveRedLeft(uint32_t h);
+};
+
+template <typename K, typename V>
+class CompactLLRB_map<K, V>::const_iterator {
+ public:
+  typedef std::forward_iterator_tag iterator_category;
+  typedef std::pair<K, V> value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef std::pair<const K&, const V&> reference;
+  typedef LLRBArrowProxy<reference> pointer;
+
+  const_iterator() : map(nullptr), depth(0) {}
+
+  reference operator*() const {
+    const Node &n = map->At(path[depth - 1]);
+    return reference(n.key, n.value);
+  }
+  pointer operator->() const { return pointer(**this); }
+
+  const_iterator& operator++() {
+    uint32_t i = path[depth - 1];
+    if (map->Right(i)) {
+      PushMin(map->Right(i));
+      return *this;
+    }
+    // Climb until arriving from a left child
+    do {
+      i = path[--depth];
+    } while (depth && map->Right(path[depth - 1]) == i);
+    return *this;
+  }
+  const_iterator operator++(int) {
+    const_iterator old(*this);
+    ++*this;
+    return old;
+  }
+
+  bool operator==(const const_iterator &other) const {
+    return Current() == other.Current();
+  }
+  bool operator!=(const const_iterator &other) const {
+    return Current() != other.Current();
+  }
+
+ private:
+  friend class CompactLLRB_map;
+  explicit const_iterator(const CompactLLRB_map *map) : map(map), depth(0) {}
+
+  uint32_t Current() const { return depth ? path[depth - 1] : 0; }
+  void PushMin(uint32_t i) {
+    for (; i; i = map->Left(i)) path[depth++] = i;
+  }
+
+  const CompactLLRB_map *map;
+  uint32_t path[kMaxDepth];
+  int depth;
+};
+
+template <typename K, typename V>
+CompactLLRB_map<K, V>::CompactLLRB_map(CompactLLRB_map&& other)
+    : slots(std::move(other.slots)),
+      capacity(other.capacity),
+      next_index(other.next_index),
+      free_list(other.free_list),
+      root(other.root),
+      cur_size(other.cur_size) {
+  other.capacity = 0;
+  other.next_index = 1;
+  other.free_list = other.root = 0;
+  other.cur_size = 0;
+}
+
+template <typename K, typename V>
+CompactLLRB_map<K, V>& CompactLLRB_map<K, V>::operator=(
+    CompactLLRB_map&& other) {
+  if (this != &other) {
+    Clear();
+    std::swap(slots, other.slots);
+    std::swap(capacity, other.capacity);
+    std::swap(next_index, other.next_index);
+    std::swap(free_list, other.free_list);
+    std::swap(root, other.root);
+    std::swap(cur_size, other.cur_size);
+  }
+  return *this;
+}
+
+template <typename K, typename V>
+CompactLLRB_map<K, V>::~CompactLLRB_map() {
+  Clear();
+}
+
+template <typename K, typename V>
+std::size_t CompactLLRB_map<K, V>::BytesUsed() const {
+  return std::size_t(capacity) * sizeof(Slot);
+}
+
+template <typename K, typename V>
+uint32_t CompactLLRB_map<K, V>::NewNode(K key, const V &value) {
+  uint32_t i = free_list;
+  if (i) {
+    free_list = slots[i].next_free;
+  } else {
+    if (next_index == kIndexMask)
+      throw std::runtime_error("Error: map is full");
+    if (next_index >= capacity) {
+      // @value may be the value of a node, which Grow moves, so copy it
+      // first and build the node from the copy
+      V held(value);
+      Grow();
+      return NewNode(key, held);
+    }
+    i = next_index++;
+  }
+  try {
+    ::new (static_cast<void*>(&At(i))) Node{key, value, {kRed, 0}};
+  } catch (...) {
+    slots[i].next_free = free_list;
+    free_list = i;
+    throw;
+  }
+  return i;
+}
+
+template <typename K, typename V>
+void CompactLLRB_map<K, V>::DeleteNode(uint32_t i) {
+  At(i).~Node();
+  slots[i].next_free = free_list;
+  free_list = i;
+}
+
+template <typename K, typename V>
+void CompactLLRB_map<K, V>::DestroyTree(uint32_t i) {
+  // Destroy node by node without recursion. Rotating left children up turns
+  // the tree into a right-leaning list that is destroyed front to back
+  while (i) {
+    uint32_t l = Left(i);
+    if (l) {
+      SetLink(i, 0, Right(l));
+      SetLink(l, 1, i);
+      i = l;
+    } else {
+      uint32_t next = Right(i);
+      At(i).~Node();
+      i = next;
+    }
+  }
+}
+
+template <typename K, typename V>
+void CompactLLRB_map<K, V>::Grow() {
+  uint32_t grown_capacity = capacity ? 2 * capacity : kMinCapacity;
+  if (grown_capacity > kIndexMask + 1u) grown_capacity = kIndexMask + 1u;
+  std::unique_ptr<Slot[]> grown(new Slot[grown_capacity]);
+  if (std::is_trivially_copyable<Node>::value) {
+    if (capacity)
+      std::memcpy(static_cast<void*>(grown.get()), slots.get(),
+                  capacity * sizeof(Slot));
+  } else {
+    // Free slots hold only their link, live ones a node to move over
+    for (uint32_t i = free_list; i; i = slots[i].next_free)
+      grown[i].next_free = slots[i].next_free;
+    std::size_t moved = 0;
+    try {
+      ForEachNode([&](uint32_t i) {
+        ::new (static_cast<void*>(&grown[i].node))
+            Node(std::move_if_noexcept(At(i)));
+        moved++;
+      });
+    } catch (...) {
+      ForEachNode([&](uint32_t i) {
+        if (moved > 0) {
+          grown[i].node.~Node();
+          moved--;
+        }
+      });
+      throw;
+    }
+    ForEachNode([this](uint32_t i) { At(i).~Node(); });
+  }
+  slots = std::move(grown);
+  capacity = grown_capacity;
+}
+
+template <typename K, typename V>
+template <typename Visit>
+void CompactLLRB_map<K, V>::ForEachNode(Visit visit) const {
+  uint32_t path[kMaxDepth];
+  int depth = 0;
+  uint32_t i = root;
+  while (i || depth > 0) {
+    for (; i; i = Left(i)) path[depth++] = i;
+    i = path[--depth];
+    uint32_t next = Right(i);
+    visit(i);
+    i = next;
+  }
+}
+
+template <typename K, typename V>
+void CompactLLRB_map<K, V>::Clear() {
+  // Slots go all at once, so only values that need it are destroyed
+  if (!std::is_trivially_destructible<Node>::value)
+    DestroyTree(root);
+  slots.reset();
+  capacity = 0;
+  next_index = 1;
+  free_list = root = 0;
+  cur_size = 0;
+}
+
+template <typename K, typename V>
+uint32_t CompactLLRB_map<K, V>::Find(K key) const {
+  uint32_t i = root;
+  while (i) {
+    const Node &n = At(i);
+    if (key == n.key) break;
+    // Start loading both children while the keys are compared, so the next
+    // node is on its way whichever side the search takes
+    uint32_t left = n.link[0] & kIndexMask, right = n.link[1];
+    __builtin_prefetch(&slots[left]);
+    __builtin_prefetch(&slots[right]);
+    i = key < n.key ? left : right;
+  }
+  return i;
+}
+
+template <typename K, typename V>
+bool CompactLLRB_map<K, V>::Contains(K key) const {
+  return Find(key) != 0;
+}
+
+template <typename K, typename V>
+const V& CompactLLRB_map<K, V>::Get(K key) const {
+  uint32_t i = Find(key);
+  if (!i)
+    throw std::runtime_error("Error: Key not in map");
+  return At(i).value;
+}
+
+template <typename K, typename V>
+K CompactLLRB_map<K, V>::Max() const {
+  if (!root)
+    throw std::runtime_error("Error: Map is empty");
+  uint32_t i = root;
+  while (Right(i)) i = Right(i);
+  return At(i).key;
+}
+
+template <typename K, typename V>
+K CompactLLRB_map<K, V>::Min() const {
+  if (!root)
+    throw std::runtime_error("Error: Map is empty");
+  uint32_t i = root;
+  while (Left(i)) i = Left(i);
+  return At(i).key;
+}
+
+template <typename K, typename V>
+void CompactLLRB_map<K, V>::Insert(K key, const V &value) {
+  // Nodes from the root down to the new node, and the side taken at each,
+  // fixed up on the way back
+  uint32_t path[kMaxDepth];
+  int side[kMaxDepth];
+  int depth = 0;
+  for (uint32_t i = root; i;) {
+    const Node &n = At(i);
+    int c = Compare(key, n.key);
+    if (c == 0)
+      throw std::runtime_error("Key already inserted");
+    path[depth] = i;
+    side[depth++] = c > 0;
+    i = n.link[c > 0] & kIndexMask;
+  }
+
+  uint32_t child = NewNode(key, value);
+  while (depth > 0) {
+    depth--;
+    SetLink(path[depth], side[depth], child);
+    child = FixUp(path[depth]);
+  }
+  root = child;
+  SetRed(root, false);
+  cur_size++;
+}
+
+template <typename K, typename V>
+void CompactLLRB_map<K, V>::Remove(K key) {
+  // Nodes from the root down to the current one and the side taken at each,
+  // fixed up on the way back. A rotation on the way down leaves the link
+  // above it stale until then
+  uint32_t path[kMaxDepth];
+  int side[kMaxDepth];
+  int depth = 0;
+  uint32_t h = root;
+  bool removed = false;
+  while (h) {
+    if (key < At(h).key) {
+      // Key not found
+      if (!Left(h)) break;
+      if (!IsRed(Left(h)) && !IsRed(Left(Left(h))))
+        h = MoveRedLeft(h);
+      path[depth] = h;
+      side[depth++] = 0;
+      h = Left(h);
+      continue;
+    }
+
+    if (IsRed(Left(h)))
+      h = RotateRight(h);
+    if (At(h).key == key && !Right(h)) {
+      // Remove h, nothing is left below it to fix
+      DeleteNode(h);
+      h = 0;
+      removed = true;
+      break;
+    }
+    // Key not found
+    if (!Right(h)) break;
+
+    if (!IsRed(Right(h)) && !IsRed(Left(Right(h))))
+      h = MoveRedRight(h);
+    path[depth] = h;
+    side[depth++] = 1;
+    if (At(h).key == key) {
+      // Walk down to the min node of the right subtree, moving a red link
+      // down the left side as the descent goes
+      int h_depth = depth - 1;
+      uint32_t min = Right(h);
+      while (Left(min)) {
+        if (!IsRed(Left(min)) && !IsRed(Left(Left(min))))
+          min = MoveRedLeft(min);
+        path[depth] = min;
+        side[depth++] = 0;
+        min = Left(min);
+      }
+      // Unlink the min node and put it in the place of h, links and color
+      // included, so no key or value is copied
+      At(min).link[0] = At(h).link[0];
+      At(min).link[1] = At(h).link[1];
+      path[h_depth] = min;
+      DeleteNode(h);
+      h = 0;
+      removed = true;
+      break;
+    }
+    h = Right(h);
+  }
+
+  uint32_t child = h ? FixUp(h) : 0;
+  while (depth > 0) {
+    depth--;
+    SetLink(path[depth], side[depth], child);
+    child = FixUp(path[depth]);
+  }
+  root = child;
+  if (root)
+    SetRed(root, false);
+  if (removed)
+    cur_size--;
+}
+
+template <typename K, typename V>
+void CompactLLRB_map<K, V>::FlipColors(uint32_t h) {
+  At(h).link[0] ^= kRed;
+  At(Left(h)).link[0] ^= kRed;
+  At(Right(h)).link[0] ^= kRed;
+}
+
+template <typename K, typename V>
+uint32_t CompactLLRB_map<K, V>::RotateRight(uint32_t h) {
+  uint32_t x = Left(h);
+  SetLink(h, 0, Right(x));
+  SetLink(x, 1, h);
+  SetRed(x, IsRed(h));
+  SetRed(h, true);
+  return x;
+}
+
+template <typename K, typename V>
+uint32_t CompactLLRB_map<K, V>::RotateLeft(uint32_t h) {
+  uint32_t x = Right(h);
+  SetLink(h, 1, Left(x));
+  SetLink(x, 0, h);
+  SetRed(x, IsRed(h));
+  SetRed(h, true);
+  return x;
+}
+
+template <typename K, typename V>
+uint32_t CompactLLRB_map<K, V>::FixUp(uint32_t h) {
+  // Rotate left if there is a right-leaning red node
+  if (IsRed(Right(h)) && !IsRed(Left(h)))
+    h = RotateLeft(h);
+  // Rotate right if red-red pair of nodes on left
+  if (IsRed(Left(h)) && IsRed(Left(Left(h))))
+    h = RotateRight(h);
+  // Recoloring if both children are red
+  if (IsRed(Left(h)) && IsRed(Right(h)))
+    FlipColors(h);
+  return h;
+}
+
+template <typename K, typename V>
+uint32_t CompactLLRB_map<K, V>::MoveRedRight(uint32_t h) {
+  FlipColors(h);
+  if (IsRed(Left(Left(h)))) {
+    h = RotateRight(h);
+    FlipColors(h);
+  }
+  return h;
+}
+
+template <typename K, typename V>
+uint32_t CompactLLRB_map<K, V>::MoveRedLeft(uint32_t h) {
+  FlipColors(h);
+  if (IsRed(Left(Right(h)))) {
+    SetLink(h, 1, RotateRight(Right(h)));
+    h = RotateLeft(h);
+    FlipColors(h);
+  }
+  return h;
+}
+
+template <typename K, typename V>
+typename CompactLLRB_map<K, V>::const_iterator
+CompactLLRB_map<K, V>::begin() const {
+  const_iterator it(this);
+  it.PushMin(root);
+  return it;
+}
+
+template <typename K, typename V>
+typename CompactLLRB_map<K, V>::const_iterator
+CompactLLRB_map<K, V>::end() const {
+  return const_iterator(this);
+}
+
+#endif  // COMPACT_LLRB_MAP_H_
@@ -0,0 +1,256 @@
+// Runs insert, lookup, in-order scan and remove workloads on LLRB_map,
+// LLRB_multimap and BST next to std::map and std::multimap, and prints one
+// CSV row per container, workload and phase with the time per operation,
+// the heap allocations made and the peak heap bytes in use above what the
+// phase started with.
+//
+// Workloads:
+//   sequential  every phase visits the keys in increasing order
+//   random      every phase visits the keys in its own random order
+//   zipf        random inserts and removes; lookups draw keys with a Zipf
+//               skew, so a few hot keys take most of them
+//   sorted      keys go in in increasing order, then are looked up and
+//               removed in random order
+//
+// BST does not balance, so sorted input turns it into a list. On the
+// sequential and sorted workloads it runs on at most kMaxUnbalancedKeys
+// keys, as the keys column shows, and it has no scan since it has no
+// iterators.
+//
+// Usage: container_bench [num_keys] [rounds]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "../Binary Tree/bst.h"
+#include "heap_counter.h"
+#include "llrb_map.h"
+#include "llrb_multimap.h"
+
+namespace {
+
+// BST on sorted input is a list, with O(n) inserts and recursion as deep as
+// the list is long
+const unsigned int kMaxUnbalancedKeys = 10000;
+
+// Zipf exponent of the lookups in the zipf workload
+const double kZipfSkew = 0.99;
+
+}  // namespace
+
+// Adapters so one timing loop drives every container. Scan returns whether
+// the container can walk its keys in order, and adds the values to @sum
+template <typename Map>
+struct Ops {
+  static void Insert(Map& m, int key) { m.Insert(key, key); }
+  static bool Contains(Map& m, int key) { return m.Contains(key); }
+  static void Remove(Map& m, int key) { m.Remove(key); }
+  static bool Scan(const Map& m, long long *sum) {
+    for (auto const& pair : m) *sum += pair.second;
+    return true;
+  }
+};
+
+template <>
+struct Ops<BST<int>> {
+  typedef BST<int> Map;
+  static void Insert(Map& m, int key) { m.insert(key); }
+  static bool Contains(Map& m, int key) { return m.contains(key); }
+  static void Remove(Map& m, int key) { m.remove(key); }
+  static bool Scan(const Map&, long long*) { return false; }
+};
+
+template <>
+struct Ops<std::map<int, int>> {
+  typedef std::map<int, int> Map;
+  static void Insert(Map& m, int key) { m.emplace(key, key); }
+  static bool Contains(Map& m, int key) { return m.count(key) != 0; }
+  static void Remove(Map& m, int key) { m.erase(key); }
+  static bool Scan(const Map& m, long long *sum) {
+    for (auto const& pair : m) *sum += pair.second;
+    return true;
+  }
+};
+
+template <>
+struct Ops<std::multimap<int, int>> {
+  typedef std::multimap<int, int> Map;
+  static void Insert(Map& m, int key) { m.emplace(key, key); }
+  static bool Contains(Map& m, int key) { return m.count(key) != 0; }
+  static void Remove(Map& m, int key) {
+    Map::iterator it = m.find(key);
+    if (it != m.end()) m.erase(it);
+  }
+  static bool Scan(const Map& m, long long *sum) {
+    for (auto const& pair : m) *sum += pair.second;
+    return true;
+  }
+};
+
+// Keys each phase visits, in order. Every workload inserts and removes the
+// keys 0 to n - 1 once each
+struct Workload {
+  std::string name;
+  std::vector<int> insert;
+  std::vector<int> lookup;
+  std::vector<int> remove;
+};
+
+// Return @n keys drawn from @keys, the i-th with weight 1 / (i + 1)^s
+std::vector<int> ZipfKeys(const std::vector<int>& keys, unsigned int n,
+  std::mt19937 *rng) {
+  std::vector<double> cdf(keys.size());
+  double total = 0;
+  for (std::size_t i = 0; i < keys.size(); i++) {
+    total += 1 / std::pow(i + 1.0, kZipfSkew);
+    cdf[i] = total;
+  }
+  std::uniform_real_distribution<double> uniform(0, total);
+  std::vector<int> draws(n);
+  for (unsigned int i = 0; i < n; i++) {
+    std::size_t rank = std::upper_bound(cdf.begin(), cdf.end(),
+                                        uniform(*rng)) - cdf.begin();
+    draws[i] = keys[std::min(rank, keys.size() - 1)];
+  }
+  return draws;
+}
+
+std::vector<Workload> MakeWorkloads(unsigned int num_keys) {
+  std::mt19937 rng(1);
+  std::vector<int> sorted(num_keys);
+  for (unsigned int i = 0; i < num_keys; i++) sorted[i] = i;
+  auto shuffled = [&]() {
+    std::vector<int> keys(sorted);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    return keys;
+  };
+
+  std::vector<Workload> workloads(4);
+  workloads[0] = {"sequential", sorted, sorted, sorted};
+  workloads[1] = {"random", shuffled(), shuffled(), shuffled()};
+  // Hot keys are spread over the tree, not bunched at the low end
+  workloads[2] = {"zipf", shuffled(), ZipfKeys(shuffled(), num_keys, &rng),
+                  shuffled()};
+  workloads[3] = {"sorted", sorted, shuffled(), shuffled()};
+  return workloads;
+}
+
+// Cost of one phase
+struct Phase {
+  double ns_per_op;
+  std::size_t allocations;
+  std::size_t peak_bytes;
+};
+
+// Measure @op called @n times, @op(i) for i from 0
+template <typename Op>
+Phase Measure(std::size_t n, Op op) {
+  std::size_t allocations = heap_counter.allocations;
+  std::size_t base = heap_counter.in_use;
+  heap_counter.ResetPeak();
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < n; i++) op(i);
+  auto stop = std::chrono::steady_clock::now();
+  Phase phase;
+  phase.ns_per_op =
+      std::chrono::duration<double, std::nano>(stop - start).count() / n;
+  phase.allocations = heap_counter.allocations - allocations;
+  phase.peak_bytes = heap_counter.peak - base;
+  return phase;
+}
+
+void PrintRow(const std::string& container, const Workload& workload,
+  const std::string& phase_name, const Phase& phase) {
+  std::cout << container << "," << workload.name << ","
+            << workload.insert.size() << "," << phase_name << ","
+            << phase.ns_per_op << "," << phase.allocations << ","
+            << phase.peak_bytes << std::endl;
+}
+
+// Run @workload @rounds times on a fresh @Map each time. Times are averaged
+// over the rounds; allocations and peak bytes, the same every round, are
+// those of the last one
+template <typename Map>
+void Run(const std::string& name, const Workload& workload,
+  unsigned int rounds) {
+  const std::size_t n = workload.insert.size();
+  Phase totals[4] = {};
+  Phase last[4] = {};
+  bool scanned = false;
+  std::size_t found = 0, expected_found = 0;
+  long long sum = 0;
+  for (unsigned int r = 0; r < rounds; r++) {
+    Map m;
+    last[0] = Measure(n, [&](std::size_t i) {
+      Ops<Map>::Insert(m, workload.insert[i]);
+    });
+    last[1] = Measure(workload.lookup.size(), [&](std::size_t i) {
+      found += Ops<Map>::Contains(m, workload.lookup[i]);
+    });
+    expected_found += workload.lookup.size();
+    last[2] = Measure(1, [&](std::size_t) {
+      scanned = Ops<Map>::Scan(m, &sum);
+    });
+    last[2].ns_per_op /= n;
+    last[3] = Measure(n, [&](std::size_t i) {
+      Ops<Map>::Remove(m, workload.remove[i]);
+    });
+    for (int p = 0; p < 4; p++) totals[p].ns_per_op += last[p].ns_per_op;
+  }
+  // Keys are 0 to n - 1 and every value is its key
+  long long keys = n;
+  long long expected_sum = scanned ? keys * (keys - 1) / 2 * rounds : 0;
+  if (found != expected_found || sum != expected_sum) {
+    std::cerr << "Error: " << name << " lost keys" << std::endl;
+    std::exit(1);
+  }
+
+  const char *phase_names[4] = {"insert", "lookup", "scan", "remove"};
+  for (int p = 0; p < 4; p++) {
+    if (p == 2 && !scanned) continue;
+    last[p].ns_per_op = totals[p].ns_per_op / rounds;
+    PrintRow(name, workload, phase_names[p], last[p]);
+  }
+}
+
+template <typename Map>
+void RunAll(const std::string& name, const std::vector<Workload>& workloads,
+  unsigned int rounds) {
+  for (const Workload& workload : workloads)
+    Run<Map>(name, workload, rounds);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int num_keys = argc > 1 ? std::atoi(argv[1]) : 200000;
+  unsigned int rounds = argc > 2 ? std::atoi(argv[2]) : 3;
+  if (num_keys == 0 || rounds == 0) {
+    std::cerr << "Usage: " << argv[0] << " [num_keys] [rounds]" << std::endl;
+    return 1;
+  }
+
+  std::vector<Workload> workloads = MakeWorkloads(num_keys);
+  // BST gets the balanced-shape workloads at full size, and the ones that
+  // feed it sorted keys cut down
+  std::vector<Workload> bst_workloads = workloads;
+  if (num_keys > kMaxUnbalancedKeys) {
+    std::vector<Workload> small = MakeWorkloads(kMaxUnbalancedKeys);
+    bst_workloads[0] = small[0];
+    bst_workloads[3] = small[3];
+  }
+
+  std::cout << "container,workload,keys,phase,ns_per_op,allocations,"
+               "peak_bytes" << std::endl;
+  RunAll<LLRB_map<int, int>>("LLRB_map", workloads, rounds);
+  RunAll<LLRB_multimap<int, int>>("LLRB_multimap", workloads, rounds);
+  RunAll<BST<int>>("BST", bst_workloads, rounds);
+  RunAll<std::map<int, int>>("std::map", workloads, rounds);
+  RunAll<std::multimap<int, int>>("std::multimap", workloads, rounds);
+  return 0;
+}
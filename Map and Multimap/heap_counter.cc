@@ -0,0 +1,22 @@
+#include "heap_counter.h"
+#include <malloc.h>
+#include <cstdlib>
+#include <new>
+
+HeapCounter heap_counter = {0, 0, 0};
+
+void* operator new(std::size_t size) {
+  void *p = std::malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  heap_counter.allocations++;
+  heap_counter.in_use += malloc_usable_size(p);
+  if (heap_counter.in_use > heap_counter.peak)
+    heap_counter.peak = heap_counter.in_use;
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  if (!p) return;
+  heap_counter.in_use -= malloc_usable_size(p);
+  std::free(p);
+}
@@ -0,0 +1,24 @@
+#ifndef HEAP_COUNTER_H_
+#define HEAP_COUNTER_H_
+
+#include <cstddef>
+
+// Heap use of the whole program, kept by the global operator new and delete
+// in heap_counter.cc once that is linked in. Sizes are what malloc hands
+// out, rounding included. The counters are not synchronized, so only
+// single-threaded programs get exact numbers
+struct HeapCounter {
+  // Number of calls to operator new
+  std::size_t allocations;
+  // Bytes allocated and not yet freed
+  std::size_t in_use;
+  // Most bytes in use at once since the last ResetPeak
+  std::size_t peak;
+
+  // Start a new peak from what is in use now
+  void ResetPeak() { peak = in_use; }
+};
+
+extern HeapCounter heap_counter;
+
+#endif  // HEAP_COUNTER_H_
@@ -0,0 +1,296 @@
+// Times insert, lookup, in-order scan and remove on the LLRB containers,
+// CompactLLRB_map and BTree_map with shuffled and sorted keys, next to
+// std::map and std::multimap for reference.
+//
+// Usage: llrb_bench [num_keys] [rounds]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "btree_map.h"
+#include "compact_llrb_map.h"
+#include "llrb_map.h"
+#include "llrb_multimap.h"
+
+// Adapters so one timing loop drives every container
+template <typename Map>
+struct Ops {
+  static void Insert(Map& m, int key) { m.Insert(key, key); }
+  static bool Contains(Map& m, int key) { return m.Contains(key); }
+  static void Remove(Map& m, int key) { m.Remove(key); }
+};
+
+template <>
+struct Ops<std::map<int, int>> {
+  typedef std::map<int, int> Map;
+  static void Insert(Map& m, int key) { m.emplace(key, key); }
+  static bool Contains(Map& m, int key) { return m.count(key) != 0; }
+  static void Remove(Map& m, int key) { m.erase(key); }
+};
+
+template <>
+struct Ops<std::multimap<int, int>> {
+  typedef std::multimap<int, int> Map;
+  static void Insert(Map& m, int key) { m.emplace(key, key); }
+  static bool Contains(Map& m, int key) { return m.count(key) != 0; }
+  static void Remove(Map& m, int key) {
+    Map::iterator it = m.find(key);
+    if (it != m.end()) m.erase(it);
+  }
+};
+
+// Return nanoseconds per key taken by @op over @keys
+template <typename Op>
+double NsPerKey(const std::vector<int>& keys, Op op) {
+  auto start = std::chrono::steady_clock::now();
+  for (int key : keys) op(key);
+  auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count() /
+         keys.size();
+}
+
+template <typename Map>
+void Run(const std::string& name, const std::string& order,
+  const std::vector<int>& keys, unsigned int rounds) {
+  double insert = 0, lookup = 0, scan = 0, remove = 0;
+  unsigned int found = 0;
+  long long sum = 0;
+  for (unsigned int r = 0; r < rounds; r++) {
+    Map m;
+    insert += NsPerKey(keys, [&](int key) { Ops<Map>::Insert(m, key); });
+    lookup += NsPerKey(keys, [&](int key) {
+      found += Ops<Map>::Contains(m, key);
+    });
+    auto start = std::chrono::steady_clock::now();
+    for (auto const& pair : m) sum += pair.second;
+    auto stop = std::chrono::steady_clock::now();
+    scan += std::chrono::duration<double, std::nano>(stop - start).count() /
+            keys.size();
+    remove += NsPerKey(keys, [&](int key) { Ops<Map>::Remove(m, key); });
+  }
+  // Keys are 0 to n - 1 and every value is its key
+  long long n = keys.size();
+  if (found != keys.size() * rounds || sum != n * (n - 1) / 2 * rounds) {
+    std::cerr << "Error: " << name << " lost keys" << std::endl;
+    std::exit(1);
+  }
+  std::cout << std::left << std::setw(24) << name << std::setw(10) << order
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << insert / rounds
+            << std::setw(10) << lookup / rounds
+            << std::setw(10) << scan / rounds
+            << std::setw(10) << remove / rounds << std::endl;
+}
+
+template <typename Map>
+void RunOrders(const std::string& name, const std::vector<int>& shuffled,
+  const std::vector<int>& sorted, unsigned int rounds) {
+  Run<Map>(name, "shuffled", shuffled, rounds);
+  Run<Map>(name, "sorted", sorted, rounds);
+}
+
+// Return milliseconds taken by @build, run on a fresh map
+template <typename Map = LLRB_map<int, int>, typename Build>
+double BuildMs(unsigned int expected_size, Build build) {
+  Map m;
+  auto start = std::chrono::steady_clock::now();
+  build(m);
+  auto stop = std::chrono::steady_clock::now();
+  if (m.Size() != expected_size) {
+    std::cerr << "Error: build lost keys" << std::endl;
+    std::exit(1);
+  }
+  return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+// Compare building a map key by key against BulkLoad
+void RunBulkLoad(const std::vector<int>& shuffled,
+  const std::vector<int>& sorted) {
+  std::vector<std::pair<int, int>> sorted_pairs, shuffled_pairs;
+  for (int key : sorted) sorted_pairs.emplace_back(key, key);
+  for (int key : shuffled) shuffled_pairs.emplace_back(key, key);
+  unsigned int size = sorted.size();
+
+  std::cout << std::endl << "building LLRB_map, ms" << std::endl;
+  std::cout << std::left << std::setw(34) << "Insert, sorted keys"
+            << std::right << std::setw(10) << BuildMs(size, [&](
+                 LLRB_map<int, int>& m) {
+                   for (int key : sorted) m.Insert(key, key);
+                 }) << std::endl;
+  std::cout << std::left << std::setw(34) << "BulkLoad, sorted keys"
+            << std::right << std::setw(10) << BuildMs(size, [&](
+                 LLRB_map<int, int>& m) {
+                   m.BulkLoad(sorted_pairs.begin(), sorted_pairs.end());
+                 }) << std::endl;
+  std::cout << std::left << std::setw(34) << "Insert, shuffled keys"
+            << std::right << std::setw(10) << BuildMs(size, [&](
+                 LLRB_map<int, int>& m) {
+                   for (int key : shuffled) m.Insert(key, key);
+                 }) << std::endl;
+  std::cout << std::left << std::setw(34) << "BulkLoadUnsorted, shuffled keys"
+            << std::right << std::setw(10) << BuildMs(size, [&](
+                 LLRB_map<int, int>& m) {
+                   m.BulkLoadUnsorted(shuffled_pairs);
+                 }) << std::endl;
+}
+
+// Time merging a delta of a tenth as many keys, half of them new, into a
+// map built from @shuffled
+void RunUnion(const std::vector<int>& shuffled) {
+  unsigned int size = shuffled.size();
+  std::vector<std::pair<int, int>> base, delta;
+  for (unsigned int key = 0; key < size; key++) base.emplace_back(key, key);
+  for (unsigned int i = 0; i < size / 10; i++) {
+    int key = shuffled[i] + (i % 2 ? size : 0);
+    delta.emplace_back(key, 1);
+  }
+  unsigned int merged = size + size / 20;
+
+  std::cout << std::endl << "merging " << delta.size() << " keys into "
+            << size << ", ms" << std::endl;
+  auto add = [](int, int a, int b) { return a + b; };
+  std::cout << std::left << std::setw(34) << "TryEmplace key by key"
+            << std::right << std::setw(10) << BuildMs(merged, [&](
+                 LLRB_map<int, int>& m) {
+                   m.BulkLoad(base.begin(), base.end());
+                   for (const std::pair<int, int>& entry : delta)
+                     *m.TryEmplace(entry.first, 0).first += entry.second;
+                 }) << std::endl;
+  std::cout << std::left << std::setw(34) << "Union"
+            << std::right << std::setw(10) << BuildMs(merged, [&](
+                 LLRB_map<int, int>& m) {
+                   m.BulkLoad(base.begin(), base.end());
+                   LLRB_map<int, int> other;
+                   other.BulkLoadUnsorted(delta);
+                   m.Union(std::move(other), add);
+                 }) << std::endl;
+}
+
+// Time a restart from a snapshot of a map built from @shuffled: loading it
+// into a tree, and opening it for lookups in place
+void RunSnapshot(const std::vector<int>& shuffled) {
+  const char *path = "llrb_bench.snapshot";
+  unsigned int size = shuffled.size();
+  {
+    LLRB_map<int, int> m;
+    for (int key : shuffled) m.Insert(key, key);
+    m.Save(path);
+  }
+
+  std::cout << std::endl << "restarting with " << size << " keys, ms"
+            << std::endl;
+  std::cout << std::left << std::setw(34) << "Insert, shuffled keys"
+            << std::right << std::setw(10) << BuildMs(size, [&](
+                 LLRB_map<int, int>& m) {
+                   for (int key : shuffled) m.Insert(key, key);
+                 }) << std::endl;
+  std::cout << std::left << std::setw(34) << "Load"
+            << std::right << std::setw(10) << BuildMs(size, [&](
+                 LLRB_map<int, int>& m) { m.Load(path); }) << std::endl;
+  auto start = std::chrono::steady_clock::now();
+  {
+    LLRBSnapshot<int, int> snapshot(path, false);
+    if (!snapshot.Contains(shuffled[0])) {
+      std::cerr << "Error: snapshot lost keys" << std::endl;
+      std::exit(1);
+    }
+  }
+  auto stop = std::chrono::steady_clock::now();
+  std::cout << std::left << std::setw(34) << "LLRBSnapshot, one lookup"
+            << std::right << std::setw(10)
+            << std::chrono::duration<double, std::milli>(stop - start).count()
+            << std::endl;
+  std::remove(path);
+}
+
+// Time counting string keys, each seen about four times, through the
+// const Insert and Get alone and through the upsert methods
+void RunUpsert(const std::vector<int>& shuffled) {
+  std::vector<std::string> words;
+  for (int key : shuffled)
+    words.push_back("key-" + std::to_string(key / 4));
+  unsigned int size = words.size();
+
+  std::cout << std::endl << "counting " << size << " string keys, ms"
+            << std::endl;
+  unsigned int distinct = (size + 3) / 4;
+  std::cout << std::left << std::setw(34) << "Contains, Get, Remove, Insert"
+            << std::right << std::setw(10)
+            << BuildMs<LLRB_map<std::string, int>>(distinct, [&](
+                 LLRB_map<std::string, int>& m) {
+                   for (const std::string& word : words) {
+                     int count = 1;
+                     if (m.Contains(word)) {
+                       count += m.Get(word);
+                       m.Remove(word);
+                     }
+                     m.Insert(word, count);
+                   }
+                 }) << std::endl;
+  std::cout << std::left << std::setw(34) << "TryEmplace"
+            << std::right << std::setw(10)
+            << BuildMs<LLRB_map<std::string, int>>(distinct, [&](
+                 LLRB_map<std::string, int>& m) {
+                   for (const std::string& word : words)
+                     ++*m.TryEmplace(word, 0).first;
+                 }) << std::endl;
+}
+
+// Time filling one key of a multimap with @num_values values and draining
+// it again, oldest first
+template <typename Map>
+void RunHotKey(const std::string& name, unsigned int num_values) {
+  std::vector<int> values(num_values, 0);
+  Map m;
+  double insert = NsPerKey(values, [&](int) { Ops<Map>::Insert(m, 0); });
+  double remove = NsPerKey(values, [&](int) { Ops<Map>::Remove(m, 0); });
+  std::cout << std::left << std::setw(24) << name << std::setw(10) << "one key"
+            << std::right << std::setw(10) << insert << std::setw(20) << ""
+            << std::setw(10) << remove << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int num_keys = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  unsigned int rounds = argc > 2 ? std::atoi(argv[2]) : 3;
+  if (num_keys == 0 || rounds == 0) {
+    std::cerr << "Usage: " << argv[0] << " [num_keys] [rounds]" << std::endl;
+    return 1;
+  }
+
+  std::vector<int> sorted(num_keys);
+  for (unsigned int i = 0; i < num_keys; i++) sorted[i] = i;
+  std::vector<int> shuffled(sorted);
+  std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(1));
+
+  std::cout << num_keys << " keys, ns per operation" << std::endl;
+  std::cout << std::left << std::setw(24) << "container" << std::setw(10)
+            << "keys" << std::right << std::setw(10) << "insert"
+            << std::setw(10) << "lookup" << std::setw(10) << "scan"
+            << std::setw(10) << "remove"
+            << std::endl;
+  RunOrders<LLRB_map<int, int>>("LLRB_map", shuffled, sorted, rounds);
+  RunOrders<LLRB_map<int, int, PoolAllocator<int>>>("LLRB_map (pool)",
+    shuffled, sorted, rounds);
+  RunOrders<CompactLLRB_map<int, int>>("CompactLLRB_map", shuffled, sorted,
+    rounds);
+  RunOrders<BTree_map<int, int>>("BTree_map", shuffled, sorted, rounds);
+  RunOrders<std::map<int, int>>("std::map", shuffled, sorted, rounds);
+  RunOrders<LLRB_multimap<int, int>>("LLRB_multimap", shuffled, sorted,
+    rounds);
+  RunOrders<std::multimap<int, int>>("std::multimap", shuffled, sorted,
+    rounds);
+  RunHotKey<LLRB_multimap<int, int>>("LLRB_multimap", num_keys / 10);
+  RunHotKey<std::multimap<int, int>>("std::multimap", num_keys / 10);
+  RunBulkLoad(shuffled, sorted);
+  RunUpsert(shuffled);
+  RunUnion(shuffled);
+  RunSnapshot(shuffled);
+  return 0;
+}
@@ -0,0 +1,113 @@
+#ifndef LLRB_ITERATOR_H_
+#define LLRB_ITERATOR_H_
+
+#include <memory>
+
+// Return raw pointer held by a child link, whether the tree links its nodes
+// with raw or shared pointers
+template <typename Node>
+Node* LLRBChild(Node *link) { return link; }
+template <typename Node>
+Node* LLRBChild(const std::shared_ptr<Node> &link) { return link.get(); }
+
+// Path from the root of a tree down to a node, used by the LLRB iterators
+// to step between nodes without parent links. The path lives inline, so
+// iterators never allocate
+template <typename Node>
+class LLRBPath {
+ public:
+  // A tree of 2^32 keys is at most 64 levels deep
+  static const int kMaxDepth = 64;
+
+  LLRBPath() : depth(0) {}
+
+  // Return node at the end of the path, null if the path is empty
+  Node* Current() const {
+    return depth ? nodes[depth - 1] : nullptr;
+  }
+
+  // Extend path to the min node under @n
+  void PushMin(Node *n) {
+    for (; n; n = LLRBChild(n->left)) nodes[depth++] = n;
+  }
+  // Extend path to the max node under @n
+  void PushMax(Node *n) {
+    for (; n; n = LLRBChild(n->right)) nodes[depth++] = n;
+  }
+
+  // Move to the next node in key order, or empty the path after the max
+  void Next() {
+    Node *n = nodes[depth - 1];
+    if (n->right) {
+      PushMin(LLRBChild(n->right));
+      return;
+    }
+    // Climb until arriving from a left child
+    do {
+      n = nodes[--depth];
+    } while (depth && LLRBChild(nodes[depth - 1]->right) == n);
+  }
+  // Move to the previous node in key order, or empty the path before the min
+  void Prev() {
+    Node *n = nodes[depth - 1];
+    if (n->left) {
+      PushMax(LLRBChild(n->left));
+      return;
+    }
+    // Climb until arriving from a right child
+    do {
+      n = nodes[--depth];
+    } while (depth && LLRBChild(nodes[depth - 1]->left) == n);
+  }
+
+  // Path from @root to the first node whose key is not less than @key, or
+  // greater than @key if @strict. Empty if there is no such node
+  template <typename K>
+  void Seek(Node *root, const K &key, bool strict) {
+    int found = 0;
+    depth = 0;
+    for (Node *n = root; n;) {
+      nodes[depth++] = n;
+      if (strict ? !(key < n->key) : n->key < key) {
+        n = LLRBChild(n->right);
+      } else {
+        found = depth;
+        n = LLRBChild(n->left);
+      }
+    }
+    depth = found;
+  }
+
+ private:
+  Node *nodes[kMaxDepth];
+  int depth;
+};
+
+// Holds what operator-> of an iterator returns when it yields values
+// rather than references to stored pairs
+template <typename T>
+class LLRBArrowProxy {
+ public:
+  explicit LLRBArrowProxy(const T &value) : value(value) {}
+  const T* operator->() const { return &value; }
+
+ private:
+  T value;
+};
+
+// Pair of iterators usable in a range-based for loop
+template <typename Iterator>
+class LLRBRange {
+ public:
+  LLRBRange(const Iterator &first, const Iterator &last)
+      : first(first), last(last) {}
+  Iterator begin() const { return first; }
+  Iterator end() const { return last; }
+  bool Empty() const { return first == last; }
+
+ private:
+  Iterator first;
+  Iterator last;
+};
+
+#endif  // LLRB_ITERATOR_H_
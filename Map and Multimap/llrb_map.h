@@ -1,14 +1,40 @@
 #ifndef LLRB_MAP_H_
 #define LLRB_MAP_H_
 
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <future>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <new>
+#include <stdexcept>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
+#include "llrb_iterator.h"
+#include "llrb_snapshot.h"
+#include "llrb_stats.h"
+#include "node_pool.h"
+#include "parallel_sort.h"
 
-template <typename K, typename V>
+// Left-leaning red-black tree map. Nodes come from @Alloc, rebound to the
+// node type; use PoolAllocator to recycle nodes and free them in bulk
+template <typename K, typename V,
+          typename Alloc = std::allocator<std::pair<const K, V>>>
 class LLRB_map {
  public:
+  explicit LLRB_map(const Alloc& alloc = Alloc());
+  LLRB_map(LLRB_map&& other);
+  LLRB_map& operator=(LLRB_map&& other);
+  LLRB_map(const LLRB_map&) = delete;
+  LLRB_map& operator=(const LLRB_map&) = delete;
+  ~LLRB_map();
+
   // Return size of tree
   unsigned int Size();
   // Return whether
@@ -20,264 +46,1231 @@ class LLRB_map {
   const K& Min();
   // Insert @key in tree
   void Insert(const K &key, const V& value);
+  void Insert(K &&key, V &&value);
+  // Insert @key with a value built in place from @args. Throws
+  // std::runtime_error, like Insert, if @key is already in tree
+  template <typename KeyArg, typename... Args>
+  void Emplace(KeyArg &&key, Args&&... args);
+  // Insert @key with a value built in place from @args unless @key is
+  // already in tree. Either way return its value, and whether it was
+  // inserted, after a single descent
+  template <typename KeyArg, typename... Args>
+  std::pair<V*, bool> TryEmplace(KeyArg &&key, Args&&... args);
+  // Insert @key with @value, or assign @value if @key is already in tree.
+  // Return whether @key was inserted
+  template <typename KeyArg, typename ValueArg>
+  bool InsertOrAssign(KeyArg &&key, ValueArg &&value);
   // Remove @key from tree
   void Remove(const K &key);
+  // Remove every key from tree
+  void Clear();
+  // Replace contents of tree with the <key, value> pairs in [@first, @last),
+  // which must be sorted by strictly increasing key. Builds the tree in O(n)
+  // without comparisons or rotations. Throws std::runtime_error, leaving the
+  // tree as it was, if the input is not sorted
+  template <typename ForwardIt>
+  void BulkLoad(ForwardIt first, ForwardIt last);
+  // Replace contents of tree with @entries in any order. They are sorted on
+  // up to @num_threads threads, 0 meaning one per hardware thread; for a
+  // key given more than once the last entry wins
+  void BulkLoadUnsorted(std::vector<std::pair<K, V>> entries,
+                        unsigned int num_threads = 0);
+
+  // Move keys not less than @key into @greater, another map, replacing what
+  // it held. Takes O(log n) to cut the tree plus O(k) to count the k keys
+  // moved
+  void Split(const K &key, LLRB_map *greater);
+  // Move every key of @greater, all of which must be greater than the keys
+  // in tree, to the end of tree in O(log n). Throws std::runtime_error,
+  // leaving both maps as they were, if the keys overlap
+  void Join(LLRB_map &&greater);
+  // The set operations below cut and join whole subtrees instead of
+  // inserting key by key, and work on independent subtrees on up to
+  // @num_threads threads, 0 meaning one per hardware thread
+  //
+  // Move every key of @other into tree. For a key in both maps the value
+  // becomes @merge(key, value in tree, value in @other); @merge must not
+  // throw and may run on several threads at once
+  template <typename Merge>
+  void Union(LLRB_map &&other, Merge merge, unsigned int num_threads = 0);
+  // Remove keys of tree that are not in @other
+  void Intersection(const LLRB_map &other, unsigned int num_threads = 0);
+  // Remove keys of tree that are in @other
+  void Difference(const LLRB_map &other, unsigned int num_threads = 0);
+  // Write tree to a snapshot file at @path, see llrb_snapshot.h. Keys and
+  // values must be trivially copyable
+  void Save(const std::string &path) const;
+  // Replace contents of tree with the snapshot file at @path in O(n).
+  // Throws std::runtime_error, leaving the tree as it was, if the file is
+  // missing, damaged or written for other types or a multimap
+  void Load(const std::string &path);
+  // Return shape of tree, and the operation counters when
+  // LLRB_ENABLE_STATS is defined. Walks every node, so takes O(n)
+  LLRBStats Stats() const;
+  // Return whether tree keeps its invariants: keys in increasing order, no
+  // red right child, no red node under a red node and the same number of
+  // black nodes on every path from the root. Walks every node,
+  // so takes O(n)
+  bool Validate() const;
+  // Set the operation counters to zero
+  void ResetStats();
   // Print tree in-order
   void Print();
   // Get value given key
   const V& Get(const K& Key);
 
+  // Iterators visit <key, value> pairs in key order, handing out references
+  // into the tree. Insert, Remove and Clear invalidate them
+  class const_iterator;
+  typedef const_iterator iterator;
+  const_iterator begin() const;
+  const_iterator end() const;
+  // Return iterator to the first key not less than @key
+  const_iterator LowerBound(const K &key) const;
+  // Return iterator to the first key greater than @key
+  const_iterator UpperBound(const K &key) const;
+  // Return pairs with keys from @lo to @hi, both included
+  LLRBRange<const_iterator> Range(const K &lo, const K &hi) const;
+
  private:
   enum Color { RED, BLACK };
-  struct Node{
+  struct Node {
+    template <typename KeyArg, typename... Args>
+    explicit Node(KeyArg &&key, Args&&... args)
+        : key(std::forward<KeyArg>(key)),
+          value(std::forward<Args>(args)...),
+          color(RED),
+          left(nullptr),
+          right(nullptr) {}
     K key;
     V value;
     bool color;
-    std::unique_ptr<Node> left;
-    std::unique_ptr<Node> right;
+    Node *left;
+    Node *right;
   };
-  std::unique_ptr<Node> root;
+  typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Node>
+      NodeAlloc;
+  typedef std::allocator_traits<NodeAlloc> NodeTraits;
+
+  // Insert and Remove keep the links they pass on a fixed stack. A tree of
+  // 2^32 keys is at most 64 levels deep, the rest is slack for the red links
+  // Remove pushes down while descending
+  static const int kMaxDepth = 96;
+
+  // Where a missing key goes: the empty link it belongs at and the links
+  // above it, for fixing up once a node is linked there
+  struct InsertPosition {
+    Node **path[kMaxDepth];
+    int depth;
+    Node **link;
+  };
+
+  Node *root = nullptr;
   unsigned int cur_size = 0;
+  NodeAlloc node_alloc;
+#ifdef LLRB_ENABLE_STATS
+  LLRBCounters counters;
+#endif
+
+  // Helper methods for node lifetime
+  template <typename KeyArg, typename... Args>
+  Node* NewNode(KeyArg &&key, Args&&... args);
+  void DeleteNode(Node *n);
+  void DeleteTree(Node *n);
+
+  // Build a subtree of @n pairs taken from @it, holding at most @max_size,
+  // that is 3^h - 1 for black height h
+  template <typename ForwardIt>
+  Node* Build(ForwardIt &it, std::size_t n, std::size_t max_size);
+  // Return copy of the tree under @n, with the same shape and colors, whose
+  // nodes come from this map's allocator. Keys and values are moved out
+  Node* Rehome(Node *n);
+
+  // Nodes the set operations drop, chained through their left links so
+  // collecting them never allocates, and how many keys matched. The nodes
+  // are freed on the calling thread, since allocators need not be
+  // thread-safe
+  struct SetOpResult {
+    SetOpResult() : dropped(nullptr), tail(&dropped), matches(0) {}
+    // Chain the subtree under @n, which must be detached from any tree
+    void Drop(Node *n) {
+      if (!n) return;
+      *tail = n;
+      while (n->left) n = n->left;
+      tail = &n->left;
+    }
+    // Take over what a task running part of the same operation collected
+    void Add(const SetOpResult &other) {
+      if (other.dropped) {
+        *tail = other.dropped;
+        tail = other.tail;
+      }
+      matches += other.matches;
+    }
+    Node *dropped;
+    Node **tail;
+    unsigned int matches;
+  };
+  // Subtrees at least this many black levels high, so holding at least
+  // 2^kMinForkHeight - 1 keys, are worth handing to another thread
+  static const int kMinForkHeight = 10;
+
+  // Split and join helpers. Trees taken by them may have a red root, trees
+  // they return have a black one. Each tree comes with its black height,
+  // as BlackHeight gives it, so none has to be measured again: the
+  // children of a node are as high as the node, less one if it is black
+  int BlackHeight(Node *n);
+  // Return tree of @l, then @m, then @r, where keys of @l are less than the
+  // key of @m and keys of @r greater, and set @height to its height. Takes
+  // time in the difference of the heights
+  Node* JoinTrees(Node *l, int l_height, Node *m, Node *r, int r_height,
+                  int *height);
+  // Return tree of @l followed by @r, and set @height to its height
+  Node* Concat(Node *l, int l_height, Node *r, int r_height, int *height);
+  // Cut @n into keys less than @key, put in @less, and greater, put in
+  // @greater, with their heights. Return detached node of @key, null if
+  // there is none
+  Node* SplitTree(Node *n, int n_height, const K &key, Node **less,
+                  int *less_height, Node **greater, int *greater_height);
+  // Cut max node off @n into @max and return the rest, setting @height to
+  // its height
+  Node* SplitMax(Node *n, int n_height, Node **max, int *height);
+  // Return number of nodes under @n
+  unsigned int Count(Node *n);
+
+  // Recursive set operations. @forks is how many more levels may hand
+  // half of their work to another thread. Each takes the height of the
+  // tree it cuts and sets @height to the height of the tree it returns
+  template <typename Left, typename Right>
+  void ForkJoin(bool fork, Left left, Right right);
+  int Forks(unsigned int num_threads);
+  template <typename Merge>
+  Node* UnionTrees(Node *a, int a_height, Node *b, int b_height,
+                   Merge &merge, int forks, SetOpResult *result,
+                   int *height);
+  Node* IntersectTrees(Node *a, int a_height, Node *b, int forks,
+                       SetOpResult *result, int *height);
+  Node* SubtractTrees(Node *a, int a_height, Node *b, int forks,
+                      SetOpResult *result, int *height);
 
   // Iterative helper methods
   Node* Get(Node *n, const K &key);
+  Node* Min(Node *n);
+  // Return node of @key, or null after filling @pos with where it goes
+  Node* Find(const K &key, InsertPosition *pos);
+  // Link @n at @pos and restore the balance above it
+  void Link(InsertPosition *pos, Node *n);
 
   // Recursive helper methods
-  Node* Min(Node *n);
-  void Insert(std::unique_ptr<Node> &n, const K &key, const V &value);
-  void Remove(std::unique_ptr<Node> &n, const K &key);
   void Print(Node *n);
+  void CollectStats(const Node *n, int depth, LLRBStats *stats) const;
+  // Return black height of subtree @n, whose keys must lie strictly between
+  // @lo and @hi when they are given, or -1 if it breaks an invariant
+  int Validate(const Node *n, const K *lo, const K *hi) const;
 
   // Helper methods for the self-balancing
   bool IsRed(Node *n);
   void FlipColors(Node *n);
-  void RotateRight(std::unique_ptr<Node> &prt);
-  void RotateLeft(std::unique_ptr<Node> &prt);
-  void FixUp(std::unique_ptr<Node> &n);
-  void MoveRedRight(std::unique_ptr<Node> &n);
-  void MoveRedLeft(std::unique_ptr<Node> &n);
-  void DeleteMin(std::unique_ptr<Node> &n);
+  void RotateRight(Node *&prt);
+  void RotateLeft(Node *&prt);
+  void FixUp(Node *&n);
+  void MoveRedRight(Node *&n);
+  void MoveRedLeft(Node *&n);
+};
+
+template <typename K, typename V, typename Alloc>
+class LLRB_map<K, V, Alloc>::const_iterator {
+ public:
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef std::pair<K, V> value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef std::pair<const K&, const V&> reference;
+  typedef LLRBArrowProxy<reference> pointer;
+
+  const_iterator() : root(nullptr) {}
+
+  reference operator*() const {
+    Node *n = path.Current();
+    return reference(n->key, n->value);
+  }
+  pointer operator->() const { return pointer(**this); }
+
+  const_iterator& operator++() {
+    path.Next();
+    return *this;
+  }
+  const_iterator operator++(int) {
+    const_iterator old(*this);
+    path.Next();
+    return old;
+  }
+  const_iterator& operator--() {
+    // Stepping back from end lands on the max key
+    if (path.Current())
+      path.Prev();
+    else
+      path.PushMax(root);
+    return *this;
+  }
+  const_iterator operator--(int) {
+    const_iterator old(*this);
+    --*this;
+    return old;
+  }
+
+  bool operator==(const const_iterator &other) const {
+    return path.Current() == other.path.Current();
+  }
+  bool operator!=(const const_iterator &other) const {
+    return path.Current() != other.path.Current();
+  }
+
+ private:
+  friend class LLRB_map;
+  explicit const_iterator(Node *root) : root(root) {}
+
+  Node *root;
+  LLRBPath<Node> path;
 };
 
-template <typename K, typename V>
-unsigned int LLRB_map<K, V>::Size() {
+template <typename K, typename V, typename Alloc>
+LLRB_map<K, V, Alloc>::LLRB_map(const Alloc& alloc) : node_alloc(alloc) {}
+
+template <typename K, typename V, typename Alloc>
+LLRB_map<K, V, Alloc>::LLRB_map(LLRB_map&& other)
+    : root(other.root),
+      cur_size(other.cur_size),
+      node_alloc(other.node_alloc) {
+  other.root = nullptr;
+  other.cur_size = 0;
+}
+
+template <typename K, typename V, typename Alloc>
+LLRB_map<K, V, Alloc>& LLRB_map<K, V, Alloc>::operator=(LLRB_map&& other) {
+  if (this != &other) {
+    Clear();
+    std::swap(root, other.root);
+    std::swap(cur_size, other.cur_size);
+    std::swap(node_alloc, other.node_alloc);
+  }
+  return *this;
+}
+
+template <typename K, typename V, typename Alloc>
+LLRB_map<K, V, Alloc>::~LLRB_map() {
+  Clear();
+}
+
+template <typename K, typename V, typename Alloc>
+template <typename KeyArg, typename... Args>
+typename LLRB_map<K, V, Alloc>::Node*
+LLRB_map<K, V, Alloc>::NewNode(KeyArg &&key, Args&&... args) {
+  Node *n = NodeTraits::allocate(node_alloc, 1);
+  try {
+    ::new (static_cast<void*>(n)) Node(std::forward<KeyArg>(key),
+                                       std::forward<Args>(args)...);
+  } catch (...) {
+    NodeTraits::deallocate(node_alloc, n, 1);
+    throw;
+  }
+  return n;
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::DeleteNode(Node *n) {
+  n->~Node();
+  NodeTraits::deallocate(node_alloc, n, 1);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Clear() {
+  Node *n = root;
+  root = nullptr;
+  cur_size = 0;
+
+  // Nothing to destroy: hand every slab back at once if the pool allows
+  if (std::is_trivially_destructible<Node>::value &&
+      TryReleaseAll(node_alloc))
+    return;
+
+  DeleteTree(n);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::DeleteTree(Node *n) {
+  // Free node by node without recursion. Rotating left children up turns
+  // the tree into a right-leaning list that is freed front to back
+  while (n) {
+    if (n->left) {
+      Node *l = n->left;
+      n->left = l->right;
+      l->right = n;
+      n = l;
+    } else {
+      Node *next = n->right;
+      DeleteNode(n);
+      n = next;
+    }
+  }
+}
+
+template <typename K, typename V, typename Alloc>
+template <typename ForwardIt>
+void LLRB_map<K, V, Alloc>::BulkLoad(ForwardIt first, ForwardIt last) {
+  // Count and check the input before touching the tree
+  std::size_t n = 0;
+  for (ForwardIt it = first, prev = first; it != last; prev = it, ++it, n++) {
+    if (n != 0 && !(prev->first < it->first))
+      throw std::runtime_error("Error: BulkLoad input is not sorted");
+  }
+  if (n > UINT_MAX)
+    throw std::runtime_error("Error: BulkLoad input is too large");
+
+  // The tree gets the largest black height h with 2^h - 1 <= n, so the n
+  // keys fit between a full tree of 2-nodes and one of 3-nodes
+  std::size_t max_size = 1;
+  for (std::size_t full = 0; 2 * full + 1 <= n; full = 2 * full + 1)
+    max_size *= 3;
+  max_size -= 1;
+
+  Clear();
+  root = Build(first, n, max_size);
+  cur_size = n;
+}
+
+template <typename K, typename V, typename Alloc>
+template <typename ForwardIt>
+typename LLRB_map<K, V, Alloc>::Node*
+LLRB_map<K, V, Alloc>::Build(ForwardIt &it, std::size_t n,
+                             std::size_t max_size) {
+  if (n == 0) return nullptr;
+
+  // Subtrees one black level down hold at most this many keys
+  std::size_t max_child = (max_size + 1) / 3 - 1;
+  Node *left = nullptr, *mid = nullptr, *red = nullptr, *top = nullptr;
+  try {
+    if (n - 1 <= 2 * max_child) {
+      // 2-node: one black node over two even halves
+      std::size_t n_left = (n - 1) / 2;
+      left = Build(it, n_left, max_child);
+      top = NewNode(it->first, it->second);
+      ++it;
+      top->left = left;
+      left = nullptr;
+      top->right = Build(it, n - 1 - n_left, max_child);
+    } else {
+      // 3-node: a black node with a red left child over three even thirds
+      std::size_t n_left = (n - 2) / 3;
+      std::size_t n_mid = (n - 2 - n_left) / 2;
+      left = Build(it, n_left, max_child);
+      red = NewNode(it->first, it->second);
+      ++it;
+      red->left = left;
+      left = nullptr;
+      mid = Build(it, n_mid, max_child);
+      red->right = mid;
+      mid = nullptr;
+      top = NewNode(it->first, it->second);
+      ++it;
+      top->left = red;
+      red = nullptr;
+      top->right = Build(it, n - 2 - n_left - n_mid, max_child);
+    }
+  } catch (...) {
+    DeleteTree(left);
+    DeleteTree(mid);
+    DeleteTree(red);
+    DeleteTree(top);
+    throw;
+  }
+  top->color = BLACK;
+  return top;
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::BulkLoadUnsorted(
+    std::vector<std::pair<K, V>> entries, unsigned int num_threads) {
+  typedef std::pair<K, V> Entry;
+  ParallelStableSort(entries.begin(), entries.end(),
+    [](const Entry &a, const Entry &b) { return a.first < b.first; },
+    num_threads);
+
+  // Keep the last of every run of equal keys; the sort is stable, so that
+  // is the one given last
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < entries.size(); i++) {
+    if (i + 1 < entries.size() && !(entries[i].first < entries[i + 1].first))
+      continue;
+    if (kept != i)
+      entries[kept] = std::move(entries[i]);
+    kept++;
+  }
+  entries.erase(entries.begin() + kept, entries.end());
+
+  BulkLoad(entries.begin(), entries.end());
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::Node*
+LLRB_map<K, V, Alloc>::Rehome(Node *n) {
+  if (!n) return nullptr;
+  Node *left = Rehome(n->left);
+  Node *copy = nullptr;
+  try {
+    copy = NewNode(std::move(n->key), std::move(n->value));
+    copy->left = left;
+    left = nullptr;
+    copy->right = Rehome(n->right);
+  } catch (...) {
+    DeleteTree(left);
+    DeleteTree(copy);
+    throw;
+  }
+  copy->color = n->color;
+  return copy;
+}
+
+template <typename K, typename V, typename Alloc>
+int LLRB_map<K, V, Alloc>::BlackHeight(Node *n) {
+  // Right links are never red, so every node on the right spine below the
+  // root counts
+  int height = 0;
+  for (; n; n = n->right)
+    if (!IsRed(n)) height++;
+  return height;
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::Node*
+LLRB_map<K, V, Alloc>::JoinTrees(Node *l, int l_height, Node *m, Node *r,
+                                 int r_height, int *height) {
+  // A red root made black adds a black level
+  if (IsRed(l)) {
+    l->color = BLACK;
+    l_height++;
+  }
+  if (IsRed(r)) {
+    r->color = BLACK;
+    r_height++;
+  }
+  if (l_height == r_height) {
+    m->left = l;
+    m->right = r;
+    m->color = BLACK;
+    *height = l_height + 1;
+    return m;
+  }
+
+  // Walk down the side of the taller tree to a black node as high as the
+  // shorter tree, and put @m there as a red node over both. That is an
+  // insert one level above the leaves of the shorter tree, so the same
+  // fixups as for Insert restore the balance on the way back up
+  Node **path[kMaxDepth];
+  int depth = 0;
+  Node *top;
+  Node **link;
+  if (l_height > r_height) {
+    top = l;
+    link = &top;
+    for (int height = l_height; height > r_height; height--) {
+      path[depth++] = link;
+      link = &(*link)->right;
+    }
+    m->left = *link;
+    m->right = r;
+  } else {
+    top = r;
+    link = &top;
+    // Left links may be red, and red nodes do not count
+    for (int height = r_height; height > l_height || IsRed(*link);) {
+      path[depth++] = link;
+      if (!IsRed(*link)) height--;
+      link = &(*link)->left;
+    }
+    m->left = l;
+    m->right = *link;
+  }
+  m->color = RED;
+  *link = m;
+  while (depth > 0)
+    FixUp(*path[--depth]);
+  // The fixups may leave a red root, one black level short of the rest
+  *height = std::max(l_height, r_height) + (IsRed(top) ? 1 : 0);
+  top->color = BLACK;
+  return top;
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::Node*
+LLRB_map<K, V, Alloc>::Concat(Node *l, int l_height, Node *r,
+                              int r_height, int *height) {
+  if (!r) {
+    *height = l_height;
+    return l;
+  }
+  if (!l) {
+    *height = r_height;
+    return r;
+  }
+  Node *max;
+  l = SplitMax(l, l_height, &max, &l_height);
+  return JoinTrees(l, l_height, max, r, r_height, height);
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::Node*
+LLRB_map<K, V, Alloc>::SplitTree(Node *n, int n_height, const K &key,
+                                 Node **less, int *less_height,
+                                 Node **greater, int *greater_height) {
+  if (!n) {
+    *less = *greater = nullptr;
+    *less_height = *greater_height = 0;
+    return nullptr;
+  }
+  Node *l = n->left, *r = n->right;
+  int child_height = n_height - (IsRed(n) ? 0 : 1);
+  if (key == n->key) {
+    n->left = n->right = nullptr;
+    *less = l;
+    *greater = r;
+    *less_height = *greater_height = child_height;
+    return n;
+  }
+  Node *found, *cut;
+  int cut_height;
+  if (key < n->key) {
+    found = SplitTree(l, child_height, key, less, less_height, &cut,
+                      &cut_height);
+    *greater = JoinTrees(cut, cut_height, n, r, child_height,
+                         greater_height);
+  } else {
+    found = SplitTree(r, child_height, key, &cut, &cut_height, greater,
+                      greater_height);
+    *less = JoinTrees(l, child_height, n, cut, cut_height, less_height);
+  }
+  return found;
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::Node*
+LLRB_map<K, V, Alloc>::SplitMax(Node *n, int n_height, Node **max,
+                                int *height) {
+  Node *l = n->left;
+  int child_height = n_height - (IsRed(n) ? 0 : 1);
+  if (!n->right) {
+    n->left = nullptr;
+    *max = n;
+    *height = child_height;
+    return l;
+  }
+  int rest_height;
+  Node *rest = SplitMax(n->right, child_height, max, &rest_height);
+  return JoinTrees(l, child_height, n, rest, rest_height, height);
+}
+
+template <typename K, typename V, typename Alloc>
+unsigned int LLRB_map<K, V, Alloc>::Count(Node *n) {
+  if (!n) return 0;
+  return Count(n->left) + 1 + Count(n->right);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Split(const K &key, LLRB_map *greater) {
+  greater->Clear();
+  greater->node_alloc = node_alloc;
+  Node *less, *rest;
+  int less_height, rest_height;
+  if (Node *n = SplitTree(root, BlackHeight(root), key, &less, &less_height,
+                          &rest, &rest_height))
+    rest = JoinTrees(nullptr, 0, n, rest, rest_height, &rest_height);
+  root = less;
+  if (root) root->color = BLACK;
+  greater->root = rest;
+  greater->cur_size = Count(rest);
+  cur_size -= greater->cur_size;
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Join(LLRB_map &&greater) {
+  if (!greater.root) return;
+  if (root && !(Max() < greater.Min()))
+    throw std::runtime_error("Error: Join needs greater keys");
+  Node *r = greater.root;
+  if (node_alloc != greater.node_alloc) {
+    r = Rehome(r);
+    greater.Clear();
+  }
+  int height;
+  root = Concat(root, BlackHeight(root), r, BlackHeight(r), &height);
+  cur_size += greater.cur_size;
+  greater.root = nullptr;
+  greater.cur_size = 0;
+}
+
+template <typename K, typename V, typename Alloc>
+template <typename Left, typename Right>
+void LLRB_map<K, V, Alloc>::ForkJoin(bool fork, Left left, Right right) {
+  std::future<void> task;
+  if (fork) {
+    try {
+      task = std::async(std::launch::async, left);
+    } catch (const std::system_error&) {
+      // No thread to be had, do the work here
+      fork = false;
+    }
+  }
+  if (!fork) left();
+  right();
+  if (fork) task.get();
+}
+
+template <typename K, typename V, typename Alloc>
+int LLRB_map<K, V, Alloc>::Forks(unsigned int num_threads) {
+  if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+  // Halves are rarely even, so fork one level more than the threads need
+  int forks = 0;
+  for (unsigned int tasks = 1; tasks < num_threads; tasks *= 2) forks++;
+  return forks ? forks + 1 : 0;
+}
+
+template <typename K, typename V, typename Alloc>
+template <typename Merge>
+void LLRB_map<K, V, Alloc>::Union(LLRB_map &&other, Merge merge,
+                                  unsigned int num_threads) {
+  if (this == &other || !other.root) return;
+  Node *b = other.root;
+  unsigned int other_size = other.cur_size;
+  if (node_alloc != other.node_alloc) {
+    b = Rehome(b);
+    other.Clear();
+  }
+  other.root = nullptr;
+  other.cur_size = 0;
+
+  SetOpResult result;
+  int height;
+  root = UnionTrees(root, BlackHeight(root), b, BlackHeight(b), merge,
+                    Forks(num_threads), &result, &height);
+  if (root) root->color = BLACK;
+  cur_size += other_size - result.matches;
+  DeleteTree(result.dropped);
+}
+
+template <typename K, typename V, typename Alloc>
+template <typename Merge>
+typename LLRB_map<K, V, Alloc>::Node*
+LLRB_map<K, V, Alloc>::UnionTrees(Node *a, int a_height, Node *b,
+                                  int b_height, Merge &merge, int forks,
+                                  SetOpResult *result, int *height) {
+  if (!a || !b) {
+    *height = a ? a_height : b_height;
+    return a ? a : b;
+  }
+  // Cut @b around the root of @a and unite the sides independently
+  Node *b_less, *b_greater;
+  int b_less_height, b_greater_height;
+  Node *match = SplitTree(b, b_height, a->key, &b_less, &b_less_height,
+                          &b_greater, &b_greater_height);
+  Node *a_less = a->left, *a_greater = a->right;
+  int child_height = a_height - (IsRed(a) ? 0 : 1);
+  Node *l, *r;
+  int l_height, r_height;
+  SetOpResult left_result;
+  ForkJoin(forks > 0 && a_height >= kMinForkHeight,
+    [&]() {
+      l = UnionTrees(a_less, child_height, b_less, b_less_height, merge,
+                     forks - 1, &left_result, &l_height);
+    },
+    [&]() {
+      r = UnionTrees(a_greater, child_height, b_greater, b_greater_height,
+                     merge, forks - 1, result, &r_height);
+    });
+  result->Add(left_result);
+  if (match) {
+    a->value = merge(a->key, a->value, match->value);
+    result->Drop(match);
+    result->matches++;
+  }
+  return JoinTrees(l, l_height, a, r, r_height, height);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Intersection(const LLRB_map &other,
+                                         unsigned int num_threads) {
+  if (this == &other) return;
+  SetOpResult result;
+  int height;
+  root = IntersectTrees(root, BlackHeight(root), other.root,
+                        Forks(num_threads), &result, &height);
+  if (root) root->color = BLACK;
+  cur_size = result.matches;
+  DeleteTree(result.dropped);
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::Node*
+LLRB_map<K, V, Alloc>::IntersectTrees(Node *a, int a_height, Node *b,
+                                      int forks, SetOpResult *result,
+                                      int *height) {
+  *height = 0;
+  if (!a) return nullptr;
+  if (!b) {
+    result->Drop(a);
+    return nullptr;
+  }
+  // Cut @a around the root of @b, which is only read
+  Node *a_less, *a_greater;
+  int a_less_height, a_greater_height;
+  Node *match = SplitTree(a, a_height, b->key, &a_less, &a_less_height,
+                          &a_greater, &a_greater_height);
+  Node *l, *r;
+  int l_height, r_height;
+  SetOpResult left_result;
+  ForkJoin(forks > 0 && a_less_height >= kMinForkHeight,
+    [&]() {
+      l = IntersectTrees(a_less, a_less_height, b->left, forks - 1,
+                         &left_result, &l_height);
+    },
+    [&]() {
+      r = IntersectTrees(a_greater, a_greater_height, b->right, forks - 1,
+                         result, &r_height);
+    });
+  result->Add(left_result);
+  if (!match) return Concat(l, l_height, r, r_height, height);
+  result->matches++;
+  return JoinTrees(l, l_height, match, r, r_height, height);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Difference(const LLRB_map &other,
+                                       unsigned int num_threads) {
+  if (this == &other) {
+    Clear();
+    return;
+  }
+  SetOpResult result;
+  int height;
+  root = SubtractTrees(root, BlackHeight(root), other.root,
+                       Forks(num_threads), &result, &height);
+  if (root) root->color = BLACK;
+  cur_size -= result.matches;
+  DeleteTree(result.dropped);
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::Node*
+LLRB_map<K, V, Alloc>::SubtractTrees(Node *a, int a_height, Node *b,
+                                     int forks, SetOpResult *result,
+                                     int *height) {
+  *height = a_height;
+  if (!a || !b) return a;
+  Node *a_less, *a_greater;
+  int a_less_height, a_greater_height;
+  Node *match = SplitTree(a, a_height, b->key, &a_less, &a_less_height,
+                          &a_greater, &a_greater_height);
+  Node *l, *r;
+  int l_height, r_height;
+  SetOpResult left_result;
+  ForkJoin(forks > 0 && a_less_height >= kMinForkHeight,
+    [&]() {
+      l = SubtractTrees(a_less, a_less_height, b->left, forks - 1,
+                        &left_result, &l_height);
+    },
+    [&]() {
+      r = SubtractTrees(a_greater, a_greater_height, b->right, forks - 1,
+                        result, &r_height);
+    });
+  result->Add(left_result);
+  if (match) {
+    result->Drop(match);
+    result->matches++;
+  }
+  return Concat(l, l_height, r, r_height, height);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Save(const std::string &path) const {
+  SaveLLRBSnapshot<K, V>(path, begin(), end(), cur_size, false);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Load(const std::string &path) {
+  LLRBSnapshot<K, V> snapshot(path);
+  if (snapshot.IsMulti())
+    throw std::runtime_error("Error: snapshot " + path + " is of a multimap");
+  BulkLoad(snapshot.begin(), snapshot.end());
+}
+
+template <typename K, typename V, typename Alloc>
+unsigned int LLRB_map<K, V, Alloc>::Size() {
   return cur_size;
 }
 
-template <typename K, typename V>
-typename LLRB_map<K, V>::Node* LLRB_map<K, V>::Get(LLRB_map<K, V>::Node* n,
-                                             const K &key) {
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::Node* LLRB_map<K, V, Alloc>::Get(Node* n,
+                                                              const K &key) {
+  LLRB_STAT(counters.Add(LLRBCounters::kOperations));
   while (n) {
+    LLRB_STAT(counters.Add(LLRBCounters::kComparisons));
     if (key == n->key)
       return n;
 
     if (key < n->key)
-      n = n->left.get();
+      n = n->left;
     else
-      n = n->right.get();
+      n = n->right;
   }
   return nullptr;
 }
 
-template <typename K, typename V>
-const V& LLRB_map<K, V>::Get(const K& Key) {
-  Node* n = Get(root.get(), Key);
+template <typename K, typename V, typename Alloc>
+const V& LLRB_map<K, V, Alloc>::Get(const K& Key) {
+  Node* n = Get(root, Key);
   if (!n) {
     throw std::runtime_error("Error: Key not in map");
   }
   return n->value;
 }
 
-template <typename K, typename V>
-bool LLRB_map<K, V>::Contains(const K &key) {
-  return Get(root.get(), key) != nullptr;
+template <typename K, typename V, typename Alloc>
+bool LLRB_map<K, V, Alloc>::Contains(const K &key) {
+  return Get(root, key) != nullptr;
 }
 
-template <typename K, typename V>
-const K& LLRB_map<K, V>::Max(void) {
-  Node *n = root.get();
-  while (n->right) n = n->right.get();
+template <typename K, typename V, typename Alloc>
+const K& LLRB_map<K, V, Alloc>::Max(void) {
+  Node *n = root;
+  while (n->right) n = n->right;
   return n->key;
 }
 
-template <typename K, typename V>
-const K& LLRB_map<K, V>::Min(void) {
-  return Min(root.get())->key;
+template <typename K, typename V, typename Alloc>
+const K& LLRB_map<K, V, Alloc>::Min(void) {
+  return Min(root)->key;
 }
 
-template <typename K, typename V>
-typename LLRB_map<K, V>::Node* LLRB_map<K, V>::Min(Node *n) {
-  if (n->left)
-    return Min(n->left.get());
-  else
-    return n;
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::Node* LLRB_map<K, V, Alloc>::Min(Node *n) {
+  while (n->left) n = n->left;
+  return n;
 }
 
-template <typename K, typename V>
-bool LLRB_map<K, V>::IsRed(Node *n) {
+template <typename K, typename V, typename Alloc>
+bool LLRB_map<K, V, Alloc>::IsRed(Node *n) {
   if (!n) return false;
   return (n->color == RED);
 }
 
-template <typename K, typename V>
-void LLRB_map<K, V>::FlipColors(Node *n) {
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::FlipColors(Node *n) {
+  LLRB_STAT(counters.Add(LLRBCounters::kFlipColors));
   n->color = !n->color;
   n->left->color = !n->left->color;
   n->right->color = !n->right->color;
 }
 
-template <typename K, typename V>
-void LLRB_map<K, V>::RotateRight(std::unique_ptr<Node> &prt) {
-  std::unique_ptr<Node> chd = std::move(prt->left);
-  prt->left = std::move(chd->right);
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::RotateRight(Node *&prt) {
+  LLRB_STAT(counters.Add(LLRBCounters::kRotateRight));
+  Node *chd = prt->left;
+  prt->left = chd->right;
   chd->color = prt->color;
   prt->color = RED;
-  chd->right = std::move(prt);
-  prt = std::move(chd);
+  chd->right = prt;
+  prt = chd;
 }
 
-template <typename K, typename V>
-void LLRB_map<K, V>::RotateLeft(std::unique_ptr<Node> &prt) {
-  std::unique_ptr<Node> chd = std::move(prt->right);
-  prt->right = std::move(chd->left);
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::RotateLeft(Node *&prt) {
+  LLRB_STAT(counters.Add(LLRBCounters::kRotateLeft));
+  Node *chd = prt->right;
+  prt->right = chd->left;
   chd->color = prt->color;
   prt->color = RED;
-  chd->left = std::move(prt);
-  prt = std::move(chd);
+  chd->left = prt;
+  prt = chd;
 }
 
-template <typename K, typename V>
-void LLRB_map<K, V>::FixUp(std::unique_ptr<Node> &n) {
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::FixUp(Node *&n) {
   // Rotate left if there is a right-leaning red node
-  if (IsRed(n->right.get()) && !IsRed(n->left.get()))
+  if (IsRed(n->right) && !IsRed(n->left))
     RotateLeft(n);
   // Rotate right if red-red pair of nodes on left
-  if (IsRed(n->left.get()) && IsRed(n->left->left.get()))
+  if (IsRed(n->left) && IsRed(n->left->left))
     RotateRight(n);
   // Recoloring if both children are red
-  if (IsRed(n->left.get()) && IsRed(n->right.get()))
-    FlipColors(n.get());
+  if (IsRed(n->left) && IsRed(n->right))
+    FlipColors(n);
 }
 
-template <typename K, typename V>
-void LLRB_map<K, V>::MoveRedRight(std::unique_ptr<Node> &n) {
-  FlipColors(n.get());
-  if (IsRed(n->left->left.get())) {
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::MoveRedRight(Node *&n) {
+  LLRB_STAT(counters.Add(LLRBCounters::kMoveRedRight));
+  FlipColors(n);
+  if (IsRed(n->left->left)) {
     RotateRight(n);
-    FlipColors(n.get());
+    FlipColors(n);
   }
 }
 
-template <typename K, typename V>
-void LLRB_map<K, V>::MoveRedLeft(std::unique_ptr<Node> &n) {
-  FlipColors(n.get());
-  if (IsRed(n->right->left.get())) {
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::MoveRedLeft(Node *&n) {
+  LLRB_STAT(counters.Add(LLRBCounters::kMoveRedLeft));
+  FlipColors(n);
+  if (IsRed(n->right->left)) {
     RotateRight(n->right);
     RotateLeft(n);
-    FlipColors(n.get());
+    FlipColors(n);
   }
 }
 
-template <typename K, typename V>
-void LLRB_map<K, V>::DeleteMin(std::unique_ptr<Node> &n) {
-  // No left child, min is 'n'
-  if (!n->left) {
-    // Remove n
-    n = nullptr;
-    return;
-  }
-
-  if (!IsRed(n->left.get()) && !IsRed(n->left->left.get()))
-    MoveRedLeft(n);
-
-  DeleteMin(n->left);
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Remove(const K &key) {
+  // Links from the root down to the current node, fixed up on the way back
+  Node **path[kMaxDepth];
+  int depth = 0;
+  Node **link = &root;
+  bool removed = false;
 
-  FixUp(n);
-}
-
-template <typename K, typename V>
-void LLRB_map<K, V>::Remove(const K &key) {
-  if (!Contains(key))
-    return;
-  Remove(root, key);
-  cur_size--;
-  if (root)
-    root->color = BLACK;
-}
-
-template <typename K, typename V>
-void LLRB_map<K, V>::Remove(std::unique_ptr<Node> &n, const K &key) {
-  // Key not found
-  if (!n) return;
+  LLRB_STAT(counters.Add(LLRBCounters::kOperations));
+  while (*link) {
+    LLRB_STAT(counters.Add(LLRBCounters::kComparisons));
+    path[depth++] = link;
+    if (key < (*link)->key) {
+      // Key not found
+      if (!(*link)->left) break;
+      if (!IsRed((*link)->left) && !IsRed((*link)->left->left))
+        MoveRedLeft(*link);
+      link = &(*link)->left;
+      continue;
+    }
 
-  if (key < n->key) {
-    if (!IsRed(n->left.get()) && !IsRed(n->left->left.get()))
-      MoveRedLeft(n);
-    Remove(n->left, key);
-  } else {
-    if (IsRed(n->left.get()))
-      RotateRight(n);
+    if (IsRed((*link)->left))
+      RotateRight(*link);
 
+    Node *n = *link;
     if (key == n->key && !n->right) {
-      // Remove n
-      n = nullptr;
-      return;
+      // Remove n, nothing is left below it to fix
+      depth--;
+      *link = nullptr;
+      DeleteNode(n);
+      removed = true;
+      break;
     }
 
-    if (!IsRed(n->right.get()) && !IsRed(n->right->left.get()))
-      MoveRedRight(n);
+    // Key not found
+    if (!n->right) break;
 
+    if (!IsRed(n->right) && !IsRed(n->right->left))
+      MoveRedRight(*link);
+
+    n = *link;
     if (key == n->key) {
-      // Find min node in the right subtree
-      Node *n_min = Min(n->right.get());
-      // Copy content from min node
-      n->key = n_min->key;
-      n->value = n_min->value;
-      // Delete min node recursively
-      DeleteMin(n->right);
-    } else {
-      Remove(n->right, key);
+      // Walk down to the min node of the right subtree, moving a red link
+      // down the left side as the descent goes
+      Node **n_link = link;
+      int right_depth = depth;
+      link = &n->right;
+      while ((*link)->left) {
+        path[depth++] = link;
+        if (!IsRed((*link)->left) && !IsRed((*link)->left->left))
+          MoveRedLeft(*link);
+        link = &(*link)->left;
+      }
+      // Unlink the min node and put it in the place of n, so no key or
+      // value is copied. The link below n on the path now lives in it
+      Node *n_min = *link;
+      *link = nullptr;
+      n_min->left = n->left;
+      n_min->right = n->right;
+      n_min->color = n->color;
+      *n_link = n_min;
+      if (depth > right_depth)
+        path[right_depth] = &n_min->right;
+      DeleteNode(n);
+      removed = true;
+      break;
     }
+    link = &n->right;
   }
 
-  FixUp(n);
+  while (depth > 0)
+    FixUp(*path[--depth]);
+  if (removed)
+    cur_size--;
+  if (root)
+    root->color = BLACK;
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::Node*
+LLRB_map<K, V, Alloc>::Find(const K &key, InsertPosition *pos) {
+  pos->depth = 0;
+  pos->link = &root;
+  LLRB_STAT(counters.Add(LLRBCounters::kOperations));
+  while (Node *n = *pos->link) {
+    LLRB_STAT(counters.Add(LLRBCounters::kComparisons));
+    if (key == n->key)
+      return n;
+    pos->path[pos->depth++] = pos->link;
+    pos->link = key < n->key ? &n->left : &n->right;
+  }
+  return nullptr;
 }
 
-template <typename K, typename V>
-void LLRB_map<K, V>::Insert(const K &key, const V& value) {
-  Insert(root, key, value);
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Link(InsertPosition *pos, Node *n) {
+  *pos->link = n;
+  // Walk back up restoring the balance. Rotations move links, not nodes,
+  // so @n stays valid
+  while (pos->depth > 0)
+    FixUp(*pos->path[--pos->depth]);
   cur_size++;
   root->color = BLACK;
 }
 
-template <typename K, typename V>
-void LLRB_map<K, V>::Insert(std::unique_ptr<Node> &n,
-                                       const K &key,
-                                       const V &value) {
-  if (!n)
-    n = std::unique_ptr<Node>(new Node{key, value, RED});
-  else if (key < n->key)
-    Insert(n->left, key, value);
-  else if (key > n->key)
-    Insert(n->right, key, value);
-  else
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Insert(const K &key, const V& value) {
+  Emplace(key, value);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Insert(K &&key, V &&value) {
+  Emplace(std::move(key), std::move(value));
+}
+
+template <typename K, typename V, typename Alloc>
+template <typename KeyArg, typename... Args>
+void LLRB_map<K, V, Alloc>::Emplace(KeyArg &&key, Args&&... args) {
+  InsertPosition pos;
+  if (Find(key, &pos))
     throw std::runtime_error("Key already inserted");
+  Link(&pos, NewNode(std::forward<KeyArg>(key), std::forward<Args>(args)...));
+}
 
-  FixUp(n);
+template <typename K, typename V, typename Alloc>
+template <typename KeyArg, typename... Args>
+std::pair<V*, bool> LLRB_map<K, V, Alloc>::TryEmplace(KeyArg &&key,
+                                                      Args&&... args) {
+  InsertPosition pos;
+  if (Node *n = Find(key, &pos))
+    return std::pair<V*, bool>(&n->value, false);
+  Node *n = NewNode(std::forward<KeyArg>(key), std::forward<Args>(args)...);
+  Link(&pos, n);
+  return std::pair<V*, bool>(&n->value, true);
+}
+
+template <typename K, typename V, typename Alloc>
+template <typename KeyArg, typename ValueArg>
+bool LLRB_map<K, V, Alloc>::InsertOrAssign(KeyArg &&key, ValueArg &&value) {
+  InsertPosition pos;
+  if (Node *n = Find(key, &pos)) {
+    n->value = std::forward<ValueArg>(value);
+    return false;
+  }
+  Link(&pos, NewNode(std::forward<KeyArg>(key),
+                     std::forward<ValueArg>(value)));
+  return true;
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::const_iterator
+LLRB_map<K, V, Alloc>::begin() const {
+  const_iterator it(root);
+  it.path.PushMin(root);
+  return it;
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::const_iterator
+LLRB_map<K, V, Alloc>::end() const {
+  return const_iterator(root);
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::const_iterator
+LLRB_map<K, V, Alloc>::LowerBound(const K &key) const {
+  const_iterator it(root);
+  it.path.Seek(root, key, false);
+  return it;
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_map<K, V, Alloc>::const_iterator
+LLRB_map<K, V, Alloc>::UpperBound(const K &key) const {
+  const_iterator it(root);
+  it.path.Seek(root, key, true);
+  return it;
+}
+
+template <typename K, typename V, typename Alloc>
+LLRBRange<typename LLRB_map<K, V, Alloc>::const_iterator>
+LLRB_map<K, V, Alloc>::Range(const K &lo, const K &hi) const {
+  if (hi < lo)
+    return LLRBRange<const_iterator>(end(), end());
+  return LLRBRange<const_iterator>(LowerBound(lo), UpperBound(hi));
+}
+
+template <typename K, typename V, typename Alloc>
+LLRBStats LLRB_map<K, V, Alloc>::Stats() const {
+  LLRBStats stats;
+  CollectStats(root, 0, &stats);
+  // Every path has as many black nodes, so the left spine will do
+  for (const Node *n = root; n; n = n->left)
+    if (n->color == BLACK) stats.black_height++;
+#ifdef LLRB_ENABLE_STATS
+  stats.counted = true;
+  stats.ops = counters.Read();
+#endif
+  return stats;
+}
+
+template <typename K, typename V, typename Alloc>
+bool LLRB_map<K, V, Alloc>::Validate() const {
+  return Validate(root, nullptr, nullptr) >= 0;
+}
+
+template <typename K, typename V, typename Alloc>
+int LLRB_map<K, V, Alloc>::Validate(const Node *n, const K *lo,
+                                    const K *hi) const {
+  if (!n) return 0;
+  if ((lo && !(*lo < n->key)) || (hi && !(n->key < *hi))) return -1;
+  if (n->right && n->right->color == RED) return -1;
+  if (n->color == RED && n->left && n->left->color == RED) return -1;
+  int left = Validate(n->left, lo, &n->key);
+  int right = Validate(n->right, &n->key, hi);
+  if (left < 0 || left != right) return -1;
+  return left + (n->color == BLACK ? 1 : 0);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::ResetStats() {
+  LLRB_STAT(counters.Reset());
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::CollectStats(const Node *n, int depth,
+                                         LLRBStats *stats) const {
+  if (!n) return;
+  stats->AddNode(depth);
+  stats->bytes_used += sizeof(Node);
+  CollectStats(n->left, depth + 1, stats);
+  CollectStats(n->right, depth + 1, stats);
 }
 
-template <typename K, typename V>
-void LLRB_map<K, V>::Print() {
-  Print(root.get());
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Print() {
+  Print(root);
   std::cout << std::endl;
 }
 
-template <typename K, typename V>
-void LLRB_map<K, V>::Print(Node *n) {
+template <typename K, typename V, typename Alloc>
+void LLRB_map<K, V, Alloc>::Print(Node *n) {
   if (!n) return;
-  Print(n->left.get());
+  Print(n->left);
   std::cout << "<" << n->key << "," << n->value << "> ";
-  Print(n->right.get());
+  Print(n->right);
 }
 
 #endif  // LLRB_MAP_H_
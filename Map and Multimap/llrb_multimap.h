@@ -1,15 +1,36 @@
 #ifndef LLRB_MULTIMAP_H_
 #define LLRB_MULTIMAP_H_
 
+#include <climits>
+#include <cstddef>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <new>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <utility>
 #include <vector>
-
-template <typename K, typename V>
+#include "llrb_iterator.h"
+#include "llrb_snapshot.h"
+#include "llrb_stats.h"
+#include "node_pool.h"
+#include "value_list.h"
+
+// Left-leaning red-black tree multimap. Nodes come from @Alloc, rebound to the
+// node type; use PoolAllocator to recycle nodes and free them in bulk
+template <typename K, typename V,
+          typename Alloc = std::allocator<std::pair<const K, V>>>
 class LLRB_multimap {
  public:
+  explicit LLRB_multimap(const Alloc& alloc = Alloc());
+  LLRB_multimap(LLRB_multimap&& other);
+  LLRB_multimap& operator=(LLRB_multimap&& other);
+  LLRB_multimap(const LLRB_multimap&) = delete;
+  LLRB_multimap& operator=(const LLRB_multimap&) = delete;
+  ~LLRB_multimap();
+
   // Return size of tree
   unsigned int Size();
   // Return whether @key is found in tree
@@ -20,309 +41,742 @@ class LLRB_multimap {
   const K& Min();
   // Insert key with value in tree
   void Insert(const K &key, const V &value);
+  void Insert(K &&key, V &&value);
+  // Insert key with a value built in place from @args
+  template <typename KeyArg, typename... Args>
+  void Emplace(KeyArg &&key, Args&&... args);
   // Remove @key from tree
   void Remove(const K &key);
+  // Remove every key from tree
+  void Clear();
+  // Replace contents of tree with the <key, value> pairs in [@first, @last),
+  // which must be sorted by key; values of one key keep their order. Builds
+  // the tree in O(n) without rotations. Throws std::runtime_error, leaving
+  // the tree as it was, if the input is not sorted
+  template <typename ForwardIt>
+  void BulkLoad(ForwardIt first, ForwardIt last);
+  // Write tree to a snapshot file at @path, see llrb_snapshot.h. Keys and
+  // values must be trivially copyable
+  void Save(const std::string &path) const;
+  // Replace contents of tree with the snapshot file at @path in O(n).
+  // Throws std::runtime_error, leaving the tree as it was, if the file is
+  // missing, damaged or written for other types
+  void Load(const std::string &path);
+  // Return shape of tree, and the operation counters when
+  // LLRB_ENABLE_STATS is defined. Walks every node, so takes O(n)
+  LLRBStats Stats() const;
+  // Return whether tree keeps its invariants: keys in increasing order, no
+  // red right child, no red node under a red node, the same number of black
+  // nodes on every path from the root and values for every key. Walks every
+  // node, so takes O(n)
+  bool Validate() const;
+  // Set the operation counters to zero
+  void ResetStats();
   // Print tree in-order
   void Print();
   // Return first value of node with matching key
   const V& Get(const K& key);
-  // Return all values in tree
+  // Return all values in tree, in key order
   std::vector<V> GetAll();
 
+  // Iterators visit every <key, value> pair in key order, values of one key
+  // in insertion order, handing out references into the tree. Insert, Remove
+  // and Clear invalidate them
+  class const_iterator;
+  typedef const_iterator iterator;
+  const_iterator begin() const;
+  const_iterator end() const;
+  // Return iterator to the first pair with key not less than @key
+  const_iterator LowerBound(const K &key) const;
+  // Return iterator to the first pair with key greater than @key
+  const_iterator UpperBound(const K &key) const;
+  // Return pairs with keys from @lo to @hi, both included
+  LLRBRange<const_iterator> Range(const K &lo, const K &hi) const;
+
  private:
   enum Color { RED, BLACK };
   struct Node {
-    Node(const K &key, const V &value) : key(key),
-                                         values(new std::vector<V>{value}),
-                                         color(RED)
-    {}
+    template <typename KeyArg, typename... Args>
+    explicit Node(KeyArg &&key, Args&&... args)
+        : key(std::forward<KeyArg>(key)),
+          color(RED),
+          left(nullptr),
+          right(nullptr) {
+      values.emplace_back(std::forward<Args>(args)...);
+    }
     K key;
-    std::unique_ptr<std::vector<V>> values;
+    // Values in insertion order; the first few are stored in the node
+    ValueList<V> values;
     bool color;
-    std::unique_ptr<Node> left;
-    std::unique_ptr<Node> right;
+    Node *left;
+    Node *right;
   };
-  std::unique_ptr<Node> root;
+  typedef typename std::allocator_traits<Alloc>::template rebind_alloc<Node>
+      NodeAlloc;
+  typedef std::allocator_traits<NodeAlloc> NodeTraits;
+
+  // Insert and Remove keep the links they pass on a fixed stack. A tree of
+  // 2^32 keys is at most 64 levels deep, the rest is slack for the red links
+  // Remove pushes down while descending
+  static const int kMaxDepth = 96;
+
+  Node *root = nullptr;
   unsigned int cur_size = 0;
+  NodeAlloc node_alloc;
+#ifdef LLRB_ENABLE_STATS
+  LLRBCounters counters;
+#endif
+
+  // Helper methods for node lifetime
+  template <typename KeyArg, typename... Args>
+  Node* NewNode(KeyArg &&key, Args&&... args);
+  void DeleteNode(Node *n);
+  void DeleteTree(Node *n);
+
+  // Build a subtree of @n keys, each with the run of pairs taken from @it
+  // that share it, holding at most @max_size keys, that is 3^h - 1 for
+  // black height h
+  template <typename ForwardIt>
+  Node* Build(ForwardIt &it, ForwardIt last, std::size_t n,
+              std::size_t max_size);
+  // Return node holding the run of pairs with the key of @it, and move @it
+  // past them
+  template <typename ForwardIt>
+  Node* NewRun(ForwardIt &it, ForwardIt last);
 
   // Iterative helper methods
   Node* Get(Node *n, const K &key);
+  Node* Min(Node *n);
 
   // Recursive helper methods
-  Node* Min(Node *n);
-  void Insert(std::unique_ptr<Node> &n, const K &key, const V &value);
-  void Remove(std::unique_ptr<Node> &n, const K &key);
   void Print(Node *n);
-  std::vector<V> GetAll(Node *n);
+  void CollectStats(const Node *n, int depth, LLRBStats *stats) const;
+  // Return black height of subtree @n, whose keys must lie strictly between
+  // @lo and @hi when they are given, or -1 if it breaks an invariant
+  int Validate(const Node *n, const K *lo, const K *hi) const;
 
   // Helper methods for the self-balancing
   bool IsRed(Node *n);
   void FlipColors(Node *n);
-  void RotateRight(std::unique_ptr<Node> &prt);
-  void RotateLeft(std::unique_ptr<Node> &prt);
-  void FixUp(std::unique_ptr<Node> &n);
-  void MoveRedRight(std::unique_ptr<Node> &n);
-  void MoveRedLeft(std::unique_ptr<Node> &n);
-  void DeleteMin(std::unique_ptr<Node> &n);
+  void RotateRight(Node *&prt);
+  void RotateLeft(Node *&prt);
+  void FixUp(Node *&n);
+  void MoveRedRight(Node *&n);
+  void MoveRedLeft(Node *&n);
+};
+
+template <typename K, typename V, typename Alloc>
+class LLRB_multimap<K, V, Alloc>::const_iterator {
+ public:
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef std::pair<K, V> value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef std::pair<const K&, const V&> reference;
+  typedef LLRBArrowProxy<reference> pointer;
+
+  const_iterator() : root(nullptr), index(0) {}
+
+  reference operator*() const {
+    Node *n = path.Current();
+    return reference(n->key, n->values[index]);
+  }
+  pointer operator->() const { return pointer(**this); }
+
+  const_iterator& operator++() {
+    if (index + 1 < path.Current()->values.size()) {
+      index++;
+    } else {
+      path.Next();
+      index = 0;
+    }
+    return *this;
+  }
+  const_iterator operator++(int) {
+    const_iterator old(*this);
+    ++*this;
+    return old;
+  }
+  const_iterator& operator--() {
+    if (index > 0) {
+      index--;
+      return *this;
+    }
+    // Stepping back from end lands on the last value of the max key
+    if (path.Current())
+      path.Prev();
+    else
+      path.PushMax(root);
+    if (path.Current())
+      index = path.Current()->values.size() - 1;
+    return *this;
+  }
+  const_iterator operator--(int) {
+    const_iterator old(*this);
+    --*this;
+    return old;
+  }
+
+  bool operator==(const const_iterator &other) const {
+    return path.Current() == other.path.Current() && index == other.index;
+  }
+  bool operator!=(const const_iterator &other) const {
+    return !(*this == other);
+  }
+
+ private:
+  friend class LLRB_multimap;
+  explicit const_iterator(Node *root) : root(root), index(0) {}
+
+  Node *root;
+  LLRBPath<Node> path;
+  // Position in the values of the current node
+  std::size_t index;
 };
 
-template <typename K, typename V>
-unsigned int LLRB_multimap<K, V>::Size() {
+template <typename K, typename V, typename Alloc>
+LLRB_multimap<K, V, Alloc>::LLRB_multimap(const Alloc& alloc)
+    : node_alloc(alloc) {}
+
+template <typename K, typename V, typename Alloc>
+LLRB_multimap<K, V, Alloc>::LLRB_multimap(LLRB_multimap&& other)
+    : root(other.root),
+      cur_size(other.cur_size),
+      node_alloc(other.node_alloc) {
+  other.root = nullptr;
+  other.cur_size = 0;
+}
+
+template <typename K, typename V, typename Alloc>
+LLRB_multimap<K, V, Alloc>& LLRB_multimap<K, V, Alloc>::operator=(
+    LLRB_multimap&& other) {
+  if (this != &other) {
+    Clear();
+    std::swap(root, other.root);
+    std::swap(cur_size, other.cur_size);
+    std::swap(node_alloc, other.node_alloc);
+  }
+  return *this;
+}
+
+template <typename K, typename V, typename Alloc>
+LLRB_multimap<K, V, Alloc>::~LLRB_multimap() {
+  Clear();
+}
+
+template <typename K, typename V, typename Alloc>
+template <typename KeyArg, typename... Args>
+typename LLRB_multimap<K, V, Alloc>::Node*
+LLRB_multimap<K, V, Alloc>::NewNode(KeyArg &&key, Args&&... args) {
+  Node *n = NodeTraits::allocate(node_alloc, 1);
+  try {
+    ::new (static_cast<void*>(n)) Node(std::forward<KeyArg>(key),
+                                       std::forward<Args>(args)...);
+  } catch (...) {
+    NodeTraits::deallocate(node_alloc, n, 1);
+    throw;
+  }
+  return n;
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::DeleteNode(Node *n) {
+  n->~Node();
+  NodeTraits::deallocate(node_alloc, n, 1);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::Clear() {
+  Node *n = root;
+  root = nullptr;
+  cur_size = 0;
+
+  // Nothing to destroy: hand every slab back at once if the pool allows
+  if (std::is_trivially_destructible<Node>::value &&
+      TryReleaseAll(node_alloc))
+    return;
+
+  DeleteTree(n);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::DeleteTree(Node *n) {
+  // Free node by node without recursion. Rotating left children up turns
+  // the tree into a right-leaning list that is freed front to back
+  while (n) {
+    if (n->left) {
+      Node *l = n->left;
+      n->left = l->right;
+      l->right = n;
+      n = l;
+    } else {
+      Node *next = n->right;
+      DeleteNode(n);
+      n = next;
+    }
+  }
+}
+
+template <typename K, typename V, typename Alloc>
+template <typename ForwardIt>
+void LLRB_multimap<K, V, Alloc>::BulkLoad(ForwardIt first, ForwardIt last) {
+  // Count pairs and keys, and check the input, before touching the tree
+  std::size_t n = 0, keys = 0;
+  for (ForwardIt it = first, prev = first; it != last; prev = it, ++it, n++) {
+    if (n == 0 || prev->first < it->first)
+      keys++;
+    else if (it->first < prev->first)
+      throw std::runtime_error("Error: BulkLoad input is not sorted");
+  }
+  if (n > UINT_MAX)
+    throw std::runtime_error("Error: BulkLoad input is too large");
+
+  // Same shape as LLRB_map::BulkLoad gives, over the distinct keys
+  std::size_t max_size = 1;
+  for (std::size_t full = 0; 2 * full + 1 <= keys; full = 2 * full + 1)
+    max_size *= 3;
+  max_size -= 1;
+
+  Clear();
+  root = Build(first, last, keys, max_size);
+  cur_size = n;
+}
+
+template <typename K, typename V, typename Alloc>
+template <typename ForwardIt>
+typename LLRB_multimap<K, V, Alloc>::Node*
+LLRB_multimap<K, V, Alloc>::NewRun(ForwardIt &it, ForwardIt last) {
+  Node *n = NewNode(it->first, it->second);
+  try {
+    for (++it; it != last && !(n->key < it->first); ++it)
+      n->values.push_back(it->second);
+  } catch (...) {
+    DeleteNode(n);
+    throw;
+  }
+  return n;
+}
+
+template <typename K, typename V, typename Alloc>
+template <typename ForwardIt>
+typename LLRB_multimap<K, V, Alloc>::Node*
+LLRB_multimap<K, V, Alloc>::Build(ForwardIt &it, ForwardIt last,
+                                  std::size_t n, std::size_t max_size) {
+  if (n == 0) return nullptr;
+
+  // Subtrees one black level down hold at most this many keys
+  std::size_t max_child = (max_size + 1) / 3 - 1;
+  Node *left = nullptr, *mid = nullptr, *red = nullptr, *top = nullptr;
+  try {
+    if (n - 1 <= 2 * max_child) {
+      // 2-node: one black node over two even halves
+      std::size_t n_left = (n - 1) / 2;
+      left = Build(it, last, n_left, max_child);
+      top = NewRun(it, last);
+      top->left = left;
+      left = nullptr;
+      top->right = Build(it, last, n - 1 - n_left, max_child);
+    } else {
+      // 3-node: a black node with a red left child over three even thirds
+      std::size_t n_left = (n - 2) / 3;
+      std::size_t n_mid = (n - 2 - n_left) / 2;
+      left = Build(it, last, n_left, max_child);
+      red = NewRun(it, last);
+      red->left = left;
+      left = nullptr;
+      mid = Build(it, last, n_mid, max_child);
+      red->right = mid;
+      mid = nullptr;
+      top = NewRun(it, last);
+      top->left = red;
+      red = nullptr;
+      top->right = Build(it, last, n - 2 - n_left - n_mid, max_child);
+    }
+  } catch (...) {
+    DeleteTree(left);
+    DeleteTree(mid);
+    DeleteTree(red);
+    DeleteTree(top);
+    throw;
+  }
+  top->color = BLACK;
+  return top;
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::Save(const std::string &path) const {
+  SaveLLRBSnapshot<K, V>(path, begin(), end(), cur_size, true);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::Load(const std::string &path) {
+  LLRBSnapshot<K, V> snapshot(path);
+  BulkLoad(snapshot.begin(), snapshot.end());
+}
+
+template <typename K, typename V, typename Alloc>
+unsigned int LLRB_multimap<K, V, Alloc>::Size() {
   return cur_size;
 }
 
-template <typename K, typename V>
-typename LLRB_multimap<K, V>::Node* LLRB_multimap<K, V>::Get
-    (LLRB_multimap<K, V>::Node* n, const K &key) {
+template <typename K, typename V, typename Alloc>
+typename LLRB_multimap<K, V, Alloc>::Node* LLRB_multimap<K, V, Alloc>::Get
+    (Node* n, const K &key) {
+  LLRB_STAT(counters.Add(LLRBCounters::kOperations));
   while (n) {
+    LLRB_STAT(counters.Add(LLRBCounters::kComparisons));
     if (key == n->key)
       return n;
 
     if (key < n->key)
-      n = n->left.get();
+      n = n->left;
     else
-      n = n->right.get();
+      n = n->right;
   }
   return nullptr;
 }
 
-template <typename K, typename V>
-bool LLRB_multimap<K, V>::Contains(const K &key) {
-  return Get(root.get(), key) != nullptr;
+template <typename K, typename V, typename Alloc>
+bool LLRB_multimap<K, V, Alloc>::Contains(const K &key) {
+  return Get(root, key) != nullptr;
 }
 
-template <typename K, typename V>
-const K& LLRB_multimap<K, V>::Max(void) {
-  Node *n = root.get();
-  while (n->right) n = n->right.get();
+template <typename K, typename V, typename Alloc>
+const K& LLRB_multimap<K, V, Alloc>::Max(void) {
+  Node *n = root;
+  while (n->right) n = n->right;
   return n->key;
 }
 
-template <typename K, typename V>
-const K& LLRB_multimap<K, V>::Min(void) {
-  return Min(root.get())->key;
+template <typename K, typename V, typename Alloc>
+const K& LLRB_multimap<K, V, Alloc>::Min(void) {
+  return Min(root)->key;
 }
 
-template <typename K, typename V>
-typename LLRB_multimap<K, V>::Node* LLRB_multimap<K, V>::Min(Node *n) {
-  if (n->left)
-    return Min(n->left.get());
-  else
-    return n;
+template <typename K, typename V, typename Alloc>
+typename LLRB_multimap<K, V, Alloc>::Node* LLRB_multimap<K, V, Alloc>::Min(Node *n) {
+  while (n->left) n = n->left;
+  return n;
 }
 
-template <typename K, typename V>
-bool LLRB_multimap<K, V>::IsRed(Node *n) {
+template <typename K, typename V, typename Alloc>
+bool LLRB_multimap<K, V, Alloc>::IsRed(Node *n) {
   if (!n) return false;
   return (n->color == RED);
 }
 
-template <typename K, typename V>
-void LLRB_multimap<K, V>::FlipColors(Node *n) {
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::FlipColors(Node *n) {
+  LLRB_STAT(counters.Add(LLRBCounters::kFlipColors));
   n->color = !n->color;
   n->left->color = !n->left->color;
   n->right->color = !n->right->color;
 }
 
-template <typename K, typename V>
-void LLRB_multimap<K, V>::RotateRight(std::unique_ptr<Node> &prt) {
-  std::unique_ptr<Node> chd = std::move(prt->left);
-  prt->left = std::move(chd->right);
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::RotateRight(Node *&prt) {
+  LLRB_STAT(counters.Add(LLRBCounters::kRotateRight));
+  Node *chd = prt->left;
+  prt->left = chd->right;
   chd->color = prt->color;
   prt->color = RED;
-  chd->right = std::move(prt);
-  prt = std::move(chd);
+  chd->right = prt;
+  prt = chd;
 }
 
-template <typename K, typename V>
-void LLRB_multimap<K, V>::RotateLeft(std::unique_ptr<Node> &prt) {
-  std::unique_ptr<Node> chd = std::move(prt->right);
-  prt->right = std::move(chd->left);
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::RotateLeft(Node *&prt) {
+  LLRB_STAT(counters.Add(LLRBCounters::kRotateLeft));
+  Node *chd = prt->right;
+  prt->right = chd->left;
   chd->color = prt->color;
   prt->color = RED;
-  chd->left = std::move(prt);
-  prt = std::move(chd);
+  chd->left = prt;
+  prt = chd;
 }
 
-template <typename K, typename V>
-void LLRB_multimap<K, V>::FixUp(std::unique_ptr<Node> &n) {
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::FixUp(Node *&n) {
   // Rotate left if there is a right-leaning red node
-  if (IsRed(n->right.get()) && !IsRed(n->left.get()))
+  if (IsRed(n->right) && !IsRed(n->left))
     RotateLeft(n);
   // Rotate right if red-red pair of nodes on left
-  if (IsRed(n->left.get()) && IsRed(n->left->left.get()))
+  if (IsRed(n->left) && IsRed(n->left->left))
     RotateRight(n);
   // Recoloring if both children are red
-  if (IsRed(n->left.get()) && IsRed(n->right.get()))
-    FlipColors(n.get());
+  if (IsRed(n->left) && IsRed(n->right))
+    FlipColors(n);
 }
 
-template <typename K, typename V>
-void LLRB_multimap<K, V>::MoveRedRight(std::unique_ptr<Node> &n) {
-  FlipColors(n.get());
-  if (IsRed(n->left->left.get())) {
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::MoveRedRight(Node *&n) {
+  LLRB_STAT(counters.Add(LLRBCounters::kMoveRedRight));
+  FlipColors(n);
+  if (IsRed(n->left->left)) {
     RotateRight(n);
-    FlipColors(n.get());
+    FlipColors(n);
   }
 }
 
-template <typename K, typename V>
-void LLRB_multimap<K, V>::MoveRedLeft(std::unique_ptr<Node> &n) {
-  FlipColors(n.get());
-  if (IsRed(n->right->left.get())) {
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::MoveRedLeft(Node *&n) {
+  LLRB_STAT(counters.Add(LLRBCounters::kMoveRedLeft));
+  FlipColors(n);
+  if (IsRed(n->right->left)) {
     RotateRight(n->right);
     RotateLeft(n);
-    FlipColors(n.get());
+    FlipColors(n);
   }
 }
 
-template <typename K, typename V>
-void LLRB_multimap<K, V>::DeleteMin(std::unique_ptr<Node> &n) {
-  // No left child, min is 'n'
-  if (!n->left) {
-    // Remove n
-    n = nullptr;
-    return;
-  }
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::Remove(const K &key) {
+  // Links from the root down to the current node, fixed up on the way back
+  Node **path[kMaxDepth];
+  int depth = 0;
+  Node **link = &root;
+  bool removed = false;
+
+  LLRB_STAT(counters.Add(LLRBCounters::kOperations));
+  while (*link) {
+    LLRB_STAT(counters.Add(LLRBCounters::kComparisons));
+    Node *n = *link;
+    // Remove top value of n if has multiple values. The tree keeps its shape
+    // below n, only the links above it need fixing
+    if (key == n->key && n->values.size() > 1) {
+      n->values.pop_front();
+      removed = true;
+      break;
+    }
 
-  if (!IsRed(n->left.get()) && !IsRed(n->left->left.get()))
-    MoveRedLeft(n);
+    path[depth++] = link;
+    if (key < n->key) {
+      // Key not found
+      if (!n->left) break;
+      if (!IsRed(n->left) && !IsRed(n->left->left))
+        MoveRedLeft(*link);
+      link = &(*link)->left;
+      continue;
+    }
 
-  DeleteMin(n->left);
+    if (IsRed(n->left))
+      RotateRight(*link);
 
-  FixUp(n);
-}
+    n = *link;
+    if (key == n->key && !n->right) {
+      // Remove n, nothing is left below it to fix
+      depth--;
+      *link = nullptr;
+      DeleteNode(n);
+      removed = true;
+      break;
+    }
 
-template <typename K, typename V>
-void LLRB_multimap<K, V>::Remove(const K &key) {
-  if (!Contains(key))
-    return;
-  Remove(root, key);
-  cur_size--;
-  if (root)
-    root->color = BLACK;
-}
+    // Key not found
+    if (!n->right) break;
 
-template <typename K, typename V>
-void LLRB_multimap<K, V>::Remove(std::unique_ptr<Node> &n, const K &key) {
-  // Key not found
-  if (!n) return;
+    if (!IsRed(n->right) && !IsRed(n->right->left))
+      MoveRedRight(*link);
 
-  // Remove top value of n if has multiple values
-  if (key == n->key && (n->values.get())->size() > 1) {
-    std::vector<V>* vals = n->values.get();
-    for (unsigned int i = 0; i < vals->size() - 1; i++) {
-      vals->at(i) = vals->at(i + 1);
+    n = *link;
+    if (key == n->key) {
+      // Walk down to the min node of the right subtree, moving a red link
+      // down the left side as the descent goes
+      Node **n_link = link;
+      int right_depth = depth;
+      link = &n->right;
+      while ((*link)->left) {
+        path[depth++] = link;
+        if (!IsRed((*link)->left) && !IsRed((*link)->left->left))
+          MoveRedLeft(*link);
+        link = &(*link)->left;
+      }
+      // Unlink the min node and put it in the place of n, so no key or
+      // value is moved. The link below n on the path now lives in it
+      Node *n_min = *link;
+      *link = nullptr;
+      n_min->left = n->left;
+      n_min->right = n->right;
+      n_min->color = n->color;
+      *n_link = n_min;
+      if (depth > right_depth)
+        path[right_depth] = &n_min->right;
+      DeleteNode(n);
+      removed = true;
+      break;
     }
-    vals->pop_back();
-    return;
+    link = &n->right;
   }
 
-  if (key < n->key) {
-    if (!IsRed(n->left.get()) && !IsRed(n->left->left.get()))
-      MoveRedLeft(n);
-    Remove(n->left, key);
-  } else {
-    if (IsRed(n->left.get()))
-      RotateRight(n);
+  while (depth > 0)
+    FixUp(*path[--depth]);
+  if (removed)
+    cur_size--;
+  if (root)
+    root->color = BLACK;
+}
 
-    if (key == n->key && !n->right) {
-      // Remove n
-      n = nullptr;
-      return;
-    }
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::Insert(const K &key, const V &value) {
+  Emplace(key, value);
+}
 
-    if (!IsRed(n->right.get()) && !IsRed(n->right->left.get()))
-      MoveRedRight(n);
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::Insert(K &&key, V &&value) {
+  Emplace(std::move(key), std::move(value));
+}
 
+template <typename K, typename V, typename Alloc>
+template <typename KeyArg, typename... Args>
+void LLRB_multimap<K, V, Alloc>::Emplace(KeyArg &&key, Args&&... args) {
+  // Links from the root down to the new node, fixed up on the way back
+  Node **path[kMaxDepth];
+  int depth = 0;
+  Node **link = &root;
+
+  LLRB_STAT(counters.Add(LLRBCounters::kOperations));
+  while (*link) {
+    LLRB_STAT(counters.Add(LLRBCounters::kComparisons));
+    Node *n = *link;
     if (key == n->key) {
-      // Find min node in the right subtree
-      Node *n_min = Min(n->right.get());
-      // Copy content from min node
-      n->key = n_min->key;
-      n->values.reset(std::move(n_min->values.release()));
-      // Delete min node recursively
-      DeleteMin(n->right);
-    } else {
-      Remove(n->right, key);
+      // Existing key: the shape of the tree does not change
+      n->values.emplace_back(std::forward<Args>(args)...);
+      cur_size++;
+      return;
     }
+    path[depth++] = link;
+    link = key < n->key ? &n->left : &n->right;
   }
+  *link = NewNode(std::forward<KeyArg>(key), std::forward<Args>(args)...);
 
-  FixUp(n);
-}
-
-template <typename K, typename V>
-void LLRB_multimap<K, V>::Insert(const K &key, const V &value) {
-  Insert(root, key, value);
+  while (depth > 0)
+    FixUp(*path[--depth]);
   cur_size++;
   root->color = BLACK;
 }
 
-template <typename K, typename V>
-void LLRB_multimap<K, V>::Insert(std::unique_ptr<Node> &n, const K &key,
-                                 const V &value) {
-  if (!n)
-    n = std::unique_ptr<Node>(new Node(key, value));
-  else if (key < n->key)
-    Insert(n->left, key, value);
-  else if (key > n->key)
-    Insert(n->right, key, value);
-  else
-    (n->values.get())->push_back(value);
+template <typename K, typename V, typename Alloc>
+LLRBStats LLRB_multimap<K, V, Alloc>::Stats() const {
+  LLRBStats stats;
+  CollectStats(root, 0, &stats);
+  // Every path has as many black nodes, so the left spine will do
+  for (const Node *n = root; n; n = n->left)
+    if (n->color == BLACK) stats.black_height++;
+#ifdef LLRB_ENABLE_STATS
+  stats.counted = true;
+  stats.ops = counters.Read();
+#endif
+  return stats;
+}
+
+template <typename K, typename V, typename Alloc>
+bool LLRB_multimap<K, V, Alloc>::Validate() const {
+  return Validate(root, nullptr, nullptr) >= 0;
+}
+
+template <typename K, typename V, typename Alloc>
+int LLRB_multimap<K, V, Alloc>::Validate(const Node *n, const K *lo,
+                                         const K *hi) const {
+  if (!n) return 0;
+  if ((lo && !(*lo < n->key)) || (hi && !(n->key < *hi))) return -1;
+  if (n->values.empty()) return -1;
+  if (n->right && n->right->color == RED) return -1;
+  if (n->color == RED && n->left && n->left->color == RED) return -1;
+  int left = Validate(n->left, lo, &n->key);
+  int right = Validate(n->right, &n->key, hi);
+  if (left < 0 || left != right) return -1;
+  return left + (n->color == BLACK ? 1 : 0);
+}
+
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::ResetStats() {
+  LLRB_STAT(counters.Reset());
+}
 
-  FixUp(n);
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::CollectStats(const Node *n, int depth,
+                                              LLRBStats *stats) const {
+  if (!n) return;
+  stats->AddNode(depth);
+  stats->bytes_used += sizeof(Node) + n->values.heap_bytes();
+  CollectStats(n->left, depth + 1, stats);
+  CollectStats(n->right, depth + 1, stats);
 }
 
-template <typename K, typename V>
-void LLRB_multimap<K, V>::Print() {
-  Print(root.get());
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::Print() {
+  Print(root);
   std::cout << std::endl;
 }
 
-template <typename K, typename V>
-void LLRB_multimap<K, V>::Print(Node *n) {
+template <typename K, typename V, typename Alloc>
+void LLRB_multimap<K, V, Alloc>::Print(Node *n) {
   if (!n) return;
-  Print(n->left.get());
+  Print(n->left);
   std::cout << "<" << n->key << ">: ";
-  for (auto n : *(n->values.get())) {
-    std::cout << n << " ";
+  for (unsigned int i = 0; i < n->values.size(); i++) {
+    std::cout << n->values[i] << " ";
   }
   std::cout << std::endl;
-  Print(n->right.get());
+  Print(n->right);
 }
 
-template <typename K, typename V>
-const V& LLRB_multimap<K, V>::Get(const K& key) {
-  Node* n = Get(root.get(), key);
+template <typename K, typename V, typename Alloc>
+const V& LLRB_multimap<K, V, Alloc>::Get(const K& key) {
+  Node* n = Get(root, key);
   if (!n) {
     throw std::runtime_error("No matching node found!");
   }
-  return (n->values.get())->at(0);
+  return n->values.front();
 }
 
-template<typename K, typename V>
-std::vector<V> LLRB_multimap<K, V>::GetAll() {
-  Node *n = root.get();
-  if (!n) {
+template <typename K, typename V, typename Alloc>
+std::vector<V> LLRB_multimap<K, V, Alloc>::GetAll() {
+  if (!root) {
     throw std::runtime_error("Empty Tree!");
   }
-  return GetAll(n);
-}
-
-template<typename K, typename V>
-std::vector<V> LLRB_multimap<K, V>::GetAll(LLRB_multimap::Node *n) {
   std::vector<V> all;
-  if (!n) return all;
-  // Get all values stored in right subtree
-  std::vector<V> right = GetAll(n->right.get());
-  // Get all values stored in left subtree
-  std::vector<V> left = GetAll(n->left.get());
-  // Concatenate all values stored in left and right subtrees
-  // and in current node
-  all.insert(all.end(), left.begin(), left.end());
-  all.insert(all.end(), right.begin(), right.end());
-  all.insert(all.end(), n->values.get()->begin(), n->values.get()->end());
+  all.reserve(cur_size);
+  for (const_iterator it = begin(); it != end(); ++it)
+    all.push_back(it->second);
   return all;
 }
 
+template <typename K, typename V, typename Alloc>
+typename LLRB_multimap<K, V, Alloc>::const_iterator
+LLRB_multimap<K, V, Alloc>::begin() const {
+  const_iterator it(root);
+  it.path.PushMin(root);
+  return it;
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_multimap<K, V, Alloc>::const_iterator
+LLRB_multimap<K, V, Alloc>::end() const {
+  return const_iterator(root);
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_multimap<K, V, Alloc>::const_iterator
+LLRB_multimap<K, V, Alloc>::LowerBound(const K &key) const {
+  const_iterator it(root);
+  it.path.Seek(root, key, false);
+  return it;
+}
+
+template <typename K, typename V, typename Alloc>
+typename LLRB_multimap<K, V, Alloc>::const_iterator
+LLRB_multimap<K, V, Alloc>::UpperBound(const K &key) const {
+  const_iterator it(root);
+  it.path.Seek(root, key, true);
+  return it;
+}
+
+template <typename K, typename V, typename Alloc>
+LLRBRange<typename LLRB_multimap<K, V, Alloc>::const_iterator>
+LLRB_multimap<K, V, Alloc>::Range(const K &lo, const K &hi) const {
+  if (hi < lo)
+    return LLRBRange<const_iterator>(end(), end());
+  return LLRBRange<const_iterator>(LowerBound(lo), UpperBound(hi));
+}
+
 #endif  // LLRB_MULTIMAP_H_
@@ -0,0 +1,359 @@
+#ifndef LLRB_SNAPSHOT_H_
+#define LLRB_SNAPSHOT_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "llrb_iterator.h"
+
+// A snapshot file holds a header, then every key, then every value, in key
+// order. Values of one multimap key follow each other in insertion order.
+// Both arrays start on a 64-byte boundary so they can be used in place
+// once the file is mapped. Numbers are in the byte order of the machine
+// that wrote the file, which the header records
+struct LLRBSnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t key_size;
+  uint32_t value_size;
+  uint32_t flags;
+  uint32_t reserved;
+  uint64_t count;
+  uint64_t keys_offset;
+  uint64_t values_offset;
+  // FNV-1a of the key and value arrays
+  uint64_t checksum;
+};
+
+const char kLLRBSnapshotMagic[8] = {'L', 'L', 'R', 'B', 'S', 'N', 'A', 'P'};
+const uint32_t kLLRBSnapshotVersion = 1;
+const uint32_t kLLRBSnapshotByteOrder = 0x01020304;
+// Set when a key may appear more than once
+const uint32_t kLLRBSnapshotMulti = 1;
+const uint64_t kLLRBSnapshotAlign = 64;
+
+// Return FNV-1a @hash extended with @size bytes at @data
+inline uint64_t LLRBSnapshotChecksum(uint64_t hash, const void *data,
+                                     std::size_t size) {
+  const unsigned char *bytes = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+const uint64_t kLLRBSnapshotChecksumSeed = 0xcbf29ce484222325ULL;
+
+// Write the @count <key, value> pairs in [@first, @last), sorted by key, to
+// a snapshot at @path. The file is written beside @path and renamed over it
+// when complete, so readers never see half a snapshot. Throws
+// std::runtime_error if the file cannot be written
+template <typename K, typename V, typename Iterator>
+void SaveLLRBSnapshot(const std::string &path, Iterator first, Iterator last,
+                      uint64_t count, bool multi) {
+  static_assert(std::is_trivially_copyable<K>::value &&
+                std::is_trivially_copyable<V>::value,
+                "snapshots need trivially copyable keys and values");
+
+  LLRBSnapshotHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kLLRBSnapshotMagic, sizeof(header.magic));
+  header.version = kLLRBSnapshotVersion;
+  header.byte_order = kLLRBSnapshotByteOrder;
+  header.key_size = sizeof(K);
+  header.value_size = sizeof(V);
+  header.flags = multi ? kLLRBSnapshotMulti : 0;
+  header.count = count;
+  auto align = [](uint64_t offset) {
+    return (offset + kLLRBSnapshotAlign - 1) / kLLRBSnapshotAlign *
+           kLLRBSnapshotAlign;
+  };
+  header.keys_offset = align(sizeof(header));
+  header.values_offset = align(header.keys_offset + count * sizeof(K));
+
+  // A temp file of its own, so saves to one path at once don't write over
+  // each other's. mkstemp makes it 0600; a snapshot is meant to be shared
+  std::string temp_path = path + ".XXXXXX";
+  int fd = mkstemp(&temp_path[0]);
+  if (fd < 0)
+    throw std::runtime_error("Error: cannot write snapshot " + path);
+  fchmod(fd, 0644);
+  close(fd);
+  std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    std::remove(temp_path.c_str());
+    throw std::runtime_error("Error: cannot write snapshot " + path);
+  }
+
+  // The header goes last, once the checksum is known
+  const char padding[kLLRBSnapshotAlign] = {};
+  uint64_t checksum = kLLRBSnapshotChecksumSeed;
+  out.write(padding, header.keys_offset);
+  for (Iterator it = first; it != last; ++it) {
+    const K &key = (*it).first;
+    checksum = LLRBSnapshotChecksum(checksum, &key, sizeof(K));
+    out.write(reinterpret_cast<const char*>(&key), sizeof(K));
+  }
+  out.write(padding,
+            header.values_offset - header.keys_offset - count * sizeof(K));
+  for (Iterator it = first; it != last; ++it) {
+    const V &value = (*it).second;
+    checksum = LLRBSnapshotChecksum(checksum, &value, sizeof(V));
+    out.write(reinterpret_cast<const char*>(&value), sizeof(V));
+  }
+  header.checksum = checksum;
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.close();
+  if (!out || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+    std::remove(temp_path.c_str());
+    throw std::runtime_error("Error: cannot write snapshot " + path);
+  }
+}
+
+// Read-only map served straight from a snapshot file mapped into memory.
+// Opening it costs no parsing and no allocation, and lookups are binary
+// searches over the key array. Pages are read in as lookups touch them
+template <typename K, typename V>
+class LLRBSnapshot {
+ public:
+  static_assert(std::is_trivially_copyable<K>::value &&
+                std::is_trivially_copyable<V>::value,
+                "snapshots need trivially copyable keys and values");
+  static_assert(alignof(K) <= kLLRBSnapshotAlign &&
+                alignof(V) <= kLLRBSnapshotAlign,
+                "snapshot arrays are only 64-byte aligned");
+
+  // Map snapshot at @path. Throws std::runtime_error if it is missing,
+  // damaged or written for other key or value types. Checking the checksum
+  // reads the whole file; @verify false skips it and leaves pages to be
+  // read on demand
+  explicit LLRBSnapshot(const std::string &path, bool verify = true);
+  LLRBSnapshot(const LLRBSnapshot&) = delete;
+  LLRBSnapshot& operator=(const LLRBSnapshot&) = delete;
+  ~LLRBSnapshot();
+
+  // Return number of <key, value> pairs
+  unsigned int Size() const { return count; }
+  // Return whether a key may appear more than once
+  bool IsMulti() const { return multi; }
+  // Return whether @key is found in snapshot
+  bool Contains(const K &key) const;
+  // Return first value given key. Throws std::runtime_error if @key is not
+  // in snapshot
+  const V& Get(const K &key) const;
+
+  // Iterators visit <key, value> pairs in key order, handing out references
+  // into the mapped file
+  class const_iterator;
+  typedef const_iterator iterator;
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, count); }
+  // Return iterator to the first pair with key not less than @key
+  const_iterator LowerBound(const K &key) const;
+  // Return iterator to the first pair with key greater than @key
+  const_iterator UpperBound(const K &key) const;
+  // Return pairs with keys from @lo to @hi, both included
+  LLRBRange<const_iterator> Range(const K &lo, const K &hi) const;
+
+ private:
+  void *data;
+  std::size_t size;
+  const K *keys;
+  const V *values;
+  unsigned int count;
+  bool multi;
+
+  // Check the mapped file, throwing std::runtime_error if it is unusable
+  void Validate(const std::string &path, bool verify);
+};
+
+template <typename K, typename V>
+class LLRBSnapshot<K, V>::const_iterator {
+ public:
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef std::pair<K, V> value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef std::pair<const K&, const V&> reference;
+  typedef LLRBArrowProxy<reference> pointer;
+
+  const_iterator() : snapshot(nullptr), index(0) {}
+
+  reference operator*() const {
+    return reference(snapshot->keys[index], snapshot->values[index]);
+  }
+  pointer operator->() const { return pointer(**this); }
+
+  const_iterator& operator++() {
+    index++;
+    return *this;
+  }
+  const_iterator operator++(int) {
+    const_iterator old(*this);
+    index++;
+    return old;
+  }
+  const_iterator& operator--() {
+    index--;
+    return *this;
+  }
+  const_iterator operator--(int) {
+    const_iterator old(*this);
+    index--;
+    return old;
+  }
+
+  bool operator==(const const_iterator &other) const {
+    return index == other.index;
+  }
+  bool operator!=(const const_iterator &other) const {
+    return index != other.index;
+  }
+
+ private:
+  friend class LLRBSnapshot;
+  const_iterator(const LLRBSnapshot *snapshot, std::size_t index)
+      : snapshot(snapshot), index(index) {}
+
+  const LLRBSnapshot *snapshot;
+  std::size_t index;
+};
+
+template <typename K, typename V>
+LLRBSnapshot<K, V>::LLRBSnapshot(const std::string &path, bool verify)
+    : data(nullptr), size(0), keys(nullptr), values(nullptr), count(0),
+      multi(false) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Error: cannot open snapshot " + path);
+  struct stat info;
+  if (fstat(fd, &info) != 0 ||
+      static_cast<std::size_t>(info.st_size) < sizeof(LLRBSnapshotHeader)) {
+    close(fd);
+    throw std::runtime_error("Error: snapshot " + path + " is damaged");
+  }
+  size = info.st_size;
+  data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    throw std::runtime_error("Error: cannot map snapshot " + path);
+  try {
+    Validate(path, verify);
+  } catch (...) {
+    munmap(data, size);
+    throw;
+  }
+}
+
+template <typename K, typename V>
+LLRBSnapshot<K, V>::~LLRBSnapshot() {
+  munmap(data, size);
+}
+
+template <typename K, typename V>
+void LLRBSnapshot<K, V>::Validate(const std::string &path, bool verify) {
+  const LLRBSnapshotHeader &header =
+      *static_cast<const LLRBSnapshotHeader*>(data);
+  if (std::memcmp(header.magic, kLLRBSnapshotMagic, sizeof(header.magic)) ||
+      header.version != kLLRBSnapshotVersion)
+    throw std::runtime_error("Error: " + path + " is not a snapshot");
+  if (header.byte_order != kLLRBSnapshotByteOrder ||
+      header.key_size != sizeof(K) || header.value_size != sizeof(V))
+    throw std::runtime_error("Error: snapshot " + path +
+                             " was written for other types");
+
+  // Both arrays must be aligned and fit in the file, without overflow
+  uint64_t n = header.count;
+  if (n > UINT_MAX || header.keys_offset % kLLRBSnapshotAlign ||
+      header.values_offset % kLLRBSnapshotAlign ||
+      header.keys_offset < sizeof(header) ||
+      header.values_offset < header.keys_offset ||
+      (header.values_offset - header.keys_offset) / sizeof(K) < n ||
+      header.values_offset > size ||
+      (size - header.values_offset) / sizeof(V) != n ||
+      (size - header.values_offset) % sizeof(V))
+    throw std::runtime_error("Error: snapshot " + path + " is damaged");
+
+  const char *bytes = static_cast<const char*>(data);
+  keys = reinterpret_cast<const K*>(bytes + header.keys_offset);
+  values = reinterpret_cast<const V*>(bytes + header.values_offset);
+  count = n;
+  multi = header.flags & kLLRBSnapshotMulti;
+
+  if (verify) {
+    uint64_t checksum = LLRBSnapshotChecksum(kLLRBSnapshotChecksumSeed, keys,
+                                             n * sizeof(K));
+    checksum = LLRBSnapshotChecksum(checksum, values, n * sizeof(V));
+    if (checksum != header.checksum)
+      throw std::runtime_error("Error: snapshot " + path + " is damaged");
+  }
+}
+
+template <typename K, typename V>
+bool LLRBSnapshot<K, V>::Contains(const K &key) const {
+  const_iterator it = LowerBound(key);
+  return it != end() && keys[it.index] == key;
+}
+
+template <typename K, typename V>
+const V& LLRBSnapshot<K, V>::Get(const K &key) const {
+  const_iterator it = LowerBound(key);
+  if (it == end() || !(keys[it.index] == key))
+    throw std::runtime_error("Error: Key not in map");
+  return values[it.index];
+}
+
+template <typename K, typename V>
+typename LLRBSnapshot<K, V>::const_iterator
+LLRBSnapshot<K, V>::LowerBound(const K &key) const {
+  std::size_t first = 0;
+  for (std::size_t length = count; length > 0;) {
+    std::size_t half = length / 2;
+    if (keys[first + half] < key) {
+      first += half + 1;
+      length -= half + 1;
+    } else {
+      length = half;
+    }
+  }
+  return const_iterator(this, first);
+}
+
+template <typename K, typename V>
+typename LLRBSnapshot<K, V>::const_iterator
+LLRBSnapshot<K, V>::UpperBound(const K &key) const {
+  std::size_t first = 0;
+  for (std::size_t length = count; length > 0;) {
+    std::size_t half = length / 2;
+    if (key < keys[first + half]) {
+      length = half;
+    } else {
+      first += half + 1;
+      length -= half + 1;
+    }
+  }
+  return const_iterator(this, first);
+}
+
+template <typename K, typename V>
+LLRBRange<typename LLRBSnapshot<K, V>::const_iterator>
+LLRBSnapshot<K, V>::Range(const K &lo, const K &hi) const {
+  if (hi < lo) return LLRBRange<const_iterator>(end(), end());
+  return LLRBRange<const_iterator>(LowerBound(lo), UpperBound(hi));
+}
+
+#endif  // LLRB_SNAPSHOT_H_
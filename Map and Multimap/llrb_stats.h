@@ -0,0 +1,145 @@
+#ifndef LLRB_STATS_H_
+#define LLRB_STATS_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Define LLRB_ENABLE_STATS before including llrb_map.h or llrb_multimap.h
+// to have the trees count the balancing work their operations do. Without
+// it the counters are compiled out and cost nothing
+#ifdef LLRB_ENABLE_STATS
+#define LLRB_STAT(statement) statement
+#else
+#define LLRB_STAT(statement)
+#endif
+
+// Totals of the work done by tree operations since the tree was made or
+// its counters were reset
+struct LLRBOpCounts {
+  // Lookups, inserts and removes of a single key
+  uint64_t operations = 0;
+  // Keys compared against on the way down, one per node visited
+  uint64_t comparisons = 0;
+  uint64_t rotate_left = 0;
+  uint64_t rotate_right = 0;
+  uint64_t flip_colors = 0;
+  uint64_t move_red_left = 0;
+  uint64_t move_red_right = 0;
+};
+
+// Counters a tree keeps while LLRB_ENABLE_STATS is defined. Lookups may run
+// side by side under a read lock, so every counter is a relaxed atomic
+class LLRBCounters {
+ public:
+  enum Counter {
+    kOperations,
+    kComparisons,
+    kRotateLeft,
+    kRotateRight,
+    kFlipColors,
+    kMoveRedLeft,
+    kMoveRedRight,
+    kNumCounters
+  };
+
+  LLRBCounters() { Reset(); }
+  LLRBCounters(const LLRBCounters&) = delete;
+  LLRBCounters& operator=(const LLRBCounters&) = delete;
+
+  // Add @n to @counter
+  void Add(Counter counter, uint64_t n = 1) {
+    counts[counter].fetch_add(n, std::memory_order_relaxed);
+  }
+  // Return copy of every counter
+  LLRBOpCounts Read() const {
+    LLRBOpCounts totals;
+    totals.operations = Load(kOperations);
+    totals.comparisons = Load(kComparisons);
+    totals.rotate_left = Load(kRotateLeft);
+    totals.rotate_right = Load(kRotateRight);
+    totals.flip_colors = Load(kFlipColors);
+    totals.move_red_left = Load(kMoveRedLeft);
+    totals.move_red_right = Load(kMoveRedRight);
+    return totals;
+  }
+  // Set every counter to zero
+  void Reset() {
+    for (int i = 0; i < kNumCounters; i++)
+      counts[i].store(0, std::memory_order_relaxed);
+  }
+
+ private:
+  uint64_t Load(Counter counter) const {
+    return counts[counter].load(std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> counts[kNumCounters];
+};
+
+// Shape of a tree, and the work counted so far when LLRB_ENABLE_STATS is
+// defined
+struct LLRBStats {
+  // Number of nodes, one per distinct key
+  std::size_t nodes = 0;
+  // Nodes on the longest path from the root, 0 for an empty tree
+  int height = 0;
+  // Black nodes on every path from the root
+  int black_height = 0;
+  // Bytes taken by the nodes and by multimap value lists spilled to the
+  // heap. Allocator overhead and memory the keys and values own are left out
+  std::size_t bytes_used = 0;
+  // Number of nodes at each depth, the root at depth 0
+  std::vector<std::size_t> depth_histogram;
+  // Whether @ops was counted, that is whether LLRB_ENABLE_STATS is defined
+  bool counted = false;
+  LLRBOpCounts ops;
+
+  // Return mean depth of a node, counting the root as 0
+  double MeanDepth() const {
+    if (nodes == 0) return 0;
+    double total = 0;
+    for (std::size_t d = 0; d < depth_histogram.size(); d++)
+      total += static_cast<double>(d) * depth_histogram[d];
+    return total / nodes;
+  }
+  // Return mean comparisons per counted operation
+  double ComparisonsPerOperation() const {
+    if (ops.operations == 0) return 0;
+    return static_cast<double>(ops.comparisons) / ops.operations;
+  }
+
+  // Record a node at @depth
+  void AddNode(int depth) {
+    if (depth_histogram.size() <= static_cast<std::size_t>(depth))
+      depth_histogram.resize(depth + 1);
+    depth_histogram[depth]++;
+    nodes++;
+    if (depth + 1 > height) height = depth + 1;
+  }
+};
+
+inline std::ostream& operator<<(std::ostream &out, const LLRBStats &stats) {
+  out << "nodes " << stats.nodes << ", height " << stats.height
+      << ", black height " << stats.black_height << ", bytes "
+      << stats.bytes_used << ", mean depth " << stats.MeanDepth() << "\n";
+  out << "depth histogram:";
+  for (std::size_t d = 0; d < stats.depth_histogram.size(); d++)
+    out << " " << d << ":" << stats.depth_histogram[d];
+  out << "\n";
+  if (!stats.counted)
+    return out << "operation counters off, define LLRB_ENABLE_STATS\n";
+  const LLRBOpCounts &ops = stats.ops;
+  out << "operations " << ops.operations << ", comparisons "
+      << ops.comparisons << " (" << stats.ComparisonsPerOperation()
+      << " per operation)\n";
+  out << "rotate left " << ops.rotate_left << ", rotate right "
+      << ops.rotate_right << ", flip colors " << ops.flip_colors
+      << ", move red left " << ops.move_red_left << ", move red right "
+      << ops.move_red_right << "\n";
+  return out;
+}
+
+#endif  // LLRB_STATS_H_
@@ -0,0 +1,532 @@
+// Checks LLRB_map and LLRB_multimap against std::map under random inserts
+// and removes, many of them of keys the tree does not hold, and checks every
+// red-black invariant of the trees as they change. Checks the shape
+// BulkLoad builds for every size up to a bound, and split, join and the set
+// operations against the same done on std::map, CompactLLRB_map under
+// random inserts and removes, and the ordered walks of ShardedLLRB_map,
+// which merge its shards. Prints every failed check and exits with 1 if
+// there are any.
+//
+// Usage: llrb_tester
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "compact_llrb_map.h"
+#include "llrb_map.h"
+#include "llrb_multimap.h"
+#include "node_pool.h"
+#include "sharded_llrb_map.h"
+
+namespace {
+
+int failures = 0;
+
+void Check(bool ok, const std::string& what) {
+  if (ok) return;
+  std::cerr << "FAILED: " << what << std::endl;
+  failures++;
+}
+
+// Check that @tree has @nodes nodes and keeps every invariant of a left
+// leaning red-black tree, walking all of it
+template <typename Tree>
+void CheckTree(const Tree& tree, std::size_t nodes, const std::string& what) {
+  Check(tree.Stats().nodes == nodes, what + ": node count");
+  Check(tree.Validate(), what + ": invariants");
+}
+
+// Return whether iterating @tree gives the pairs of @expected in order
+template <typename Tree, typename Pairs>
+bool SameContents(const Tree& tree, const Pairs& expected) {
+  auto want = expected.begin();
+  for (auto it = tree.begin(); it != tree.end(); ++it, ++want) {
+    if (want == expected.end() || it->first != want->first ||
+        it->second != want->second)
+      return false;
+  }
+  return want == expected.end();
+}
+
+// Random inserts and removes on maps of keys 0 to a random bound. Removes
+// also pick keys past both ends of the range, and every round ends by
+// removing the keys left in random order
+void CheckMap(int rounds) {
+  std::mt19937 rng(1);
+  for (int round = 0; round < rounds; round++) {
+    int range = 1 + rng() % 2000;
+    LLRB_map<int, int> tree;
+    std::map<int, int> expected;
+    std::string what = "map round " + std::to_string(round);
+
+    tree.Remove(0);
+    Check(tree.Size() == 0, what + ": remove from empty tree");
+    for (int op = 0; op < 5000; op++) {
+      int key = static_cast<int>(rng() % (range + 20)) - 10;
+      if (rng() % 2) {
+        bool threw = false;
+        try {
+          tree.Insert(key, op);
+        } catch (const std::runtime_error&) {
+          threw = true;
+        }
+        Check(threw == (expected.count(key) == 1),
+              what + ": insert of " + std::to_string(key));
+        expected.insert(std::make_pair(key, op));
+      } else {
+        tree.Remove(key);
+        expected.erase(key);
+      }
+      Check(tree.Size() == expected.size(), what + ": size");
+      if (op % 500 == 0) {
+        Check(SameContents(tree, expected), what + ": contents");
+        CheckTree(tree, expected.size(), what);
+      }
+    }
+    Check(SameContents(tree, expected), what + ": contents");
+    CheckTree(tree, expected.size(), what);
+
+    std::vector<int> keys;
+    for (const auto& entry : expected) keys.push_back(entry.first);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (int key : keys) {
+      tree.Remove(key);
+      tree.Remove(key);
+      Check(!tree.Contains(key), what + ": contains removed key");
+    }
+    tree.Remove(range + 5);
+    Check(tree.Size() == 0, what + ": size once emptied");
+    CheckTree(tree, 0, what + " emptied");
+  }
+}
+
+// Same for the multimap: a key may hold several values, and Remove takes
+// the oldest one, unlinking the node once the last one goes
+void CheckMultimap(int rounds) {
+  std::mt19937 rng(2);
+  for (int round = 0; round < rounds; round++) {
+    int range = 1 + rng() % 500;
+    LLRB_multimap<int, int> tree;
+    std::map<int, std::deque<int>> expected;
+    unsigned int values = 0;
+    std::string what = "multimap round " + std::to_string(round);
+
+    for (int op = 0; op < 5000; op++) {
+      int key = static_cast<int>(rng() % (range + 20)) - 10;
+      if (rng() % 2) {
+        tree.Insert(key, op);
+        expected[key].push_back(op);
+        values++;
+      } else {
+        tree.Remove(key);
+        auto found = expected.find(key);
+        if (found != expected.end()) {
+          found->second.pop_front();
+          if (found->second.empty()) expected.erase(found);
+          values--;
+        }
+      }
+      Check(tree.Size() == values, what + ": size");
+      if (op % 500 == 0) {
+        std::vector<std::pair<int, int>> pairs;
+        for (const auto& entry : expected)
+          for (int value : entry.second)
+            pairs.push_back(std::make_pair(entry.first, value));
+        Check(SameContents(tree, pairs), what + ": contents");
+        CheckTree(tree, expected.size(), what);
+      }
+    }
+
+    for (const auto& entry : expected)
+      for (std::size_t i = 0; i <= entry.second.size(); i++)
+        tree.Remove(entry.first);
+    Check(tree.Size() == 0, what + ": size once emptied");
+    CheckTree(tree, 0, what + " emptied");
+  }
+}
+
+// Insert values of a key that are copies of values it already holds, so
+// the argument refers into the list that grows to take it
+void CheckMultimapSelfInsert() {
+  LLRB_multimap<int, std::string> tree;
+  std::vector<std::string> expected;
+  tree.Insert(1, std::string(40, 'a'));
+  expected.push_back(std::string(40, 'a'));
+  for (int i = 0; i < 40; i++) {
+    if (i % 2 == 0) {
+      tree.Insert(1, tree.Get(1));
+      expected.push_back(expected.front());
+    } else {
+      // The newest value, the last one the list would move
+      const std::string *newest = nullptr;
+      for (auto it = tree.begin(); it != tree.end(); ++it)
+        newest = &it->second;
+      tree.Emplace(1, *newest + "b");
+      expected.push_back(expected.back() + "b");
+    }
+  }
+  std::vector<std::pair<int, std::string>> pairs;
+  for (const std::string& value : expected)
+    pairs.push_back(std::make_pair(1, value));
+  Check(tree.Size() == expected.size() && SameContents(tree, pairs),
+        "multimap insert of a value it holds");
+}
+
+// Return largest h with 2^h - 1 <= @n, the black height BulkLoad gives
+int BulkLoadHeight(std::size_t n) {
+  int height = 0;
+  for (std::size_t full = 0; 2 * full + 1 <= n; full = 2 * full + 1)
+    height++;
+  return height;
+}
+
+// BulkLoad of keys 0 to n - 1 for every n up to @max_keys, then removes
+// and inserts on the loaded tree to see that it is a valid one to change
+void CheckBulkLoad(int max_keys) {
+  std::mt19937 rng(3);
+  std::vector<std::pair<int, int>> sorted;
+  for (int n = 0; n <= max_keys; n++) {
+    std::string what = "BulkLoad of " + std::to_string(n) + " keys";
+    LLRB_map<int, int> tree;
+    tree.Insert(-1, -1);
+    tree.BulkLoad(sorted.begin(), sorted.end());
+    std::map<int, int> expected(sorted.begin(), sorted.end());
+    Check(tree.Size() == expected.size(), what + ": size");
+    Check(SameContents(tree, expected), what + ": contents");
+    CheckTree(tree, n, what);
+    LLRBStats stats = tree.Stats();
+    Check(stats.black_height == BulkLoadHeight(n), what + ": black height");
+
+    for (int i = 0; i < 4 && n > 0; i++) {
+      int key = rng() % n;
+      tree.Remove(key);
+      expected.erase(key);
+    }
+    for (int i = 0; i < 4; i++) {
+      int key = n + i;
+      tree.Insert(key, key);
+      expected.insert(std::make_pair(key, key));
+    }
+    Check(SameContents(tree, expected), what + ": contents once changed");
+    CheckTree(tree, expected.size(), what + " once changed");
+
+    sorted.push_back(std::make_pair(n, n));
+  }
+
+  // Unsorted input or a repeated key is refused, leaving the tree alone
+  LLRB_map<int, int> tree;
+  tree.Insert(7, 7);
+  std::vector<std::pair<int, int>> repeated = {{1, 1}, {2, 2}, {2, 3}};
+  for (int attempt = 0; attempt < 2; attempt++) {
+    bool threw = false;
+    try {
+      if (attempt == 0) {
+        tree.BulkLoad(repeated.begin(), repeated.end());
+      } else {
+        tree.BulkLoad(repeated.rbegin(), repeated.rend());
+      }
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    Check(threw, "BulkLoad of unsorted input throws");
+    Check(tree.Size() == 1 && tree.Contains(7),
+          "BulkLoad of unsorted input leaves the tree alone");
+  }
+}
+
+// BulkLoadUnsorted of shuffled keys with repeats, on 1 to 4 threads, and
+// multimap BulkLoad, which keeps every value of a key in order
+void CheckBulkLoadUnsorted(int rounds) {
+  std::mt19937 rng(4);
+  for (int round = 0; round < rounds; round++) {
+    std::string what = "BulkLoadUnsorted round " + std::to_string(round);
+    int n = rng() % 5000;
+    std::vector<std::pair<int, int>> entries;
+    std::map<int, int> expected;
+    for (int i = 0; i < n; i++) {
+      int key = rng() % (n / 2 + 1);
+      entries.push_back(std::make_pair(key, i));
+      expected[key] = i;
+    }
+    LLRB_map<int, int> tree;
+    tree.BulkLoadUnsorted(entries, 1 + round % 4);
+    Check(tree.Size() == expected.size(), what + ": size");
+    Check(SameContents(tree, expected), what + ": last value wins");
+    CheckTree(tree, expected.size(), what);
+    LLRBStats stats = tree.Stats();
+    Check(stats.black_height == BulkLoadHeight(expected.size()),
+          what + ": black height");
+
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const std::pair<int, int>& a,
+                        const std::pair<int, int>& b) {
+                       return a.first < b.first;
+                     });
+    LLRB_multimap<int, int> multi;
+    multi.BulkLoad(entries.begin(), entries.end());
+    what = "multimap BulkLoad round " + std::to_string(round);
+    Check(multi.Size() == entries.size(), what + ": size");
+    Check(SameContents(multi, entries), what + ": contents");
+    CheckTree(multi, expected.size(), what);
+    stats = multi.Stats();
+    Check(stats.black_height == BulkLoadHeight(expected.size()),
+          what + ": black height");
+  }
+}
+
+// Fill @tree and @expected with about @n random keys from 0 to @range - 1
+template <typename Map>
+void RandomFill(int n, int range, int value, std::mt19937 *rng, Map *tree,
+                std::map<int, int> *expected) {
+  for (int i = 0; i < n; i++) {
+    int key = (*rng)() % range;
+    if (expected->insert(std::make_pair(key, value + key)).second)
+      tree->Insert(key, value + key);
+  }
+}
+
+// Split at a random key, often one not in the tree or past either end,
+// and join the halves back. Pool maps each have their own pool, so joining
+// them moves the nodes across
+template <typename Map>
+void CheckSplitJoin(const std::string& name, int rounds) {
+  std::mt19937 rng(5);
+  for (int round = 0; round < rounds; round++) {
+    std::string what = name + " split round " + std::to_string(round);
+    int range = 1 + rng() % 4000;
+    Map tree;
+    std::map<int, int> expected;
+    RandomFill(rng() % 3000, range, 0, &rng, &tree, &expected);
+    int key = static_cast<int>(rng() % (range + 20)) - 10;
+    Map greater;
+    greater.Insert(-5, -5);
+    tree.Split(key, &greater);
+    std::map<int, int> less(expected.begin(), expected.lower_bound(key));
+    std::map<int, int> rest(expected.lower_bound(key), expected.end());
+    Check(tree.Size() == less.size() && SameContents(tree, less),
+          what + ": keys less than " + std::to_string(key));
+    Check(greater.Size() == rest.size() && SameContents(greater, rest),
+          what + ": keys not less than " + std::to_string(key));
+    CheckTree(tree, less.size(), what + " less");
+    CheckTree(greater, rest.size(), what + " greater");
+
+    if (!less.empty() && !rest.empty()) {
+      // The halves the wrong way round overlap
+      bool threw = false;
+      try {
+        greater.Join(std::move(tree));
+      } catch (const std::runtime_error&) {
+        threw = true;
+      }
+      Check(threw && tree.Size() == less.size() &&
+            greater.Size() == rest.size(),
+            what + ": join of overlapping keys throws");
+      CheckTree(tree, less.size(), what + " less after failed join");
+      CheckTree(greater, rest.size(), what + " greater after failed join");
+    }
+    tree.Join(std::move(greater));
+    Check(greater.Size() == 0, what + ": joined map is emptied");
+    Check(tree.Size() == expected.size() && SameContents(tree, expected),
+          what + ": join");
+    CheckTree(tree, expected.size(), what + " join");
+  }
+}
+
+// Union, Intersection and Difference of random maps on 1 to 4 threads.
+// Big enough maps fork, so the threaded paths run too
+template <typename Map>
+void CheckSetOperations(const std::string& name, int rounds) {
+  std::mt19937 rng(6);
+  for (int round = 0; round < rounds; round++) {
+    int range = 1 + rng() % 200000;
+    unsigned int num_threads = 1 + round % 4;
+    Map a, b;
+    std::map<int, int> a_keys, b_keys;
+    RandomFill(rng() % 30000, range, 0, &rng, &a, &a_keys);
+    RandomFill(rng() % 30000, range, 1000000, &rng, &b, &b_keys);
+
+    std::map<int, int> expected;
+    std::string what = name + " set operation round " + std::to_string(round);
+    switch (round % 3) {
+      case 0:
+        what += ": union";
+        expected = b_keys;
+        for (const auto& entry : a_keys) {
+          auto found = expected.find(entry.first);
+          if (found == expected.end())
+            expected.insert(entry);
+          else
+            found->second += entry.second;
+        }
+        a.Union(std::move(b), [](int, int x, int y) { return x + y; },
+                num_threads);
+        Check(b.Size() == 0, what + ": other map is emptied");
+        break;
+      case 1:
+        what += ": intersection";
+        for (const auto& entry : a_keys)
+          if (b_keys.count(entry.first)) expected.insert(entry);
+        a.Intersection(b, num_threads);
+        Check(b.Size() == b_keys.size() && SameContents(b, b_keys),
+              what + ": other map is left alone");
+        break;
+      default:
+        what += ": difference";
+        for (const auto& entry : a_keys)
+          if (!b_keys.count(entry.first)) expected.insert(entry);
+        a.Difference(b, num_threads);
+        Check(b.Size() == b_keys.size() && SameContents(b, b_keys),
+              what + ": other map is left alone");
+        break;
+    }
+    Check(a.Size() == expected.size(), what + ": size");
+    Check(SameContents(a, expected), what + ": contents");
+    CheckTree(a, expected.size(), what);
+  }
+}
+
+// Random inserts and removes on CompactLLRB_map against std::map. Values
+// are made by @make_value from a number; std::string values make growing
+// move the nodes one by one rather than copy the array. Some inserts copy
+// the value of another key, which a growing array must read before moving
+template <typename V, typename MakeValue>
+void CheckCompactMap(const std::string& name, int rounds,
+                     MakeValue make_value) {
+  std::mt19937 rng(7);
+  for (int round = 0; round < rounds; round++) {
+    int range = 1 + rng() % 3000;
+    CompactLLRB_map<int, V> tree;
+    std::map<int, V> expected;
+    std::string what = name + " round " + std::to_string(round);
+
+    tree.Remove(0);
+    for (int op = 0; op < 6000; op++) {
+      int key = static_cast<int>(rng() % (range + 20)) - 10;
+      int what_op = rng() % 4;
+      if (what_op < 2) {
+        if (what_op == 1 && !expected.empty() && !expected.count(key)) {
+          auto near = expected.lower_bound(key);
+          if (near == expected.end()) near = expected.begin();
+          tree.Insert(key, tree.Get(near->first));
+          expected.insert(std::make_pair(key, near->second));
+          continue;
+        }
+        V value = make_value(op);
+        bool threw = false;
+        try {
+          tree.Insert(key, value);
+        } catch (const std::runtime_error&) {
+          threw = true;
+        }
+        Check(threw == (expected.count(key) == 1),
+              what + ": insert of " + std::to_string(key));
+        expected.insert(std::make_pair(key, value));
+      } else if (what_op == 2) {
+        tree.Remove(key);
+        expected.erase(key);
+      } else {
+        auto found = expected.find(key);
+        bool contains = tree.Contains(key);
+        Check(contains == (found != expected.end()),
+              what + ": contains " + std::to_string(key));
+        if (contains && found != expected.end())
+          Check(tree.Get(key) == found->second,
+                what + ": get " + std::to_string(key));
+      }
+      Check(tree.Size() == expected.size(), what + ": size");
+      if (op % 1000 == 0)
+        Check(SameContents(tree, expected), what + ": contents");
+    }
+    Check(SameContents(tree, expected), what + ": contents");
+    if (!expected.empty()) {
+      Check(tree.Min() == expected.begin()->first, what + ": min");
+      Check(tree.Max() == expected.rbegin()->first, what + ": max");
+    }
+
+    CompactLLRB_map<int, V> moved(std::move(tree));
+    Check(tree.Size() == 0 && moved.Size() == expected.size() &&
+          SameContents(moved, expected), what + ": move");
+    std::vector<int> keys;
+    for (const auto& entry : expected) keys.push_back(entry.first);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (int key : keys) {
+      moved.Remove(key);
+      moved.Remove(key);
+      Check(!moved.Contains(key), what + ": contains removed key");
+    }
+    Check(moved.Size() == 0 && moved.begin() == moved.end(),
+          what + ": emptied");
+  }
+}
+
+// Walks of ShardedLLRB_map over 1 to 16 shards, whole and over random
+// ranges, must merge the shards into the pairs of std::map in key order
+void CheckShardedWalks(int rounds) {
+  std::mt19937 rng(8);
+  for (int round = 0; round < rounds; round++) {
+    unsigned int num_shards = 1 + round % 16;
+    int range = 1 + rng() % 5000;
+    ShardedLLRB_map<int, int> sharded(num_shards);
+    std::map<int, int> expected;
+    RandomFill(rng() % 4000, range, 0, &rng, &sharded, &expected);
+    for (int i = 0; i < 500; i++) {
+      int key = rng() % range;
+      sharded.Remove(key);
+      expected.erase(key);
+    }
+    std::string what = "sharded round " + std::to_string(round) + ", " +
+                       std::to_string(num_shards) + " shards";
+    Check(sharded.Size() == expected.size(), what + ": size");
+
+    std::vector<std::pair<int, int>> walked;
+    sharded.ForEach([&walked](int key, int value) {
+      walked.push_back(std::make_pair(key, value));
+    });
+    Check(SameContents(walked, expected), what + ": walk");
+
+    for (int i = 0; i < 20; i++) {
+      int lo = static_cast<int>(rng() % (range + 20)) - 10;
+      int hi = lo + static_cast<int>(rng() % (range / 4 + 2)) - 1;
+      walked.clear();
+      sharded.ForEachInRange(lo, hi, [&walked](int key, int value) {
+        walked.push_back(std::make_pair(key, value));
+      });
+      auto first = expected.lower_bound(lo);
+      auto last = lo <= hi ? expected.upper_bound(hi) : first;
+      Check(SameContents(walked, std::map<int, int>(first, last)),
+            what + ": walk from " + std::to_string(lo) + " to " +
+                std::to_string(hi));
+    }
+  }
+}
+
+}  // namespace
+
+int main() {
+  CheckMap(200);
+  CheckMultimap(100);
+  CheckMultimapSelfInsert();
+  CheckBulkLoad(3000);
+  CheckBulkLoadUnsorted(40);
+  CheckSplitJoin<LLRB_map<int, int>>("map", 400);
+  CheckSplitJoin<LLRB_map<int, int, PoolAllocator<int>>>("pool map", 100);
+  CheckSetOperations<LLRB_map<int, int>>("map", 60);
+  CheckSetOperations<LLRB_map<int, int, PoolAllocator<int>>>("pool map", 24);
+  CheckCompactMap<int>("compact map", 100, [](int n) { return n; });
+  CheckCompactMap<std::string>("compact map of strings", 40, [](int n) {
+    return std::string(24, 'x') + std::to_string(n);
+  });
+  CheckShardedWalks(48);
+  if (failures > 0) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "llrb_tester: all checks passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,162 @@
+#ifndef NODE_POOL_H_
+#define NODE_POOL_H_
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Slabs and free list for blocks of one size
+class NodePoolArena {
+ public:
+  NodePoolArena(std::size_t block_size, std::size_t slab_bytes)
+      : block_size(block_size),
+        blocks_per_slab(slab_bytes / block_size ? slab_bytes / block_size : 1),
+        free_list(nullptr),
+        next(nullptr),
+        end(nullptr) {}
+  ~NodePoolArena() { Release(); }
+  NodePoolArena(const NodePoolArena&) = delete;
+  NodePoolArena& operator=(const NodePoolArena&) = delete;
+
+  void* Allocate() {
+    // Recycle a freed block first, then carve from the current slab
+    if (free_list) {
+      FreeBlock* block = free_list;
+      free_list = block->next;
+      return block;
+    }
+    if (next == end) {
+      slabs.push_back(
+        static_cast<char*>(::operator new(blocks_per_slab * block_size)));
+      next = slabs.back();
+      end = next + blocks_per_slab * block_size;
+    }
+    void* block = next;
+    next += block_size;
+    return block;
+  }
+  void Deallocate(void* p) {
+    FreeBlock* block = static_cast<FreeBlock*>(p);
+    block->next = free_list;
+    free_list = block;
+  }
+  // Free every slab at once, whatever is still allocated from them
+  void Release() {
+    for (char* slab : slabs) ::operator delete(slab);
+    slabs.clear();
+    free_list = nullptr;
+    next = end = nullptr;
+  }
+
+ private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+  std::size_t block_size;
+  std::size_t blocks_per_slab;
+  std::vector<char*> slabs;
+  FreeBlock* free_list;
+  char* next;
+  char* end;
+};
+
+// Arenas shared by all copies of a PoolAllocator, one per block size
+class NodePoolGroup {
+ public:
+  explicit NodePoolGroup(std::size_t slab_bytes) : slab_bytes(slab_bytes) {}
+  NodePoolArena* Get(std::size_t block_size) {
+    std::unique_ptr<NodePoolArena>& arena = arenas[block_size];
+    if (!arena) arena.reset(new NodePoolArena(block_size, slab_bytes));
+    return arena.get();
+  }
+
+ private:
+  std::size_t slab_bytes;
+  std::map<std::size_t, std::unique_ptr<NodePoolArena>> arenas;
+};
+
+// Slab allocator for tree nodes. Single objects are carved out of large slabs
+// and recycled through a free list, so inserting and removing keys does not
+// go through malloc. Slabs are only returned all at once, when the last copy
+// of the allocator goes away or through TryReleaseAll. Copies and rebound
+// copies of an allocator share one pool; a pool is not thread-safe.
+template <typename T, std::size_t SlabBytes = 64 * 1024>
+class PoolAllocator {
+ public:
+  typedef T value_type;
+  template <typename U> struct rebind {
+    typedef PoolAllocator<U, SlabBytes> other;
+  };
+
+  PoolAllocator()
+      : group(new NodePoolGroup(SlabBytes)), arena(group->Get(BlockSize())) {}
+  // Copying shares the pool. There is no move, so a moved-from allocator
+  // still owns its pool
+  PoolAllocator(const PoolAllocator& other) = default;
+  PoolAllocator& operator=(const PoolAllocator& other) = default;
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U, SlabBytes>& other)  // NOLINT
+      : group(other.group), arena(group->Get(BlockSize())) {}
+
+  // Return storage for @n objects. Only single objects come from the pool
+  T* allocate(std::size_t n) {
+    if (n != 1)
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    return static_cast<T*>(arena->Allocate());
+  }
+  // Give back storage from allocate
+  void deallocate(T* p, std::size_t n) {
+    if (n != 1)
+      ::operator delete(p);
+    else
+      arena->Deallocate(p);
+  }
+
+  // Free every slab of this object size at once, if no other allocator
+  // shares the pool. Objects still in it must not need destruction
+  bool TryReleaseAll() {
+    if (group.use_count() != 1) return false;
+    arena->Release();
+    return true;
+  }
+
+  template <typename U>
+  bool operator==(const PoolAllocator<U, SlabBytes>& other) const {
+    return group == other.group;
+  }
+  template <typename U>
+  bool operator!=(const PoolAllocator<U, SlabBytes>& other) const {
+    return group != other.group;
+  }
+
+ private:
+  template <typename U, std::size_t S> friend class PoolAllocator;
+
+  // Blocks hold either a T or a free list link, and keep T aligned
+  static std::size_t BlockSize() {
+    std::size_t size = sizeof(T) > sizeof(void*) ? sizeof(T) : sizeof(void*);
+    std::size_t align = alignof(T) > alignof(void*) ? alignof(T)
+                                                    : alignof(void*);
+    return (size + align - 1) / align * align;
+  }
+
+  std::shared_ptr<NodePoolGroup> group;
+  NodePoolArena* arena;
+};
+
+// Free every node of @alloc in bulk when it supports it. Containers call this
+// on Clear before falling back to freeing nodes one at a time
+template <typename Alloc>
+bool TryReleaseAll(Alloc&) {
+  return false;
+}
+
+template <typename T, std::size_t SlabBytes>
+bool TryReleaseAll(PoolAllocator<T, SlabBytes>& alloc) {
+  return alloc.TryReleaseAll();
+}
+
+#endif  // NODE_POOL_H_
@@ -0,0 +1,56 @@
+#ifndef PARALLEL_SORT_H_
+#define PARALLEL_SORT_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+// Stable sort of [@first, @last) on up to @num_threads threads, 0 meaning
+// one per hardware thread. Chunks are sorted side by side, then merged in
+// pairs, each round of merges again running in parallel
+template <typename It, typename Compare>
+void ParallelStableSort(It first, It last, Compare less,
+                        unsigned int num_threads = 0) {
+  // Below this many elements per chunk a thread costs more than it saves
+  const std::size_t kMinChunk = 1 << 14;
+
+  std::size_t size = std::distance(first, last);
+  if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+  std::size_t num_chunks = num_threads ? num_threads : 1;
+  if (num_chunks > size / kMinChunk) num_chunks = size / kMinChunk;
+  if (num_chunks < 2) {
+    std::stable_sort(first, last, less);
+    return;
+  }
+
+  // Chunk i is [bounds[i], bounds[i + 1])
+  std::vector<It> bounds;
+  for (std::size_t i = 0; i < num_chunks; i++)
+    bounds.push_back(first + size * i / num_chunks);
+  bounds.push_back(last);
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < num_chunks; i++)
+    threads.emplace_back([&bounds, &less, i]() {
+      std::stable_sort(bounds[i], bounds[i + 1], less);
+    });
+  for (std::thread &t : threads) t.join();
+
+  // Merge neighbouring runs until one is left
+  for (std::size_t width = 1; width < num_chunks; width *= 2) {
+    threads.clear();
+    for (std::size_t i = 0; i + width < num_chunks; i += 2 * width) {
+      It lo = bounds[i];
+      It mid = bounds[i + width];
+      It hi = bounds[std::min(i + 2 * width, num_chunks)];
+      threads.emplace_back([lo, mid, hi, &less]() {
+        std::inplace_merge(lo, mid, hi, less);
+      });
+    }
+    for (std::thread &t : threads) t.join();
+  }
+}
+
+#endif  // PARALLEL_SORT_H_
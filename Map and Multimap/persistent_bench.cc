@@ -0,0 +1,176 @@
+// Measures lookup throughput of reader threads while one writer inserts and
+// removes as fast as it can, on PersistentLLRB_map read through snapshots
+// and on one LLRB_map behind a mutex.
+//
+// Usage: persistent_bench [num_keys] [lookups_per_reader] [max_readers]
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "llrb_map.h"
+#include "persistent_llrb_map.h"
+
+namespace {
+
+// Readers take a fresh snapshot after this many lookups
+const unsigned int kLookupsPerSnapshot = 100;
+
+// The baseline: readers and the writer share one lock
+class MutexLLRB_map {
+ public:
+  int Get(int key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return map.Get(key);
+  }
+  void Insert(int key, int value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    map.Insert(key, value);
+  }
+  void Remove(int key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    map.Remove(key);
+  }
+
+ private:
+  std::mutex mutex;
+  LLRB_map<int, int> map;
+};
+
+// Lookups go to the snapshot, which readers renew every few lookups
+class SnapshotReader {
+ public:
+  explicit SnapshotReader(PersistentLLRB_map<int, int> *map) : map(map) {}
+  int Get(int key) {
+    if (lookups++ % kLookupsPerSnapshot == 0)
+      snapshot = map->TakeSnapshot();
+    return snapshot.Get(key);
+  }
+
+ private:
+  PersistentLLRB_map<int, int> *map;
+  PersistentLLRB_map<int, int>::Snapshot snapshot;
+  unsigned int lookups = 0;
+};
+
+class MutexReader {
+ public:
+  explicit MutexReader(MutexLLRB_map *map) : map(map) {}
+  int Get(int key) { return map->Get(key); }
+
+ private:
+  MutexLLRB_map *map;
+};
+
+struct Result {
+  // Millions of lookups per second over all readers
+  double read_mops;
+  // Thousands of writes per second
+  double write_kops;
+};
+
+// Fill @map with the even keys in [0, @num_keys), which readers look up and
+// the writer never touches
+template <typename Map>
+void Fill(Map *map, unsigned int num_keys) {
+  for (unsigned int key = 0; key < num_keys; key += 2) map->Insert(key, key);
+}
+
+// Run @num_readers threads of @lookups_per_reader lookups of even keys while
+// one writer flips odd keys in and out of @map until the readers are done
+template <typename Reader, typename Map>
+Result ReadWhileWrite(Map *map, unsigned int num_keys,
+                      unsigned int lookups_per_reader,
+                      unsigned int num_readers) {
+  std::atomic<bool> done(false);
+  std::atomic<long long> checksum(0);
+  long long writes = 0;
+
+  std::thread writer([&]() {
+    std::mt19937 rng(0);
+    std::vector<bool> present(num_keys / 2);
+    while (!done.load(std::memory_order_relaxed)) {
+      unsigned int slot = rng() % present.size();
+      int key = 2 * slot + 1;
+      if (present[slot])
+        map->Remove(key);
+      else
+        map->Insert(key, key);
+      present[slot] = !present[slot];
+      writes++;
+    }
+  });
+
+  auto read = [&](unsigned int seed) {
+    std::mt19937 rng(seed);
+    Reader reader(map);
+    long long sum = 0;
+    for (unsigned int i = 0; i < lookups_per_reader; i++)
+      sum += reader.Get(2 * (rng() % (num_keys / 2)));
+    checksum += sum;
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> readers;
+  for (unsigned int t = 0; t < num_readers; t++)
+    readers.emplace_back(read, t + 1);
+  for (std::thread &reader : readers) reader.join();
+  auto stop = std::chrono::steady_clock::now();
+  done = true;
+  writer.join();
+
+  double seconds = std::chrono::duration<double>(stop - start).count();
+  return Result{
+      lookups_per_reader * static_cast<double>(num_readers) / seconds / 1e6,
+      writes / seconds / 1e3};
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  unsigned int num_keys = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  unsigned int lookups_per_reader = argc > 2 ? std::atoi(argv[2]) : 1000000;
+  unsigned int max_readers = argc > 3 ? std::atoi(argv[3])
+                                      : std::thread::hardware_concurrency();
+  if (num_keys < 2 || lookups_per_reader == 0) {
+    std::cerr << "Usage: " << argv[0]
+              << " [num_keys] [lookups_per_reader] [max_readers]"
+              << std::endl;
+    return 1;
+  }
+  if (max_readers == 0) max_readers = 1;
+
+  std::cout << num_keys << " keys, " << std::thread::hardware_concurrency()
+            << " hardware threads, one writer" << std::endl;
+  std::cout << "Mops/s of reads and Kops/s of writes" << std::endl;
+  std::cout << std::setw(8) << "readers" << std::setw(12) << "mutex rd"
+            << std::setw(12) << "mutex wr" << std::setw(12) << "persist rd"
+            << std::setw(12) << "persist wr" << std::endl;
+
+  // Powers of two, then max_readers itself
+  std::vector<unsigned int> reader_counts;
+  for (unsigned int readers = 1; readers < max_readers; readers *= 2)
+    reader_counts.push_back(readers);
+  reader_counts.push_back(max_readers);
+
+  for (unsigned int readers : reader_counts) {
+    MutexLLRB_map single;
+    PersistentLLRB_map<int, int> persistent;
+    Fill(&single, num_keys);
+    Fill(&persistent, num_keys);
+    Result locked = ReadWhileWrite<MutexReader>(&single, num_keys,
+                                                lookups_per_reader, readers);
+    Result shared = ReadWhileWrite<SnapshotReader>(
+        &persistent, num_keys, lookups_per_reader, readers);
+    std::cout << std::setw(8) << readers << std::fixed << std::setprecision(2)
+              << std::setw(12) << locked.read_mops << std::setw(12)
+              << locked.write_kops << std::setw(12) << shared.read_mops
+              << std::setw(12) << shared.write_kops << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,499 @@
+#ifndef PERSISTENT_LLRB_MAP_H_
+#define PERSISTENT_LLRB_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include "llrb_iterator.h"
+
+// Left-leaning red-black tree map with persistent snapshots. Insert and
+// Remove never change a node that a snapshot can see: they copy the nodes on
+// their path, and the few siblings they recolor, and share everything else
+// with the previous version. Nodes are reference counted, so a version is
+// freed once the map and every snapshot of it let go.
+//
+// Writers are serialized by a mutex. TakeSnapshot is O(1) and can be called
+// from any thread while writes go on; a snapshot is immutable and is read
+// without locks
+template <typename K, typename V>
+class PersistentLLRB_map {
+ private:
+  struct Node;
+  struct State;
+
+ public:
+  class Snapshot;
+
+  PersistentLLRB_map();
+  PersistentLLRB_map(const PersistentLLRB_map&) = delete;
+  PersistentLLRB_map& operator=(const PersistentLLRB_map&) = delete;
+
+  // Return size of latest version
+  unsigned int Size();
+  // Insert @key in tree. Throws std::runtime_error if it is already there
+  void Insert(const K &key, const V &value);
+  // Remove @key from tree
+  void Remove(const K &key);
+  // Remove every key from tree
+  void Clear();
+  // Return read-only view of the latest version. It stays valid, and
+  // unchanged, however the map changes afterwards
+  Snapshot TakeSnapshot() const;
+
+ private:
+  enum Color { RED, BLACK };
+  typedef std::shared_ptr<Node> NodePtr;
+  struct Node {
+    K key;
+    V value;
+    bool color;
+    NodePtr left;
+    NodePtr right;
+    // Write that created this copy of the node
+    uint64_t version;
+  };
+  // What a snapshot holds: a root and the size that goes with it
+  struct State {
+    NodePtr root;
+    unsigned int size;
+  };
+
+  // Insert and Remove keep the links they pass on a fixed stack; see
+  // LLRB_map for the bound
+  static const int kMaxDepth = 96;
+
+  // Writer side, guarded by write_mutex
+  std::mutex write_mutex;
+  NodePtr root;
+  unsigned int cur_size = 0;
+  uint64_t version = 0;
+  // Latest version, swapped atomically for readers
+  std::shared_ptr<const State> published;
+
+  // Make the latest write visible to TakeSnapshot
+  void Publish();
+
+  // Replace @n by a private copy unless this write already copied it
+  void Own(NodePtr &n);
+
+  // Helper methods for the self-balancing. All of them copy the nodes they
+  // change first
+  static bool IsRed(const NodePtr &n);
+  void FlipColors(NodePtr &n);
+  void RotateRight(NodePtr &prt);
+  void RotateLeft(NodePtr &prt);
+  void FixUp(NodePtr &n);
+  void MoveRedRight(NodePtr &n);
+  void MoveRedLeft(NodePtr &n);
+};
+
+// Immutable version of a PersistentLLRB_map. Copying a snapshot is cheap;
+// references and iterators it hands out live as long as the snapshot does
+template <typename K, typename V>
+class PersistentLLRB_map<K, V>::Snapshot {
+ public:
+  class const_iterator;
+  typedef const_iterator iterator;
+
+  Snapshot() {}
+
+  // Return size of tree
+  unsigned int Size() const { return state ? state->size : 0; }
+  // Return whether @key is found in tree
+  bool Contains(const K &key) const { return Find(key) != nullptr; }
+  // Get value given key
+  const V& Get(const K &key) const;
+  // Return max key in tree
+  const K& Max() const;
+  // Return min key in tree
+  const K& Min() const;
+
+  // Iterators visit <key, value> pairs in key order
+  const_iterator begin() const;
+  const_iterator end() const;
+  // Return iterator to the first key not less than @key
+  const_iterator LowerBound(const K &key) const;
+  // Return iterator to the first key greater than @key
+  const_iterator UpperBound(const K &key) const;
+  // Return pairs with keys from @lo to @hi, both included
+  LLRBRange<const_iterator> Range(const K &lo, const K &hi) const;
+
+ private:
+  friend class PersistentLLRB_map;
+  explicit Snapshot(const std::shared_ptr<const State> &state)
+      : state(state) {}
+
+  const Node* Root() const { return state ? state->root.get() : nullptr; }
+  const Node* Find(const K &key) const;
+
+  std::shared_ptr<const State> state;
+};
+
+template <typename K, typename V>
+class PersistentLLRB_map<K, V>::Snapshot::const_iterator {
+ public:
+  typedef std::bidirectional_iterator_tag iterator_category;
+  typedef std::pair<K, V> value_type;
+  typedef std::ptrdiff_t difference_type;
+  typedef std::pair<const K&, const V&> reference;
+  typedef LLRBArrowProxy<reference> pointer;
+
+  const_iterator() : root(nullptr) {}
+
+  reference operator*() const {
+    const Node *n = path.Current();
+    return reference(n->key, n->value);
+  }
+  pointer operator->() const { return pointer(**this); }
+
+  const_iterator& operator++() {
+    path.Next();
+    return *this;
+  }
+  const_iterator operator++(int) {
+    const_iterator old(*this);
+    path.Next();
+    return old;
+  }
+  const_iterator& operator--() {
+    // Stepping back from end lands on the max key
+    if (path.Current())
+      path.Prev();
+    else
+      path.PushMax(root);
+    return *this;
+  }
+  const_iterator operator--(int) {
+    const_iterator old(*this);
+    --*this;
+    return old;
+  }
+
+  bool operator==(const const_iterator &other) const {
+    return path.Current() == other.path.Current();
+  }
+  bool operator!=(const const_iterator &other) const {
+    return path.Current() != other.path.Current();
+  }
+
+ private:
+  friend class Snapshot;
+  explicit const_iterator(const Node *root) : root(root) {}
+
+  const Node *root;
+  LLRBPath<const Node> path;
+};
+
+template <typename K, typename V>
+PersistentLLRB_map<K, V>::PersistentLLRB_map() {
+  Publish();
+}
+
+template <typename K, typename V>
+unsigned int PersistentLLRB_map<K, V>::Size() {
+  std::lock_guard<std::mutex> lock(write_mutex);
+  return cur_size;
+}
+
+template <typename K, typename V>
+typename PersistentLLRB_map<K, V>::Snapshot
+PersistentLLRB_map<K, V>::TakeSnapshot() const {
+  return Snapshot(std::atomic_load(&published));
+}
+
+template <typename K, typename V>
+void PersistentLLRB_map<K, V>::Publish() {
+  std::shared_ptr<const State> state(new State{root, cur_size});
+  std::atomic_store(&published, state);
+}
+
+template <typename K, typename V>
+void PersistentLLRB_map<K, V>::Own(NodePtr &n) {
+  if (n->version != version) {
+    n = std::make_shared<Node>(*n);
+    n->version = version;
+  }
+}
+
+template <typename K, typename V>
+void PersistentLLRB_map<K, V>::Clear() {
+  std::lock_guard<std::mutex> lock(write_mutex);
+  root.reset();
+  cur_size = 0;
+  Publish();
+}
+
+template <typename K, typename V>
+void PersistentLLRB_map<K, V>::Insert(const K &key, const V &value) {
+  std::lock_guard<std::mutex> lock(write_mutex);
+  version++;
+  // Nodes copied below are private until Publish, so a failed insert only
+  // needs to go back to the old root
+  NodePtr old_root = root;
+
+  // Links from the root down to the new node, fixed up on the way back
+  NodePtr *path[kMaxDepth];
+  int depth = 0;
+  NodePtr *link = &root;
+
+  while (*link) {
+    if (key == (*link)->key) {
+      root = old_root;
+      throw std::runtime_error("Key already inserted");
+    }
+    Own(*link);
+    path[depth++] = link;
+    if (key < (*link)->key)
+      link = &(*link)->left;
+    else
+      link = &(*link)->right;
+  }
+  *link = std::make_shared<Node>(
+    Node{key, value, RED, nullptr, nullptr, version});
+
+  while (depth > 0)
+    FixUp(*path[--depth]);
+  if (IsRed(root))
+    root->color = BLACK;
+  cur_size++;
+  Publish();
+}
+
+template <typename K, typename V>
+void PersistentLLRB_map<K, V>::Remove(const K &key) {
+  std::lock_guard<std::mutex> lock(write_mutex);
+  version++;
+  NodePtr old_root = root;
+
+  // Links from the root down to the current node, fixed up on the way back
+  NodePtr *path[kMaxDepth];
+  int depth = 0;
+  NodePtr *link = &root;
+  bool removed = false;
+
+  while (*link) {
+    Own(*link);
+    path[depth++] = link;
+    if (key < (*link)->key) {
+      // Key not found
+      if (!(*link)->left) break;
+      if (!IsRed((*link)->left) && !IsRed((*link)->left->left))
+        MoveRedLeft(*link);
+      link = &(*link)->left;
+      continue;
+    }
+
+    if (IsRed((*link)->left))
+      RotateRight(*link);
+
+    Node *n = link->get();
+    if (key == n->key && !n->right) {
+      // Remove n, nothing is left below it to fix
+      depth--;
+      link->reset();
+      removed = true;
+      break;
+    }
+
+    // Key not found
+    if (!n->right) break;
+
+    if (!IsRed(n->right) && !IsRed(n->right->left))
+      MoveRedRight(*link);
+
+    n = link->get();
+    if (key == n->key) {
+      // Walk down to the min node of the right subtree, moving a red link
+      // down the left side as the descent goes
+      link = &n->right;
+      while ((*link)->left) {
+        Own(*link);
+        path[depth++] = link;
+        if (!IsRed((*link)->left) && !IsRed((*link)->left->left))
+          MoveRedLeft(*link);
+        link = &(*link)->left;
+      }
+      // Copy content from min node, then remove it
+      n->key = (*link)->key;
+      n->value = (*link)->value;
+      link->reset();
+      removed = true;
+      break;
+    }
+    link = &n->right;
+  }
+
+  // Nothing removed: drop the copies, the published version is still right
+  if (!removed) {
+    root = old_root;
+    return;
+  }
+
+  while (depth > 0)
+    FixUp(*path[--depth]);
+  if (IsRed(root))
+    root->color = BLACK;
+  cur_size--;
+  Publish();
+}
+
+template <typename K, typename V>
+bool PersistentLLRB_map<K, V>::IsRed(const NodePtr &n) {
+  if (!n) return false;
+  return (n->color == RED);
+}
+
+template <typename K, typename V>
+void PersistentLLRB_map<K, V>::FlipColors(NodePtr &n) {
+  Own(n);
+  Own(n->left);
+  Own(n->right);
+  n->color = !n->color;
+  n->left->color = !n->left->color;
+  n->right->color = !n->right->color;
+}
+
+template <typename K, typename V>
+void PersistentLLRB_map<K, V>::RotateRight(NodePtr &prt) {
+  Own(prt);
+  Own(prt->left);
+  NodePtr chd = std::move(prt->left);
+  prt->left = std::move(chd->right);
+  chd->color = prt->color;
+  prt->color = RED;
+  chd->right = std::move(prt);
+  prt = std::move(chd);
+}
+
+template <typename K, typename V>
+void PersistentLLRB_map<K, V>::RotateLeft(NodePtr &prt) {
+  Own(prt);
+  Own(prt->right);
+  NodePtr chd = std::move(prt->right);
+  prt->right = std::move(chd->left);
+  chd->color = prt->color;
+  prt->color = RED;
+  chd->left = std::move(prt);
+  prt = std::move(chd);
+}
+
+template <typename K, typename V>
+void PersistentLLRB_map<K, V>::FixUp(NodePtr &n) {
+  // Rotate left if there is a right-leaning red node
+  if (IsRed(n->right) && !IsRed(n->left))
+    RotateLeft(n);
+  // Rotate right if red-red pair of nodes on left
+  if (IsRed(n->left) && IsRed(n->left->left))
+    RotateRight(n);
+  // Recoloring if both children are red
+  if (IsRed(n->left) && IsRed(n->right))
+    FlipColors(n);
+}
+
+template <typename K, typename V>
+void PersistentLLRB_map<K, V>::MoveRedRight(NodePtr &n) {
+  FlipColors(n);
+  if (IsRed(n->left->left)) {
+    RotateRight(n);
+    FlipColors(n);
+  }
+}
+
+template <typename K, typename V>
+void PersistentLLRB_map<K, V>::MoveRedLeft(NodePtr &n) {
+  FlipColors(n);
+  if (IsRed(n->right->left)) {
+    RotateRight(n->right);
+    RotateLeft(n);
+    FlipColors(n);
+  }
+}
+
+template <typename K, typename V>
+const typename PersistentLLRB_map<K, V>::Node*
+PersistentLLRB_map<K, V>::Snapshot::Find(const K &key) const {
+  const Node *n = Root();
+  while (n) {
+    if (key == n->key)
+      return n;
+
+    if (key < n->key)
+      n = n->left.get();
+    else
+      n = n->right.get();
+  }
+  return nullptr;
+}
+
+template <typename K, typename V>
+const V& PersistentLLRB_map<K, V>::Snapshot::Get(const K &key) const {
+  const Node *n = Find(key);
+  if (!n) {
+    throw std::runtime_error("Error: Key not in map");
+  }
+  return n->value;
+}
+
+template <typename K, typename V>
+const K& PersistentLLRB_map<K, V>::Snapshot::Max() const {
+  const Node *n = Root();
+  if (!n) {
+    throw std::runtime_error("Error: Map is empty");
+  }
+  while (n->right) n = n->right.get();
+  return n->key;
+}
+
+template <typename K, typename V>
+const K& PersistentLLRB_map<K, V>::Snapshot::Min() const {
+  const Node *n = Root();
+  if (!n) {
+    throw std::runtime_error("Error: Map is empty");
+  }
+  while (n->left) n = n->left.get();
+  return n->key;
+}
+
+template <typename K, typename V>
+typename PersistentLLRB_map<K, V>::Snapshot::const_iterator
+PersistentLLRB_map<K, V>::Snapshot::begin() const {
+  const_iterator it(Root());
+  it.path.PushMin(Root());
+  return it;
+}
+
+template <typename K, typename V>
+typename PersistentLLRB_map<K, V>::Snapshot::const_iterator
+PersistentLLRB_map<K, V>::Snapshot::end() const {
+  return const_iterator(Root());
+}
+
+template <typename K, typename V>
+typename PersistentLLRB_map<K, V>::Snapshot::const_iterator
+PersistentLLRB_map<K, V>::Snapshot::LowerBound(const K &key) const {
+  const_iterator it(Root());
+  it.path.Seek(Root(), key, false);
+  return it;
+}
+
+template <typename K, typename V>
+typename PersistentLLRB_map<K, V>::Snapshot::const_iterator
+PersistentLLRB_map<K, V>::Snapshot::UpperBound(const K &key) const {
+  const_iterator it(Root());
+  it.path.Seek(Root(), key, true);
+  return it;
+}
+
+template <typename K, typename V>
+LLRBRange<typename PersistentLLRB_map<K, V>::Snapshot::const_iterator>
+PersistentLLRB_map<K, V>::Snapshot::Range(const K &lo, const K &hi) const {
+  if (hi < lo)
+    return LLRBRange<const_iterator>(end(), end());
+  return LLRBRange<const_iterator>(LowerBound(lo), UpperBound(hi));
+}
+
+#endif  // PERSISTENT_LLRB_MAP_H_
@@ -0,0 +1,223 @@
+// Checks PersistentLLRB_map against std::map under random inserts and
+// removes: every snapshot taken along the way must still hold, after all the
+// writes that follow it, the contents the map had when it was taken. Also
+// runs reader threads over fresh snapshots while a writer changes the map;
+// build with -fsanitize=thread to check the sharing. Prints every failed
+// check and exits with 1 if there are any.
+//
+// Usage: persistent_llrb_tester
+
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "persistent_llrb_map.h"
+
+namespace {
+
+typedef PersistentLLRB_map<int, std::string> Map;
+
+int failures = 0;
+
+void Check(bool ok, const std::string& what) {
+  if (ok) return;
+  std::cerr << "FAILED: " << what << std::endl;
+  failures++;
+}
+
+// Return whether the pairs in [@first, @last) are those of [@want, @stop)
+template <typename It, typename WantIt>
+bool SamePairs(It first, It last, WantIt want, WantIt stop) {
+  for (; first != last; ++first, ++want) {
+    if (want == stop || first->first != want->first ||
+        first->second != want->second)
+      return false;
+  }
+  return want == stop;
+}
+
+// Compare @snapshot with @expected: size, lookups of keys in and out of the
+// map, walks forward and back, and ranges
+void CheckSnapshot(const Map::Snapshot& snapshot,
+                   const std::map<int, std::string>& expected, int range,
+                   std::mt19937 *rng, const std::string& what) {
+  Check(snapshot.Size() == expected.size(), what + ": size");
+  Check(SamePairs(snapshot.begin(), snapshot.end(), expected.begin(),
+                  expected.end()), what + ": forward walk");
+
+  bool same = true;
+  auto want = expected.rbegin();
+  for (auto it = snapshot.end(); it != snapshot.begin() && same; ++want) {
+    --it;
+    same = want != expected.rend() && it->first == want->first &&
+           it->second == want->second;
+  }
+  Check(same && want == expected.rend(), what + ": backward walk");
+
+  for (int key = -2; key < range + 2; key++) {
+    auto found = expected.find(key);
+    bool contains = snapshot.Contains(key);
+    Check(contains == (found != expected.end()),
+          what + ": contains " + std::to_string(key));
+    if (found == expected.end()) {
+      bool threw = false;
+      try {
+        snapshot.Get(key);
+      } catch (const std::runtime_error&) {
+        threw = true;
+      }
+      Check(threw, what + ": get of missing " + std::to_string(key));
+    } else if (contains) {
+      Check(snapshot.Get(key) == found->second,
+            what + ": get " + std::to_string(key));
+    }
+  }
+
+  if (expected.empty()) {
+    Check(snapshot.begin() == snapshot.end(), what + ": empty walk");
+    return;
+  }
+  Check(snapshot.Min() == expected.begin()->first, what + ": min");
+  Check(snapshot.Max() == expected.rbegin()->first, what + ": max");
+
+  for (int i = 0; i < 10; i++) {
+    int lo = static_cast<int>((*rng)() % (range + 4)) - 2;
+    int hi = lo + static_cast<int>((*rng)() % (range / 4 + 2)) - 1;
+    auto pairs = snapshot.Range(lo, hi);
+    auto first = expected.lower_bound(lo);
+    auto last = lo <= hi ? expected.upper_bound(hi) : first;
+    Check(SamePairs(pairs.begin(), pairs.end(), first, last),
+          what + ": range " + std::to_string(lo) + " to " +
+              std::to_string(hi));
+  }
+}
+
+// Random inserts and removes, with a snapshot and a std::map copy taken
+// every few writes. Each snapshot is checked when it is taken and again once
+// every later write is done
+void CheckSnapshots(int rounds) {
+  std::mt19937 rng(1);
+  for (int round = 0; round < rounds; round++) {
+    int range = 1 + rng() % 300;
+    Map map;
+    std::map<int, std::string> expected;
+    std::vector<std::pair<Map::Snapshot, std::map<int, std::string>>> taken;
+    std::string what = "round " + std::to_string(round);
+
+    taken.emplace_back(map.TakeSnapshot(), expected);
+    map.Remove(0);
+    for (int op = 0; op < 1500; op++) {
+      int key = static_cast<int>(rng() % (range + 2)) - 1;
+      if (rng() % 2) {
+        std::string value = std::to_string(op);
+        bool threw = false;
+        try {
+          map.Insert(key, value);
+        } catch (const std::runtime_error&) {
+          threw = true;
+        }
+        Check(threw == (expected.count(key) == 1),
+              what + ": insert of " + std::to_string(key));
+        expected.insert(std::make_pair(key, value));
+      } else {
+        map.Remove(key);
+        expected.erase(key);
+      }
+      Check(map.Size() == expected.size(), what + ": map size");
+
+      if (op % 50 == 0) {
+        taken.emplace_back(map.TakeSnapshot(), expected);
+        CheckSnapshot(taken.back().first, expected, range, &rng,
+                      what + " op " + std::to_string(op));
+      }
+    }
+
+    map.Clear();
+    Check(map.Size() == 0 && map.TakeSnapshot().Size() == 0,
+          what + ": clear");
+    for (std::size_t i = 0; i < taken.size(); i++)
+      CheckSnapshot(taken[i].first, taken[i].second, range, &rng,
+                    what + " snapshot " + std::to_string(i) + " later");
+  }
+}
+
+// Readers walk fresh snapshots while one writer inserts and removes. The
+// writer gives key k the value of k and keeps the even keys, so a reader can
+// check every snapshot on its own: keys in order, as many as Size, values
+// that match, and every even key below the bound present
+void CheckConcurrentReaders(unsigned int num_readers, int writes) {
+  const int kKeys = 512;
+  PersistentLLRB_map<int, int> map;
+  for (int key = 0; key < kKeys; key += 2) map.Insert(key, key);
+
+  std::atomic<bool> done(false);
+  std::atomic<int> bad(0);
+  std::atomic<long long> snapshots(0);
+  auto read = [&]() {
+    while (!done.load()) {
+      PersistentLLRB_map<int, int>::Snapshot snapshot = map.TakeSnapshot();
+      unsigned int count = 0;
+      int last = -1;
+      bool ok = true;
+      for (auto it = snapshot.begin(); it != snapshot.end(); ++it) {
+        ok = ok && it->first > last && it->second == it->first;
+        last = it->first;
+        count++;
+      }
+      ok = ok && count == snapshot.Size();
+      for (int key = 0; key < kKeys && ok; key += 2)
+        ok = snapshot.Contains(key) && snapshot.Get(key) == key;
+      auto odd = snapshot.Range(1, kKeys / 2);
+      for (auto it = odd.begin(); it != odd.end() && ok; ++it)
+        ok = it->first <= kKeys / 2 && it->second == it->first;
+      if (!ok) bad++;
+      snapshots++;
+    }
+  };
+
+  std::vector<std::thread> readers;
+  for (unsigned int i = 0; i < num_readers; i++) readers.emplace_back(read);
+
+  std::mt19937 rng(2);
+  std::map<int, int> expected;
+  for (int key = 0; key < kKeys; key += 2) expected[key] = key;
+  for (int i = 0; i < writes; i++) {
+    int key = 2 * static_cast<int>(rng() % kKeys) + 1;
+    if (expected.count(key)) {
+      map.Remove(key);
+      expected.erase(key);
+    } else {
+      map.Insert(key, key);
+      expected[key] = key;
+    }
+  }
+  done = true;
+  for (std::thread &reader : readers) reader.join();
+
+  std::string what = std::to_string(num_readers) + " readers";
+  Check(bad.load() == 0, what + ": " + std::to_string(bad.load()) +
+                             " torn snapshots");
+  Check(snapshots.load() > 0, what + ": no snapshot read");
+  PersistentLLRB_map<int, int>::Snapshot last = map.TakeSnapshot();
+  Check(SamePairs(last.begin(), last.end(), expected.begin(), expected.end()),
+        what + ": final contents");
+}
+
+}  // namespace
+
+int main() {
+  CheckSnapshots(30);
+  CheckConcurrentReaders(1, 20000);
+  CheckConcurrentReaders(4, 20000);
+  if (failures > 0) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  std::cout << "persistent_llrb_tester: all checks passed" << std::endl;
+  return 0;
+}
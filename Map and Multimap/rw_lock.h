@@ -0,0 +1,52 @@
+#ifndef RW_LOCK_H_
+#define RW_LOCK_H_
+
+#include <pthread.h>
+
+#include <stdexcept>
+
+// Reader-writer lock: any number of readers or a single writer
+class RWLock {
+ public:
+  RWLock() {
+    if (pthread_rwlock_init(&lock, nullptr) != 0)
+      throw std::runtime_error("Error: cannot create lock");
+  }
+  ~RWLock() { pthread_rwlock_destroy(&lock); }
+  RWLock(const RWLock&) = delete;
+  RWLock& operator=(const RWLock&) = delete;
+
+  void LockShared() { pthread_rwlock_rdlock(&lock); }
+  void UnlockShared() { pthread_rwlock_unlock(&lock); }
+  void Lock() { pthread_rwlock_wrlock(&lock); }
+  void Unlock() { pthread_rwlock_unlock(&lock); }
+
+ private:
+  pthread_rwlock_t lock;
+};
+
+// Holds @lock for reading while in scope
+class ReadGuard {
+ public:
+  explicit ReadGuard(RWLock &lock) : lock(lock) { lock.LockShared(); }
+  ~ReadGuard() { lock.UnlockShared(); }
+  ReadGuard(const ReadGuard&) = delete;
+  ReadGuard& operator=(const ReadGuard&) = delete;
+
+ private:
+  RWLock &lock;
+};
+
+// Holds @lock for writing while in scope
+class WriteGuard {
+ public:
+  explicit WriteGuard(RWLock &lock) : lock(lock) { lock.Lock(); }
+  ~WriteGuard() { lock.Unlock(); }
+  WriteGuard(const WriteGuard&) = delete;
+  WriteGuard& operator=(const WriteGuard&) = delete;
+
+ private:
+  RWLock &lock;
+};
+
+#endif  // RW_LOCK_H_
@@ -0,0 +1,130 @@
+// Measures throughput of a mixed Get/Insert/Remove workload as the
+// number of threads grows, on ShardedLLRB_map and on one LLRB_map behind a
+// mutex.
+//
+// Usage: sharded_bench [num_keys] [ops_per_thread] [max_threads] [shards]
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "llrb_map.h"
+#include "sharded_llrb_map.h"
+
+// The baseline: every operation takes one global lock
+class MutexLLRB_map {
+ public:
+  int Get(int key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return map.Get(key);
+  }
+  void Insert(int key, int value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    map.Insert(key, value);
+  }
+  void Remove(int key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    map.Remove(key);
+  }
+
+ private:
+  std::mutex mutex;
+  LLRB_map<int, int> map;
+};
+
+// Run @ops_per_thread operations on each of @num_threads threads over keys
+// in [0, @num_keys): 80% lookups, 10% inserts, 10% removes. Lookups go to
+// even keys, which Fill puts in and writes never touch, so every Get finds
+// its key and copies the value out under the lock; inserts and removes go to
+// odd keys. Return millions of operations per second
+template <typename Map>
+double Throughput(Map *map, unsigned int num_keys, unsigned int ops_per_thread,
+  unsigned int num_threads) {
+  // Readers add up the values they get, so the copies are not optimized out
+  std::atomic<long long> checksum(0);
+  auto work = [=, &checksum](unsigned int seed) {
+    std::mt19937 rng(seed);
+    long long sum = 0;
+    for (unsigned int i = 0; i < ops_per_thread; i++) {
+      int key = 2 * (rng() % (num_keys / 2));
+      unsigned int op = rng() % 10;
+      if (op == 0) {
+        // Another thread may have inserted the key since
+        try {
+          map->Insert(key + 1, key + 1);
+        } catch (std::runtime_error&) {}
+      } else if (op == 1) {
+        map->Remove(key + 1);
+      } else {
+        sum += map->Get(key);
+      }
+    }
+    checksum += sum;
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < num_threads; t++)
+    threads.emplace_back(work, t + 1);
+  for (std::thread &thread : threads) thread.join();
+  auto stop = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(stop - start).count();
+  return ops_per_thread * static_cast<double>(num_threads) / seconds / 1e6;
+}
+
+// Fill @map with the even keys. Odd keys start out missing, so inserts and
+// removes of them both take effect about half the time
+template <typename Map>
+void Fill(Map *map, unsigned int num_keys) {
+  for (unsigned int key = 0; key < num_keys; key += 2) map->Insert(key, key);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int num_keys = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  unsigned int ops_per_thread = argc > 2 ? std::atoi(argv[2]) : 1000000;
+  unsigned int max_threads = argc > 3 ? std::atoi(argv[3])
+                                      : std::thread::hardware_concurrency();
+  unsigned int num_shards = argc > 4 ? std::atoi(argv[4]) : 64;
+  if (num_keys < 2 || ops_per_thread == 0 || num_shards == 0) {
+    std::cerr << "Usage: " << argv[0]
+              << " [num_keys] [ops_per_thread] [max_threads] [shards]"
+              << std::endl;
+    return 1;
+  }
+  if (max_threads == 0) max_threads = 1;
+
+  std::cout << num_keys << " keys, " << num_shards << " shards, "
+            << std::thread::hardware_concurrency() << " hardware threads"
+            << std::endl;
+  std::cout << "Mops/s for 80% Get, 10% Insert, 10% Remove" << std::endl;
+  std::cout << std::setw(8) << "threads" << std::setw(12) << "mutex"
+            << std::setw(12) << "sharded" << std::endl;
+
+  // Powers of two, then max_threads itself
+  std::vector<unsigned int> thread_counts;
+  for (unsigned int threads = 1; threads < max_threads; threads *= 2)
+    thread_counts.push_back(threads);
+  thread_counts.push_back(max_threads);
+
+  for (unsigned int threads : thread_counts) {
+    MutexLLRB_map single;
+    ShardedLLRB_map<int, int> sharded(num_shards);
+    Fill(&single, num_keys);
+    Fill(&sharded, num_keys);
+    double single_mops = Throughput(&single, num_keys, ops_per_thread,
+                                    threads);
+    double sharded_mops = Throughput(&sharded, num_keys, ops_per_thread,
+                                     threads);
+    std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2)
+              << std::setw(12) << single_mops << std::setw(12) << sharded_mops
+              << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,192 @@
+#ifndef SHARDED_LLRB_MAP_H_
+#define SHARDED_LLRB_MAP_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "llrb_map.h"
+#include "rw_lock.h"
+
+// Thread-safe map made of independent LLRB_map shards. Every key lives in
+// the shard its hash picks, and each shard has its own reader-writer lock, so
+// operations on different shards never wait on each other and lookups in
+// the same shard run side by side. Ordered walks merge the shards by key
+template <typename K, typename V, typename Hash = std::hash<K>>
+class ShardedLLRB_map {
+ public:
+  explicit ShardedLLRB_map(unsigned int num_shards = 16,
+                           const Hash &hash = Hash());
+  ShardedLLRB_map(const ShardedLLRB_map&) = delete;
+  ShardedLLRB_map& operator=(const ShardedLLRB_map&) = delete;
+
+  // Return number of shards
+  unsigned int NumShards() const { return shards.size(); }
+  // Return size of map. Shards are counted one after another, so the result
+  // may mix states from before and after concurrent writes
+  unsigned int Size();
+  // Return whether @key is found in map
+  bool Contains(const K &key);
+  // Return copy of value given key. Throws std::runtime_error if @key is not
+  // in map
+  V Get(const K &key);
+  // Insert @key in map. Throws std::runtime_error if it is already there
+  void Insert(const K &key, const V &value);
+  // Remove @key from map
+  void Remove(const K &key);
+  // Remove every key from map
+  void Clear();
+
+  // Call @visit(key, value) on every pair in key order. All shards stay read
+  // locked during the walk, so it sees one consistent state; @visit must not
+  // write to the map
+  template <typename Visitor>
+  void ForEach(Visitor visit);
+  // Same as ForEach over keys from @lo to @hi, both included
+  template <typename Visitor>
+  void ForEachInRange(const K &lo, const K &hi, Visitor visit);
+
+ private:
+  struct Shard {
+    RWLock lock;
+    LLRB_map<K, V> map;
+  };
+  typedef typename LLRB_map<K, V>::const_iterator ShardIterator;
+
+  Hash hash;
+  std::vector<std::unique_ptr<Shard>> shards;
+
+  // Return shard holding @key
+  Shard& ShardOf(const K &key);
+  // Merge [first[i], last[i]) of every shard, which must be read locked
+  template <typename Visitor>
+  static void Merge(std::vector<ShardIterator> *first,
+                    const std::vector<ShardIterator> &last, Visitor visit);
+};
+
+template <typename K, typename V, typename Hash>
+ShardedLLRB_map<K, V, Hash>::ShardedLLRB_map(unsigned int num_shards,
+                                             const Hash &hash)
+    : hash(hash) {
+  if (num_shards == 0)
+    throw std::runtime_error("Error: map needs at least one shard");
+  for (unsigned int i = 0; i < num_shards; i++)
+    shards.emplace_back(new Shard);
+}
+
+template <typename K, typename V, typename Hash>
+typename ShardedLLRB_map<K, V, Hash>::Shard&
+ShardedLLRB_map<K, V, Hash>::ShardOf(const K &key) {
+  // Mix the bits first: std::hash of an integer is often the integer itself,
+  // and runs of keys would then stripe the shards
+  uint64_t h = static_cast<uint64_t>(hash(key)) * 0x9e3779b97f4a7c15ULL;
+  return *shards[(h >> 32) % shards.size()];
+}
+
+template <typename K, typename V, typename Hash>
+unsigned int ShardedLLRB_map<K, V, Hash>::Size() {
+  unsigned int size = 0;
+  for (auto &shard : shards) {
+    ReadGuard guard(shard->lock);
+    size += shard->map.Size();
+  }
+  return size;
+}
+
+template <typename K, typename V, typename Hash>
+bool ShardedLLRB_map<K, V, Hash>::Contains(const K &key) {
+  Shard &shard = ShardOf(key);
+  ReadGuard guard(shard.lock);
+  return shard.map.Contains(key);
+}
+
+template <typename K, typename V, typename Hash>
+V ShardedLLRB_map<K, V, Hash>::Get(const K &key) {
+  Shard &shard = ShardOf(key);
+  ReadGuard guard(shard.lock);
+  return shard.map.Get(key);
+}
+
+template <typename K, typename V, typename Hash>
+void ShardedLLRB_map<K, V, Hash>::Insert(const K &key, const V &value) {
+  Shard &shard = ShardOf(key);
+  WriteGuard guard(shard.lock);
+  shard.map.Insert(key, value);
+}
+
+template <typename K, typename V, typename Hash>
+void ShardedLLRB_map<K, V, Hash>::Remove(const K &key) {
+  Shard &shard = ShardOf(key);
+  WriteGuard guard(shard.lock);
+  shard.map.Remove(key);
+}
+
+template <typename K, typename V, typename Hash>
+void ShardedLLRB_map<K, V, Hash>::Clear() {
+  for (auto &shard : shards) {
+    WriteGuard guard(shard->lock);
+    shard->map.Clear();
+  }
+}
+
+template <typename K, typename V, typename Hash>
+template <typename Visitor>
+void ShardedLLRB_map<K, V, Hash>::ForEach(Visitor visit) {
+  // Lock in shard order, as every walk does, so walks cannot deadlock
+  std::vector<std::unique_ptr<ReadGuard>> guards;
+  std::vector<ShardIterator> first, last;
+  for (auto &shard : shards) {
+    guards.emplace_back(new ReadGuard(shard->lock));
+    first.push_back(shard->map.begin());
+    last.push_back(shard->map.end());
+  }
+  Merge(&first, last, visit);
+}
+
+template <typename K, typename V, typename Hash>
+template <typename Visitor>
+void ShardedLLRB_map<K, V, Hash>::ForEachInRange(const K &lo, const K &hi,
+                                                 Visitor visit) {
+  std::vector<std::unique_ptr<ReadGuard>> guards;
+  std::vector<ShardIterator> first, last;
+  for (auto &shard : shards) {
+    guards.emplace_back(new ReadGuard(shard->lock));
+    LLRBRange<ShardIterator> range = shard->map.Range(lo, hi);
+    first.push_back(range.begin());
+    last.push_back(range.end());
+  }
+  Merge(&first, last, visit);
+}
+
+template <typename K, typename V, typename Hash>
+template <typename Visitor>
+void ShardedLLRB_map<K, V, Hash>::Merge(std::vector<ShardIterator> *first,
+                                        const std::vector<ShardIterator> &last,
+                                        Visitor visit) {
+  // Min-heap of shards that still have pairs, ordered by their next key.
+  // Keys are unique across shards, so no tie needs breaking
+  std::vector<ShardIterator> &next = *first;
+  auto later = [&next](std::size_t a, std::size_t b) {
+    return next[b]->first < next[a]->first;
+  };
+  std::vector<std::size_t> heap;
+  for (std::size_t i = 0; i < next.size(); i++)
+    if (next[i] != last[i]) heap.push_back(i);
+  std::make_heap(heap.begin(), heap.end(), later);
+
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), later);
+    std::size_t i = heap.back();
+    visit(next[i]->first, next[i]->second);
+    if (++next[i] == last[i])
+      heap.pop_back();
+    else
+      std::push_heap(heap.begin(), heap.end(), later);
+  }
+}
+
+#endif  // SHARDED_LLRB_MAP_H_
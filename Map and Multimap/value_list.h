@@ -0,0 +1,147 @@
+#ifndef VALUE_LIST_H_
+#define VALUE_LIST_H_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Values of one multimap key, oldest first. The first @N values live inside
+// the list itself; past that they spill to a heap ring buffer that doubles as
+// it fills. Both push_back and pop_front are O(1), and neither moves the
+// values already stored unless the buffer grows
+template <typename V, std::size_t N = 3>
+class ValueList {
+ public:
+  ValueList() : data(Inline()), capacity(N), head(0), count(0) {}
+  explicit ValueList(const V &value)
+      : data(Inline()), capacity(N), head(0), count(0) {
+    push_back(value);
+  }
+  ValueList(ValueList &&other)
+      : data(Inline()), capacity(N), head(0), count(0) {
+    TakeFrom(other);
+  }
+  ValueList& operator=(ValueList &&other) {
+    if (this != &other) {
+      Reset();
+      TakeFrom(other);
+    }
+    return *this;
+  }
+  ValueList(const ValueList&) = delete;
+  ValueList& operator=(const ValueList&) = delete;
+  ~ValueList() { Reset(); }
+
+  // Return number of values
+  std::size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  // Return @i-th oldest value
+  const V& operator[](std::size_t i) const { return data[Slot(i)]; }
+  V& operator[](std::size_t i) { return data[Slot(i)]; }
+  const V& front() const { return data[head]; }
+  // Return bytes of heap ring held, 0 while the values fit inline
+  std::size_t heap_bytes() const {
+    return capacity > N ? capacity * sizeof(V) : 0;
+  }
+
+  // Append @value after the newest value
+  void push_back(const V &value) { emplace_back(value); }
+  void push_back(V &&value) { emplace_back(std::move(value)); }
+  // Append a value built in place from @args after the newest value
+  template <typename... Args>
+  void emplace_back(Args&&... args) {
+    if (count == capacity) {
+      GrowAndAppend(std::forward<Args>(args)...);
+      return;
+    }
+    ::new (static_cast<void*>(data + Slot(count)))
+      V(std::forward<Args>(args)...);
+    count++;
+  }
+  // Remove oldest value
+  void pop_front() {
+    data[head].~V();
+    head = head + 1 == capacity ? 0 : head + 1;
+    count--;
+  }
+
+ private:
+  typedef typename std::aligned_storage<sizeof(V), alignof(V)>::type Storage;
+
+  V* Inline() { return reinterpret_cast<V*>(storage); }
+  bool OnHeap() { return data != Inline(); }
+
+  // Return slot of @i-th oldest value in the ring
+  std::size_t Slot(std::size_t i) const {
+    std::size_t slot = head + i;
+    return slot < capacity ? slot : slot - capacity;
+  }
+
+  // Move the values, oldest first, to a heap ring twice the size and
+  // append a value built from @args. The new value is built first, as
+  // @args may refer to a value about to be moved
+  template <typename... Args>
+  void GrowAndAppend(Args&&... args) {
+    unsigned int new_capacity = 2 * capacity;
+    V* bigger = static_cast<V*>(::operator new(new_capacity * sizeof(V)));
+    try {
+      ::new (static_cast<void*>(bigger + count))
+        V(std::forward<Args>(args)...);
+    } catch (...) {
+      ::operator delete(bigger);
+      throw;
+    }
+    unsigned int moved = 0;
+    try {
+      for (; moved < count; moved++)
+        ::new (static_cast<void*>(bigger + moved))
+          V(std::move_if_noexcept(data[Slot(moved)]));
+    } catch (...) {
+      while (moved > 0) bigger[--moved].~V();
+      bigger[count].~V();
+      ::operator delete(bigger);
+      throw;
+    }
+    unsigned int size = count + 1;
+    Reset();
+    data = bigger;
+    capacity = new_capacity;
+    count = size;
+  }
+
+  // Destroy every value and go back to the inline slots
+  void Reset() {
+    for (unsigned int i = 0; i < count; i++) data[Slot(i)].~V();
+    if (OnHeap()) ::operator delete(data);
+    data = Inline();
+    capacity = N;
+    head = count = 0;
+  }
+
+  // Take the values of @other, which must be empty afterwards. A heap ring
+  // changes hands; inline values are moved one by one
+  void TakeFrom(ValueList &other) {
+    if (other.OnHeap()) {
+      data = other.data;
+      capacity = other.capacity;
+      head = other.head;
+      count = other.count;
+      other.data = other.Inline();
+      other.capacity = N;
+      other.head = other.count = 0;
+      return;
+    }
+    for (; count < other.count; count++)
+      ::new (static_cast<void*>(data + count)) V(std::move(other[count]));
+    other.Reset();
+  }
+
+  V* data;
+  unsigned int capacity;
+  unsigned int head;
+  unsigned int count;
+  Storage storage[N];
+};
+
+#endif  // VALUE_LIST_H_
@@ -0,0 +1,360 @@
+// written by nsrazdan
+
+#include "graph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include "index_min_pq.h"
+#include "multi_queue.h"
+
+Edge::Edge(unsigned int dest, double weight)
+    : dest(dest),
+      weight(weight)
+{}
+
+Vertex::Vertex(unsigned int id) : id(id) {}
+
+void Vertex::AddEdge(const Edge& edge) {
+  edges.push_back(edge);
+}
+
+ShortestPath::ShortestPath() :
+  src(0),
+  dest(0),
+  path_weight(0.00)
+  {}
+
+bool ShortestPath::Found() const {
+  return !path.empty();
+}
+
+void ShortestPath::PrintShortestPath(std::ostream& out) const {
+  // If path is empty, print to user that no path was found
+  if (path.empty()) {
+    std::stringstream ss;
+    ss << src << " to " << dest << ": no path";
+    out << ss.str() << '\n';
+    return;
+  }
+  // Print path, including every vertex taken
+  out << path.front() << " to " << path.back() << ": ";
+  for (unsigned int i = 0; i < path.size(); i++) {
+    out << path[i];
+    if (i != path.size() - 1) { out << " => "; }
+  }
+  out << " (" << path_weight << ")" << '\n';
+}
+
+Graph::Graph(unsigned int cur_size) :
+  cur_size(cur_size) {
+  vertices.reserve(cur_size);
+  for (unsigned int i = 0; i < cur_size; i++) {
+    vertices.emplace_back(i);
+  }
+}
+
+std::unique_ptr<Graph> Graph::Load(const std::string& filename) {
+  // Init input file and string stream to print error
+  std::ifstream task_file(filename);
+  std::stringstream ss;
+  // If input file cannot be read, print out error to user
+  if (!task_file.good()) {
+    ss << "Error: cannot open file " << filename;
+    throw std::runtime_error(ss.str());
+  }
+  return Load(task_file);
+}
+
+std::unique_ptr<Graph> Graph::Load(std::istream& in) {
+  std::stringstream ss;
+
+  int num_vertices = 0;
+  in >> num_vertices;
+
+  // Check if valid number of vertices
+  if (num_vertices <= 0) {
+    ss << "Error: invalid graph size";
+    throw std::runtime_error(ss.str());
+  }
+
+  std::unique_ptr<Graph> graph(
+    new Graph(static_cast<unsigned int>(num_vertices)));
+
+  int src, dest;
+  double weight;
+
+  // Read every line in file. Use that data to create and push edges into graph.
+  while (in >> src >> dest >> weight) {
+    if (!graph->IsNodeIndexValid(src)) {
+      ss << "Invalid source vertex number " << src;
+      throw std::runtime_error(ss.str());
+    } else if (!graph->IsNodeIndexValid(dest)) {
+      ss << "Invalid dest vertex number " << dest;
+      throw std::runtime_error(ss.str());
+    } else if (weight < 0) {
+      ss << "Invalid weight " << weight;
+      throw std::runtime_error(ss.str());
+    }
+    graph->AddEdge(static_cast<unsigned int>(src),
+      static_cast<unsigned int>(dest), weight);
+  }
+  return graph;
+}
+
+unsigned int Graph::Size() const {
+  return cur_size;
+}
+
+const Vertex& Graph::At(unsigned int id) const {
+  return vertices.at(id);
+}
+
+SearchWorkspace::SearchWorkspace() {}
+
+SearchWorkspace::~SearchWorkspace() {}
+
+// Dijkstras algorithm function
+void Graph::Search(unsigned int src, unsigned int dest,
+  SearchWorkspace* workspace) const {
+  std::vector<double>& dist = workspace->dist;
+  std::vector<unsigned int>& previous = workspace->previous;
+  std::vector<unsigned int>& touched = workspace->touched;
+
+  // Reset the state left by the last search, or size it for this graph
+  if (dist.size() != cur_size || !workspace->queue) {
+    dist.assign(cur_size, -1);
+    previous.assign(cur_size, cur_size);
+    touched.clear();
+    workspace->queue.reset(new IndexMinPQ<double>(cur_size));
+  } else {
+    for (unsigned int v : touched) {
+      dist[v] = -1;
+      previous[v] = cur_size;
+    }
+    touched.clear();
+    workspace->queue->Clear();
+  }
+  IndexMinPQ<double>& priority_vertices = *workspace->queue;
+
+  // Set source vertex distance to zero and push to queue
+  dist[src] = 0;
+  touched.push_back(src);
+  priority_vertices.Push(dist[src], src);
+
+  // While the queue is not empty
+  while (priority_vertices.Size() != 0) {
+    // Save and remove vertex
+    unsigned int cur_vertex_index = priority_vertices.Top();
+    priority_vertices.Pop();
+
+    // If destination is reached, break
+    if (cur_vertex_index == dest) {
+      break;
+    }
+
+    // For each adjacent vertex
+    for (auto const &n : vertices[cur_vertex_index].edges) {
+      // Alt path weight = source->current node distance + possible path weight
+      double alt_path_weight = dist[cur_vertex_index] + n.weight;
+
+      // If alt path is better than current one
+      if (alt_path_weight < dist[n.dest] || dist[n.dest] < 0) {
+        if (dist[n.dest] < 0) touched.push_back(n.dest);
+        // Change distance from source
+        dist[n.dest] = alt_path_weight;
+        // Update previous node in path
+        previous[n.dest] = cur_vertex_index;
+
+        // Update priority Queue
+        if (priority_vertices.Contains(n.dest)) {
+          priority_vertices.ChangeKey(alt_path_weight, n.dest);
+        } else {
+          priority_vertices.Push(alt_path_weight, n.dest);
+        }
+      }
+    }
+  }
+}
+
+void Graph::Backtrack(unsigned int src, unsigned int dest,
+  const std::vector<double>& dist, const std::vector<unsigned int>& previous,
+  ShortestPath* shortest_path) const {
+  shortest_path->src = src;
+  shortest_path->dest = dest;
+  shortest_path->path.clear();
+  shortest_path->path_weight = 0;
+
+  // If no path was found, return and do not create path. A zero distance path
+  // is left empty as well
+  if (dist[dest] <= 0) {
+    return;
+  }
+
+  // Backtracking to set shortest path. Count the vertices first, then fill
+  // the buffer back to front, so the path is written once with no shifting
+  unsigned int length = 0;
+  for (unsigned int v = dest; v != cur_size; v = previous[v]) {
+    length++;
+    if (v == src) break;
+  }
+  shortest_path->path_weight = dist[dest];
+  shortest_path->path.resize(length);
+  for (unsigned int v = dest; length != 0; v = previous[v]) {
+    shortest_path->path[--length] = v;
+  }
+}
+
+ShortestPath Graph::Dijkstra(unsigned int src, unsigned int dest) const {
+  SearchWorkspace workspace;
+  ShortestPath shortest_path;
+  Dijkstra(src, dest, &workspace, &shortest_path);
+  return shortest_path;
+}
+
+void Graph::Dijkstra(unsigned int src, unsigned int dest,
+  SearchWorkspace* workspace, ShortestPath* shortest_path) const {
+  Search(src, dest, workspace);
+  Backtrack(src, dest, workspace->dist, workspace->previous, shortest_path);
+}
+
+std::vector<ShortestPath> Graph::BatchDijkstra(
+  const std::vector<std::pair<unsigned int, unsigned int>>& queries,
+  unsigned int num_threads) const {
+  std::vector<ShortestPath> results(queries.size());
+
+  // Group query positions by source so each source is searched once
+  std::vector<unsigned int> order(queries.size());
+  for (unsigned int i = 0; i < order.size(); i++) order[i] = i;
+  std::sort(order.begin(), order.end(),
+    [&queries](unsigned int a, unsigned int b) {
+      return queries[a].first < queries[b].first;
+    });
+  std::vector<std::pair<unsigned int, unsigned int>> groups;
+  for (unsigned int i = 0; i < order.size(); i++) {
+    if (i == 0 || queries[order[i]].first != queries[order[i - 1]].first)
+      groups.emplace_back(i, i);
+    groups.back().second = i + 1;
+  }
+
+  // Threads take whole groups, so every result slot has a single writer
+  std::atomic<unsigned int> next_group(0);
+  auto worker = [&]() {
+    SearchWorkspace workspace;
+    for (unsigned int g = next_group++; g < groups.size(); g = next_group++) {
+      unsigned int first = groups[g].first, last = groups[g].second;
+      unsigned int src = queries[order[first]].first;
+      // A single query can stop at its dest, more need the whole tree
+      unsigned int stop = (last - first == 1) ?
+        queries[order[first]].second : cur_size;
+      Search(src, stop, &workspace);
+      for (unsigned int i = first; i < last; i++) {
+        Backtrack(src, queries[order[i]].second, workspace.dist,
+          workspace.previous, &results[order[i]]);
+      }
+    }
+  };
+
+  if (num_threads == 0) num_threads = 1;
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1; i < num_threads && i < groups.size(); i++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto &t : threads)
+    t.join();
+  return results;
+}
+
+// Parallel label-correcting Dijkstra. Threads pop vertices from a relaxed
+// MultiQueue, so a vertex may be settled more than once; stale entries whose
+// key no longer matches the vertex distance are skipped
+ShortestPath Graph::ParallelDijkstra(unsigned int src, unsigned int dest,
+  unsigned int num_threads) const {
+  const double kInfinity = std::numeric_limits<double>::infinity();
+  if (num_threads == 0) num_threads = 1;
+
+  // Distances are read without locks, but written under the vertex lock
+  // together with the previous vertex so both always agree
+  std::vector<std::atomic<double>> dist(cur_size);
+  std::vector<unsigned int> previous(cur_size, cur_size);
+  std::unique_ptr<std::mutex[]> locks(new std::mutex[cur_size]);
+  for (auto &d : dist) d.store(kInfinity, std::memory_order_relaxed);
+
+  // Number of items pushed but not yet fully processed. The search is over
+  // once it drops to zero
+  std::atomic<unsigned int> pending(1);
+  MultiQueue<double> priority_vertices(num_threads);
+  dist[src].store(0, std::memory_order_relaxed);
+  priority_vertices.Push(0, src);
+
+  auto worker = [&]() {
+    double cur_dist;
+    unsigned int cur_vertex_index;
+    while (pending.load() != 0) {
+      if (!priority_vertices.TryPop(&cur_dist, &cur_vertex_index)) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      // Skip stale entries, and entries that cannot beat the best distance to
+      // the destination found so far
+      if (cur_dist > dist[cur_vertex_index].load(std::memory_order_relaxed) ||
+          cur_dist >= dist[dest].load(std::memory_order_relaxed) ||
+          cur_vertex_index == dest) {
+        pending.fetch_sub(1);
+        continue;
+      }
+
+      // For each adjacent vertex
+      for (auto const &n : vertices[cur_vertex_index].edges) {
+        double alt_path_weight = cur_dist + n.weight;
+        if (alt_path_weight >= dist[n.dest].load(std::memory_order_relaxed))
+          continue;
+
+        // Recheck under the lock, another thread may have won the race
+        {
+          std::lock_guard<std::mutex> guard(locks[n.dest]);
+          if (alt_path_weight >= dist[n.dest].load(std::memory_order_relaxed))
+            continue;
+          dist[n.dest].store(alt_path_weight, std::memory_order_relaxed);
+          previous[n.dest] = cur_vertex_index;
+        }
+        pending.fetch_add(1);
+        priority_vertices.Push(alt_path_weight, n.dest);
+      }
+      pending.fetch_sub(1);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1; i < num_threads; i++)
+    threads.emplace_back(worker);
+  worker();
+  for (auto &t : threads)
+    t.join();
+
+  // Convert to the sequential convention (-1 for unreached) and backtrack
+  std::vector<double> final_dist(cur_size);
+  for (unsigned int v = 0; v < cur_size; v++) {
+    double d = dist[v].load();
+    final_dist[v] = (d == kInfinity) ? -1 : d;
+  }
+  ShortestPath shortest_path;
+  Backtrack(src, dest, final_dist, previous, &shortest_path);
+  return shortest_path;
+}
+
+void Graph::AddEdge(const unsigned int& src, const unsigned int& dest,
+  const double& weight) {
+  vertices[src].AddEdge(Edge(dest, weight));
+}
+
+bool Graph::IsNodeIndexValid(int index) const {
+  return (index >= 0 && index < static_cast<int>(cur_size));
+}
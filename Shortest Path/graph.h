@@ -0,0 +1,120 @@
+// written by nsrazdan
+//
+// Shortest path library. A Graph is loaded once and can then answer any number
+// of queries, from any number of threads, since all search state is kept per
+// query. Results identify vertices by id.
+#ifndef GRAPH_H_
+#define GRAPH_H_
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Vertex;
+class Edge;
+class Graph;
+class ShortestPath;
+class SearchWorkspace;
+template <typename K> class IndexMinPQ;
+
+// Public class to represent an edge from src vertex to dest. Directed, weighted
+// graph, so used as unique member of src with a weight and the id of the dest
+// vertex
+class Edge {
+ public:
+  Edge(unsigned int dest, double weight);
+  unsigned int dest;
+  double weight;
+};
+
+// Public class to represent vertex in graph. Has a vector of edges for vertices
+// it points to
+class Vertex {
+ public:
+  explicit Vertex(unsigned int id);
+  // Add edge to vertex. This is a directed edge to another vertex in graph
+  void AddEdge(const Edge& edge);
+  std::vector<Edge> edges;
+  unsigned int id;
+};
+
+// Class to represent the shortest path between two vertices in graph. Contains
+// ids of the vertices on the path, in order, and a weight for that path
+class ShortestPath {
+ public:
+  ShortestPath();
+  // Return whether a path was found
+  bool Found() const;
+  // Print the shortest path
+  void PrintShortestPath(std::ostream& out = std::cout) const;
+  unsigned int src;
+  unsigned int dest;
+  std::vector<unsigned int> path;
+  double path_weight;
+};
+
+// Search state that can be reused across queries. Keeping one per thread makes
+// repeated searches free of allocation once its buffers have grown to the
+// graph size, and resetting it only touches the vertices the last search
+// reached
+class SearchWorkspace {
+ public:
+  SearchWorkspace();
+  ~SearchWorkspace();
+
+ private:
+  friend class Graph;
+  std::vector<double> dist;
+  std::vector<unsigned int> previous;
+  std::vector<unsigned int> touched;
+  std::unique_ptr<IndexMinPQ<double>> queue;
+};
+
+// Class to represent graph of vertices and edges
+class Graph {
+ public:
+  explicit Graph(unsigned int cur_size);
+  // Read graph in graph.dat format: vertex count, then "src dest weight"
+  // lines. Throws std::runtime_error on malformed input
+  static std::unique_ptr<Graph> Load(const std::string& filename);
+  static std::unique_ptr<Graph> Load(std::istream& in);
+
+  unsigned int Size() const;
+  void AddEdge(const unsigned int& src, const unsigned int& dest,
+    const double& weight);
+  bool IsNodeIndexValid(int index) const;
+  const Vertex& At(unsigned int id) const;
+
+  // Shortest path from @src to @dest
+  ShortestPath Dijkstra(unsigned int src, unsigned int dest) const;
+  // Same, but reusing @workspace and the path buffer of @shortest_path
+  void Dijkstra(unsigned int src, unsigned int dest, SearchWorkspace* workspace,
+    ShortestPath* shortest_path) const;
+  // Label-correcting Dijkstra where @num_threads threads settle vertices from
+  // a shared MultiQueue
+  ShortestPath ParallelDijkstra(unsigned int src, unsigned int dest,
+    unsigned int num_threads) const;
+  // Answer every (src, dest) pair in @queries, in order. Queries sharing a
+  // source share one search, and sources are spread over @num_threads threads
+  std::vector<ShortestPath> BatchDijkstra(
+    const std::vector<std::pair<unsigned int, unsigned int>>& queries,
+    unsigned int num_threads = 1) const;
+
+ private:
+  std::vector<Vertex> vertices;
+  unsigned int cur_size;
+
+  // Run Dijkstra from @src, stopping early once @dest is settled unless @dest
+  // is Size(). Leaves distances (-1 if unreached) and previous vertices
+  // (Size() if none) in @workspace
+  void Search(unsigned int src, unsigned int dest,
+    SearchWorkspace* workspace) const;
+  // Build the path to @dest from the search results into @shortest_path
+  void Backtrack(unsigned int src, unsigned int dest,
+    const std::vector<double>& dist, const std::vector<unsigned int>& previous,
+    ShortestPath* shortest_path) const;
+};
+
+#endif  // GRAPH_H_
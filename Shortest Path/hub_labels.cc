@@ -0,0 +1,361 @@
+// written by nsrazdan
+
+#include "hub_labels.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const char kMagic[8] = {'S', 'P', 'H', 'U', 'B', 'L', 'B', '1'};
+
+// File layout: Header, then out offsets and in offsets (num_vertices + 1
+// uint64 each), out dists and in dists (double), out hubs and in hubs
+// (uint32). Wider types come first so every array is naturally aligned
+struct Header {
+  char magic[8];
+  uint32_t num_vertices;
+  uint32_t reserved;
+  uint64_t num_out;
+  uint64_t num_in;
+};
+
+const double kInfinity = std::numeric_limits<double>::infinity();
+
+// Return whether one direction of mapped labels is well formed: offsets
+// start at 0, never go down and end at @num_entries, and the hubs of every
+// vertex are ranks below @n in increasing order, as Merge needs
+bool ValidLabels(const uint64_t* offsets, const uint32_t* hubs, uint64_t n,
+  uint64_t num_entries) {
+  if (offsets[0] != 0 || offsets[n] != num_entries) return false;
+  for (uint64_t v = 0; v < n; v++) {
+    if (offsets[v + 1] < offsets[v]) return false;
+    for (uint64_t i = offsets[v]; i < offsets[v + 1]; i++) {
+      if (hubs[i] >= n || (i > offsets[v] && hubs[i] <= hubs[i - 1]))
+        return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+HubLabels::HubLabels()
+    : num_vertices(0),
+      out{nullptr, nullptr, nullptr},
+      in{nullptr, nullptr, nullptr},
+      mapping(nullptr),
+      mapping_size(0) {
+}
+
+HubLabels::~HubLabels() {
+  if (mapping) munmap(mapping, mapping_size);
+}
+
+unsigned int HubLabels::Size() const {
+  return num_vertices;
+}
+
+uint64_t HubLabels::NumEntries() const {
+  if (num_vertices == 0) return 0;
+  return out.offsets[num_vertices] + in.offsets[num_vertices];
+}
+
+std::unique_ptr<HubLabels> HubLabels::Build(const Graph& graph) {
+  unsigned int n = graph.Size();
+
+  // Reverse edges, for searching towards a hub
+  std::vector<std::vector<Edge>> reverse(n);
+  for (unsigned int v = 0; v < n; v++)
+    for (auto const& e : graph.At(v).edges)
+      reverse[e.dest].emplace_back(v, e.weight);
+
+  // High degree vertices cover the most paths, so they become hubs first
+  std::vector<unsigned int> order(n);
+  for (unsigned int v = 0; v < n; v++) order[v] = v;
+  std::stable_sort(order.begin(), order.end(),
+    [&](unsigned int a, unsigned int b) {
+      return graph.At(a).edges.size() + reverse[a].size() >
+             graph.At(b).edges.size() + reverse[b].size();
+    });
+
+  // labels[0] is out, labels[1] is in. Entries are (hub rank, distance)
+  typedef std::pair<uint32_t, double> Entry;
+  std::vector<std::vector<Entry>> labels[2];
+  labels[0].resize(n);
+  labels[1].resize(n);
+
+  // Search state, reset after every search through @touched
+  std::vector<double> dist(n, kInfinity);
+  std::vector<double> hub_dist(n, kInfinity);
+  std::vector<unsigned int> touched;
+  typedef std::pair<double, unsigned int> Item;
+  std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+
+  for (uint32_t rank = 0; rank < n; rank++) {
+    unsigned int hub = order[rank];
+    // Forward search from the hub fills in labels, pruned by out(hub).
+    // Backward search fills out labels, pruned by in(hub)
+    for (int forward = 1; forward >= 0; forward--) {
+      const std::vector<Entry>& hub_label = labels[forward ? 0 : 1][hub];
+      std::vector<std::vector<Entry>>& target = labels[forward ? 1 : 0];
+      for (auto const& e : hub_label) hub_dist[e.first] = e.second;
+
+      dist[hub] = 0;
+      touched.push_back(hub);
+      queue.push(Item(0, hub));
+      while (!queue.empty()) {
+        Item top = queue.top();
+        queue.pop();
+        unsigned int v = top.second;
+        if (top.first > dist[v]) continue;
+
+        // Prune if earlier hubs already give a path this short
+        double known = kInfinity;
+        for (auto const& e : target[v])
+          known = std::min(known, hub_dist[e.first] + e.second);
+        if (known <= top.first) continue;
+        target[v].emplace_back(rank, top.first);
+
+        const std::vector<Edge>& edges = forward ? graph.At(v).edges
+                                                 : reverse[v];
+        for (auto const& e : edges) {
+          double alt = top.first + e.weight;
+          if (alt < dist[e.dest]) {
+            if (dist[e.dest] == kInfinity) touched.push_back(e.dest);
+            dist[e.dest] = alt;
+            queue.push(Item(alt, e.dest));
+          }
+        }
+      }
+
+      for (unsigned int v : touched) dist[v] = kInfinity;
+      touched.clear();
+      for (auto const& e : hub_label) hub_dist[e.first] = kInfinity;
+    }
+  }
+
+  // Flatten into the arrays queries run on
+  std::unique_ptr<HubLabels> result(new HubLabels());
+  result->num_vertices = n;
+  Labels* sides[2] = {&result->out, &result->in};
+  for (int side = 0; side < 2; side++) {
+    std::vector<uint64_t>& offsets = result->storage_offsets[side];
+    std::vector<uint32_t>& hubs = result->storage_hubs[side];
+    std::vector<double>& dists = result->storage_dists[side];
+    offsets.assign(1, 0);
+    for (unsigned int v = 0; v < n; v++) {
+      for (auto const& e : labels[side][v]) {
+        hubs.push_back(e.first);
+        dists.push_back(e.second);
+      }
+      offsets.push_back(hubs.size());
+      std::vector<Entry>().swap(labels[side][v]);
+    }
+    sides[side]->offsets = offsets.data();
+    sides[side]->hubs = hubs.data();
+    sides[side]->dists = dists.data();
+  }
+  return result;
+}
+
+void HubLabels::Save(const std::string& filename) const {
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file.good())
+    throw std::runtime_error("Error: cannot open file " + filename);
+
+  Header header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.num_vertices = num_vertices;
+  header.reserved = 0;
+  header.num_out = out.offsets[num_vertices];
+  header.num_in = in.offsets[num_vertices];
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(out.offsets),
+    (num_vertices + 1) * sizeof(uint64_t));
+  file.write(reinterpret_cast<const char*>(in.offsets),
+    (num_vertices + 1) * sizeof(uint64_t));
+  file.write(reinterpret_cast<const char*>(out.dists),
+    header.num_out * sizeof(double));
+  file.write(reinterpret_cast<const char*>(in.dists),
+    header.num_in * sizeof(double));
+  file.write(reinterpret_cast<const char*>(out.hubs),
+    header.num_out * sizeof(uint32_t));
+  file.write(reinterpret_cast<const char*>(in.hubs),
+    header.num_in * sizeof(uint32_t));
+  if (!file.good())
+    throw std::runtime_error("Error: cannot write file " + filename);
+}
+
+std::unique_ptr<HubLabels> HubLabels::Map(const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Error: cannot open file " + filename);
+  struct stat info;
+  if (fstat(fd, &info) < 0 ||
+      static_cast<size_t>(info.st_size) < sizeof(Header)) {
+    close(fd);
+    throw std::runtime_error("Error: invalid label file " + filename);
+  }
+
+  size_t size = static_cast<size_t>(info.st_size);
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    throw std::runtime_error("Error: cannot map file " + filename);
+
+  std::unique_ptr<HubLabels> result(new HubLabels());
+  result->mapping = mapping;
+  result->mapping_size = size;
+
+  // Check the header against the file size before trusting any offsets,
+  // keeping clear of overflow on entry counts taken from the file
+  const Header* header = static_cast<const Header*>(mapping);
+  const std::string invalid = "Error: invalid label file " + filename;
+  uint64_t n = header->num_vertices;
+  uint64_t num_out = header->num_out, num_in = header->num_in;
+  const uint64_t entry_size = sizeof(double) + sizeof(uint32_t);
+  uint64_t max_entries = size / entry_size;
+  if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+      num_out > max_entries || num_in > max_entries - num_out)
+    throw std::runtime_error(invalid);
+  uint64_t expected = sizeof(Header) + 2 * (n + 1) * sizeof(uint64_t) +
+    (num_out + num_in) * entry_size;
+  if (expected != size) throw std::runtime_error(invalid);
+
+  const char* base = static_cast<const char*>(mapping) + sizeof(Header);
+  result->num_vertices = header->num_vertices;
+  result->out.offsets = reinterpret_cast<const uint64_t*>(base);
+  base += (n + 1) * sizeof(uint64_t);
+  result->in.offsets = reinterpret_cast<const uint64_t*>(base);
+  base += (n + 1) * sizeof(uint64_t);
+  result->out.dists = reinterpret_cast<const double*>(base);
+  base += num_out * sizeof(double);
+  result->in.dists = reinterpret_cast<const double*>(base);
+  base += num_in * sizeof(double);
+  result->out.hubs = reinterpret_cast<const uint32_t*>(base);
+  base += num_out * sizeof(uint32_t);
+  result->in.hubs = reinterpret_cast<const uint32_t*>(base);
+
+  // Queries index with the offsets and hubs unchecked, so check them all
+  // once here
+  if (!ValidLabels(result->out.offsets, result->out.hubs, n, num_out) ||
+      !ValidLabels(result->in.offsets, result->in.hubs, n, num_in))
+    throw std::runtime_error(invalid);
+  return result;
+}
+
+double HubLabels::Merge(const uint32_t* hubs_a, const double* dists_a,
+  size_t size_a, const uint32_t* hubs_b, const double* dists_b,
+  size_t size_b) {
+  double best = kInfinity;
+  size_t i = 0, j = 0;
+
+#ifdef __SSE2__
+  // Compare blocks of four hubs against each other with all four rotations of
+  // the second block. Only blocks that share a hub fall back to scalar code,
+  // and the block with the smaller last hub is the one that moves on
+  while (i + 4 <= size_a && j + 4 <= size_b) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hubs_a + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hubs_b + j));
+    __m128i match = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi32(a, b),
+        _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 3, 2, 1)))),
+      _mm_or_si128(
+        _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, _MM_SHUFFLE(1, 0, 3, 2))),
+        _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 1, 0, 3)))));
+    if (_mm_movemask_epi8(match) != 0) {
+      for (size_t x = i; x < i + 4; x++)
+        for (size_t y = j; y < j + 4; y++)
+          if (hubs_a[x] == hubs_b[y])
+            best = std::min(best, dists_a[x] + dists_b[y]);
+    }
+    uint32_t last_a = hubs_a[i + 3], last_b = hubs_b[j + 3];
+    if (last_a <= last_b) i += 4;
+    if (last_b <= last_a) j += 4;
+  }
+#endif
+
+  // Plain merge of what is left
+  while (i < size_a && j < size_b) {
+    if (hubs_a[i] < hubs_b[j]) {
+      i++;
+    } else if (hubs_b[j] < hubs_a[i]) {
+      j++;
+    } else {
+      best = std::min(best, dists_a[i] + dists_b[j]);
+      i++;
+      j++;
+    }
+  }
+  return best;
+}
+
+double HubLabels::Distance(unsigned int src, unsigned int dest) const {
+  if (src >= num_vertices || dest >= num_vertices)
+    throw std::out_of_range("Vertex not labeled");
+  uint64_t a = out.offsets[src], b = in.offsets[dest];
+  double best = Merge(out.hubs + a, out.dists + a, out.offsets[src + 1] - a,
+    in.hubs + b, in.dists + b, in.offsets[dest + 1] - b);
+  return best == kInfinity ? -1 : best;
+}
+
+ShortestPath HubLabels::Query(const Graph& graph, unsigned int src,
+  unsigned int dest) const {
+  ShortestPath shortest_path;
+  shortest_path.src = src;
+  shortest_path.dest = dest;
+
+  // Same convention as Graph::Dijkstra: no path, or a zero distance path,
+  // leaves the path empty
+  double remaining = Distance(src, dest);
+  if (remaining <= 0) return shortest_path;
+  shortest_path.path_weight = remaining;
+
+  // Walk from src, each time taking an edge that starts a shortest path to
+  // dest. The tolerance absorbs rounding between differently summed paths.
+  // Vertices already on the path are skipped, so zero weight cycles cannot
+  // trap the walk
+  std::unordered_set<unsigned int> on_path;
+  unsigned int v = src;
+  shortest_path.path.push_back(v);
+  on_path.insert(v);
+  while (v != dest) {
+    bool moved = false;
+    for (auto const& e : graph.At(v).edges) {
+      if (on_path.count(e.dest)) continue;
+      double rest = Distance(e.dest, dest);
+      if (rest < 0) continue;
+      if (std::fabs(e.weight + rest - remaining) <=
+          1e-9 * std::max(1.0, remaining)) {
+        v = e.dest;
+        remaining = rest;
+        shortest_path.path.push_back(v);
+        on_path.insert(v);
+        moved = true;
+        break;
+      }
+    }
+    if (!moved)
+      throw std::runtime_error("Error: labels do not match graph");
+  }
+  return shortest_path;
+}
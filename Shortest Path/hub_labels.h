@@ -0,0 +1,70 @@
+// written by nsrazdan
+//
+// Hub labeling distance oracle. Every vertex v keeps two labels, sorted by hub:
+// out(v) with distances from v to its hubs and in(v) with distances from its
+// hubs to v. The distance from s to t is the smallest out(s) + in(t) over the
+// hubs the two labels share, so a query is one merge of two short arrays.
+// Labels are built with pruned landmark labeling and saved as a flat file that
+// is mapped straight into memory when loaded.
+#ifndef HUB_LABELS_H_
+#define HUB_LABELS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "graph.h"
+
+class HubLabels {
+ public:
+  ~HubLabels();
+  // Build labels for @graph. Vertices are tried as hubs in order of degree
+  static std::unique_ptr<HubLabels> Build(const Graph& graph);
+  // Map a file written by Save. Throws std::runtime_error if the file cannot
+  // be opened or is not a label file
+  static std::unique_ptr<HubLabels> Map(const std::string& filename);
+  // Write labels to @filename. Throws std::runtime_error on failure
+  void Save(const std::string& filename) const;
+
+  // Return number of vertices labeled
+  unsigned int Size() const;
+  // Return total number of label entries, both directions
+  uint64_t NumEntries() const;
+  // Return shortest distance from @src to @dest, -1 if there is no path
+  double Distance(unsigned int src, unsigned int dest) const;
+  // Shortest path from @src to @dest. The distance comes from the labels; the
+  // vertices are recovered by walking the edges of @graph, which must be the
+  // graph the labels were built from
+  ShortestPath Query(const Graph& graph, unsigned int src,
+    unsigned int dest) const;
+
+ private:
+  // One direction of labels: entries of vertex v are [offsets[v],
+  // offsets[v + 1]) in hubs and dists. Hubs are vertex ranks, not ids, so the
+  // entries come out sorted as the labels are built
+  struct Labels {
+    const uint64_t* offsets;
+    const uint32_t* hubs;
+    const double* dists;
+  };
+
+  HubLabels();
+
+  unsigned int num_vertices;
+  Labels out;
+  Labels in;
+  // Backing storage: vectors when built, a mapping when loaded
+  std::vector<uint64_t> storage_offsets[2];
+  std::vector<uint32_t> storage_hubs[2];
+  std::vector<double> storage_dists[2];
+  void* mapping;
+  size_t mapping_size;
+
+  // Return smallest dist_a + dist_b over hubs common to both label ranges
+  static double Merge(const uint32_t* hubs_a, const double* dists_a,
+    size_t size_a, const uint32_t* hubs_b, const double* dists_b,
+    size_t size_b);
+};
+
+#endif  // HUB_LABELS_H_
@@ -24,6 +24,9 @@ class IndexMinPQ {
   bool Contains(unsigned int idx);
   // Change key associated to index @idx
   void ChangeKey(const K &key, unsigned int idx);
+  // Remove all items. Linear in Size(), not in capacity, so a queue can be
+  // reused across searches
+  void Clear();
 
  private:
   // Private members
@@ -171,8 +174,8 @@ void IndexMinPQ<K>::Pop() {
   cur_size--;
   // PercolateDown starting from root node
   PercolateDown(1);
-  // Mark the old idx_to_heap value as invalid
-  idx_to_heap[cur_size + 1] = 0;
+  // Mark the old idx_to_heap value of the removed index as invalid
+  idx_to_heap[heap_to_idx[cur_size + 1]] = 0;
 }
 
 template <typename K>
@@ -197,4 +200,11 @@ void IndexMinPQ<K>::ChangeKey(const K &key, unsigned int idx) {
   PercolateUp(idx_to_heap[idx]);
 }
 
+template <typename K>
+void IndexMinPQ<K>::Clear() {
+  for (unsigned int i = 1; i <= cur_size; i++)
+    idx_to_heap[heap_to_idx[i]] = 0;
+  cur_size = 0;
+}
+
 #endif  // INDEX_MIN_PQ_H_
@@ -0,0 +1,132 @@
+// written by nsrazdan
+#ifndef MULTI_QUEUE_H_
+#define MULTI_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Concurrent relaxed min priority queue (MultiQueue). Keeps c * p binary heaps,
+// each behind its own lock. Push goes to a random heap, and Pop looks at the
+// tops of two random heaps and removes from the better one. Pop therefore
+// returns an item close to the minimum rather than the exact minimum, which is
+// all a label-correcting search needs.
+template <typename K>
+class MultiQueue {
+ public:
+  // Constructor with number of threads sharing the queue and number of heaps
+  // per thread (the 'c' factor)
+  explicit MultiQueue(unsigned int num_threads,
+                      unsigned int heaps_per_thread = 2);
+  // Return approximate number of items
+  unsigned int Size();
+  // Associates @key with index @idx. The same index may be pushed many times
+  void Push(const K &key, unsigned int idx);
+  // Remove an item with a small key and store it in @key and @idx. Return
+  // false if every heap was seen empty
+  bool TryPop(K *key, unsigned int *idx);
+
+ private:
+  typedef std::pair<K, unsigned int> Item;
+  struct Heap {
+    std::mutex lock;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> items;
+    // Key of the top item, readable without taking the lock. Empty() if none
+    std::atomic<K> top;
+  };
+
+  unsigned int num_heaps;
+  std::unique_ptr<Heap[]> heaps;
+  std::atomic<unsigned int> cur_size;
+
+  // Helper methods
+  static K Empty() {
+    return std::numeric_limits<K>::max();
+  }
+  unsigned int RandomHeap() {
+    static thread_local std::minstd_rand rng(std::random_device{}());
+    return rng() % num_heaps;
+  }
+  // Pop top of heap @h, which must be locked by the caller
+  bool PopLocked(Heap *h, K *key, unsigned int *idx);
+};
+
+template <typename K>
+MultiQueue<K>::MultiQueue(unsigned int num_threads,
+                          unsigned int heaps_per_thread)
+    : num_heaps(std::max(1u, num_threads * heaps_per_thread)),
+      heaps(new Heap[num_heaps]),
+      cur_size(0) {
+  for (unsigned int i = 0; i < num_heaps; i++)
+    heaps[i].top.store(Empty(), std::memory_order_relaxed);
+}
+
+template <typename K>
+unsigned int MultiQueue<K>::Size() {
+  return cur_size.load(std::memory_order_relaxed);
+}
+
+template <typename K>
+void MultiQueue<K>::Push(const K &key, unsigned int idx) {
+  // Spin over random heaps until one is free, so threads rarely block
+  Heap *h = &heaps[RandomHeap()];
+  while (!h->lock.try_lock())
+    h = &heaps[RandomHeap()];
+
+  h->items.push(Item(key, idx));
+  h->top.store(h->items.top().first, std::memory_order_relaxed);
+  cur_size.fetch_add(1, std::memory_order_relaxed);
+  h->lock.unlock();
+}
+
+template <typename K>
+bool MultiQueue<K>::PopLocked(Heap *h, K *key, unsigned int *idx) {
+  // Another thread may have emptied the heap since we peeked at it
+  if (h->items.empty())
+    return false;
+
+  *key = h->items.top().first;
+  *idx = h->items.top().second;
+  h->items.pop();
+  h->top.store(h->items.empty() ? Empty() : h->items.top().first,
+               std::memory_order_relaxed);
+  cur_size.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+template <typename K>
+bool MultiQueue<K>::TryPop(K *key, unsigned int *idx) {
+  // Two-choice pops: compare the tops of two random heaps, take the smaller
+  for (unsigned int attempt = 0; attempt < num_heaps; attempt++) {
+    Heap *a = &heaps[RandomHeap()];
+    Heap *b = &heaps[RandomHeap()];
+    if (b->top.load(std::memory_order_relaxed) <
+        a->top.load(std::memory_order_relaxed))
+      std::swap(a, b);
+    if (a->top.load(std::memory_order_relaxed) == Empty())
+      continue;
+    if (!a->lock.try_lock())
+      continue;
+    bool popped = PopLocked(a, key, idx);
+    a->lock.unlock();
+    if (popped)
+      return true;
+  }
+
+  // Random choices kept missing, so scan every heap once before giving up
+  for (unsigned int i = 0; i < num_heaps; i++) {
+    std::lock_guard<std::mutex> guard(heaps[i].lock);
+    if (PopLocked(&heaps[i], key, idx))
+      return true;
+  }
+  return false;
+}
+
+#endif  // MULTI_QUEUE_H_
@@ -0,0 +1,112 @@
+// written by nsrazdan
+//
+// Checks ParallelDijkstra against the sequential Dijkstra on a random graph,
+// then measures query throughput as the number of threads grows.
+//
+// Usage: parallel_dijkstra_bench num_vertices edges_per_vertex [max_threads]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include "graph.h"
+
+typedef std::tuple<unsigned int, unsigned int, double> EdgeRecord;
+
+std::unique_ptr<Graph> BuildGraph(unsigned int num_vertices,
+  const std::vector<EdgeRecord>& edges) {
+  std::unique_ptr<Graph> graph(new Graph(num_vertices));
+  for (auto const& e : edges)
+    graph->AddEdge(std::get<0>(e), std::get<1>(e), std::get<2>(e));
+  return graph;
+}
+
+// Return whether both searches agree on the weight, and whether the parallel
+// path is a real path in the graph with that weight
+bool SamePath(const Graph& graph, const ShortestPath& expected,
+  const ShortestPath& actual) {
+  if (!expected.Found() || !actual.Found())
+    return expected.Found() == actual.Found();
+  if (std::fabs(expected.path_weight - actual.path_weight) >
+      1e-9 * std::max(1.0, expected.path_weight))
+    return false;
+
+  double weight = 0;
+  for (unsigned int i = 0; i + 1 < actual.path.size(); i++) {
+    double best = -1;
+    for (auto const& e : graph.At(actual.path[i]).edges)
+      if (e.dest == actual.path[i + 1] && (best < 0 || e.weight < best))
+        best = e.weight;
+    if (best < 0) return false;
+    weight += best;
+  }
+  return std::fabs(weight - actual.path_weight) <=
+         1e-9 * std::max(1.0, weight);
+}
+
+int main(int argc, char* argv[]) {
+  // Queries pick their ends among the vertices, so there must be one
+  unsigned int num_vertices =
+      argc == 3 || argc == 4 ? std::stoul(argv[1]) : 0;
+  if (num_vertices == 0) {
+    std::cerr << "Usage: " << argv[0]
+              << " num_vertices edges_per_vertex [max_threads]" << std::endl;
+    return 1;
+  }
+  unsigned int edges_per_vertex = std::stoul(argv[2]);
+  unsigned int max_threads = argc == 4 ? std::stoul(argv[3])
+      : std::max(1u, std::thread::hardware_concurrency());
+  const unsigned int kQueries = 16;
+
+  // Random directed graph with a ring through every vertex so most queries
+  // have a path
+  std::mt19937 rng(36);
+  std::uniform_int_distribution<unsigned int> pick(0, num_vertices - 1);
+  std::uniform_real_distribution<double> weight(1, 100);
+  std::vector<EdgeRecord> edges;
+  for (unsigned int v = 0; v < num_vertices; v++) {
+    edges.emplace_back(v, (v + 1) % num_vertices, weight(rng));
+    for (unsigned int i = 1; i < edges_per_vertex; i++)
+      edges.emplace_back(v, pick(rng), weight(rng));
+  }
+  std::vector<std::pair<unsigned int, unsigned int>> queries;
+  for (unsigned int i = 0; i < kQueries; i++)
+    queries.emplace_back(pick(rng), pick(rng));
+
+  // Exactness check
+  std::unique_ptr<Graph> graph = BuildGraph(num_vertices, edges);
+  for (auto const& q : queries) {
+    ShortestPath expected = graph->Dijkstra(q.first, q.second);
+    for (unsigned int t = 1; t <= max_threads; t *= 2) {
+      ShortestPath actual = graph->ParallelDijkstra(q.first, q.second, t);
+      if (!SamePath(*graph, expected, actual)) {
+        std::cerr << "Mismatch for " << q.first << " to " << q.second
+                  << " with " << t << " threads: expected "
+                  << expected.path_weight << ", got "
+                  << actual.path_weight << std::endl;
+        return 1;
+      }
+    }
+  }
+  std::cout << "exact: " << queries.size() << " queries match Dijkstra"
+            << std::endl;
+
+  // Throughput versus threads
+  for (unsigned int t = 1; t <= max_threads; t *= 2) {
+    auto start = std::chrono::steady_clock::now();
+    for (auto const& q : queries)
+      graph->ParallelDijkstra(q.first, q.second, t);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "threads " << t << ": "
+              << queries.size() / elapsed.count() << " queries/s" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,132 @@
+// written by nsrazdan
+
+#include "path_writer.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+PathWriter::PathWriter(int fd, Format format, size_t buffer_size)
+    : fd(fd),
+      format(format),
+      buffer(buffer_size < 64 ? 64 : buffer_size),
+      used(0) {
+  if (format == BINARY) Append("SPR1", 4);
+}
+
+PathWriter::~PathWriter() {
+  try {
+    Flush();
+  } catch (std::runtime_error& e) {
+    std::cerr << e.what() << std::endl;
+  }
+}
+
+void PathWriter::Flush() {
+  size_t written = 0;
+  while (written < used) {
+    ssize_t n = write(fd, buffer.data() + written, used - written);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      used = 0;
+      throw std::runtime_error("Error: cannot write output");
+    }
+    written += static_cast<size_t>(n);
+  }
+  used = 0;
+}
+
+void PathWriter::Reserve(size_t bytes) {
+  if (used + bytes > buffer.size()) Flush();
+}
+
+void PathWriter::Append(const void* data, size_t bytes) {
+  // Pieces larger than the buffer bypass it
+  if (bytes > buffer.size()) {
+    Flush();
+    const char* bytes_left = static_cast<const char*>(data);
+    while (bytes != 0) {
+      size_t chunk = bytes < buffer.size() ? bytes : buffer.size();
+      Append(bytes_left, chunk);
+      bytes_left += chunk;
+      bytes -= chunk;
+    }
+    return;
+  }
+  Reserve(bytes);
+  std::memcpy(buffer.data() + used, data, bytes);
+  used += bytes;
+}
+
+void PathWriter::AppendText(const char* text) {
+  Append(text, std::strlen(text));
+}
+
+void PathWriter::AppendNumber(unsigned int value) {
+  // Digits are produced backwards into a scratch array
+  char digits[10];
+  int count = 0;
+  do {
+    digits[count++] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  Reserve(count);
+  while (count != 0) buffer[used++] = digits[--count];
+}
+
+void PathWriter::AppendNumber(double value) {
+  // %g matches the default std::ostream formatting of a double
+  char text[32];
+  int length = std::snprintf(text, sizeof(text), "%g", value);
+  Append(text, static_cast<size_t>(length));
+}
+
+void PathWriter::Write(const ShortestPath& shortest_path) {
+  if (format == TEXT)
+    WriteText(shortest_path);
+  else
+    WriteBinary(shortest_path);
+}
+
+void PathWriter::WriteText(const ShortestPath& shortest_path) {
+  const std::vector<unsigned int>& path = shortest_path.path;
+  // If path is empty, print to user that no path was found
+  if (path.empty()) {
+    AppendNumber(shortest_path.src);
+    AppendText(" to ");
+    AppendNumber(shortest_path.dest);
+    AppendText(": no path\n");
+    return;
+  }
+  // Print path, including every vertex taken
+  AppendNumber(path.front());
+  AppendText(" to ");
+  AppendNumber(path.back());
+  AppendText(": ");
+  for (unsigned int i = 0; i < path.size(); i++) {
+    if (i != 0) AppendText(" => ");
+    AppendNumber(path[i]);
+  }
+  AppendText(" (");
+  AppendNumber(shortest_path.path_weight);
+  AppendText(")\n");
+}
+
+void PathWriter::WriteBinary(const ShortestPath& shortest_path) {
+  static_assert(sizeof(unsigned int) == sizeof(uint32_t),
+    "path ids are written as uint32");
+  uint32_t header[3] = {
+    shortest_path.src,
+    shortest_path.dest,
+    static_cast<uint32_t>(shortest_path.path.size())
+  };
+  Append(header, sizeof(header));
+  Append(&shortest_path.path_weight, sizeof(double));
+  Append(shortest_path.path.data(),
+    shortest_path.path.size() * sizeof(unsigned int));
+}
@@ -0,0 +1,48 @@
+// written by nsrazdan
+//
+// Buffered writer for shortest path results. Formats straight into its own
+// buffer and only calls write(2) when the buffer fills, instead of going
+// through std::cout with a flush per path.
+//
+// TEXT writes the same lines as ShortestPath::PrintShortestPath.
+// BINARY writes a header followed by one record per path, all in host byte
+// order:
+//   header: char magic[4] = "SPR1"
+//   record: uint32 src, uint32 dest, uint32 length, double weight,
+//           uint32 path[length]      (length is 0 when there is no path)
+#ifndef PATH_WRITER_H_
+#define PATH_WRITER_H_
+
+#include <cstddef>
+#include <vector>
+#include "graph.h"
+
+class PathWriter {
+ public:
+  enum Format { TEXT, BINARY };
+  // Write to file descriptor @fd, which the caller keeps open
+  PathWriter(int fd, Format format, size_t buffer_size = 1 << 16);
+  // Flush what is left
+  ~PathWriter();
+  // Append @shortest_path. Throws std::runtime_error if the write fails
+  void Write(const ShortestPath& shortest_path);
+  // Write out the buffer
+  void Flush();
+
+ private:
+  int fd;
+  Format format;
+  std::vector<char> buffer;
+  size_t used;
+
+  // Helper methods for appending to the buffer
+  void Reserve(size_t bytes);
+  void Append(const void* data, size_t bytes);
+  void AppendText(const char* text);
+  void AppendNumber(unsigned int value);
+  void AppendNumber(double value);
+  void WriteText(const ShortestPath& shortest_path);
+  void WriteBinary(const ShortestPath& shortest_path);
+};
+
+#endif  // PATH_WRITER_H_
@@ -0,0 +1,412 @@
+// written by nsrazdan
+
+#include "query_server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Longest request line accepted before the client is dropped
+const size_t kMaxLineLength = 4096;
+// Longest a worker spends writing one batch of answers to a client that
+// stopped reading them. A client that runs out the clock is dropped
+const int kWriteTimeoutMs = 2000;
+
+std::runtime_error SystemError(const std::string& what) {
+  return std::runtime_error("Error: " + what + ": " + std::strerror(errno));
+}
+
+// Write all of @data to nonblocking socket @fd within kWriteTimeoutMs.
+// Return false if the peer went away or the time ran out
+bool WriteAll(int fd, const std::string& data) {
+  auto deadline = std::chrono::steady_clock::now() +
+    std::chrono::milliseconds(kWriteTimeoutMs);
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t n = send(fd, data.data() + sent, data.size() - sent,
+      MSG_NOSIGNAL);
+    if (n >= 0) {
+      sent += static_cast<size_t>(n);
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - std::chrono::steady_clock::now()).count();
+      if (left <= 0) return false;
+      pollfd p = {fd, POLLOUT, 0};
+      int ready = poll(&p, 1, static_cast<int>(left));
+      if (ready == 0 || (ready < 0 && errno != EINTR)) return false;
+    } else if (errno != EINTR) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parse all of @token as a base 10 int into @value. Return false if it holds
+// anything else. Throws std::out_of_range if the number does not fit an int
+bool ParseInt(const std::string& token, int *value) {
+  const char *begin = token.c_str();
+  char *end;
+  errno = 0;
+  long number = std::strtol(begin, &end, 10);
+  if (end == begin || *end != '\0') return false;
+  if (errno == ERANGE || number < INT_MIN || number > INT_MAX)
+    throw std::out_of_range(token);
+  *value = static_cast<int>(number);
+  return true;
+}
+
+}  // namespace
+
+sigset_t QueryServer::BlockSignals() {
+  // Must run before any worker starts, so that no thread other than the
+  // event loop (through the signalfd) ever sees these signals
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGHUP);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+  return signals;
+}
+
+WorkerPool::WorkerPool(unsigned int num_workers) : stopping(false) {
+  if (num_workers == 0) num_workers = 1;
+  for (unsigned int i = 0; i < num_workers; i++) {
+    workers.emplace_back([this]() {
+      for (;;) {
+        std::function<void()> task;
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          ready.wait(guard, [this]() { return stopping || !tasks.empty(); });
+          if (tasks.empty()) return;
+          task = std::move(tasks.front());
+          tasks.pop_front();
+        }
+        task();
+      }
+    });
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  ready.notify_all();
+  for (auto &t : workers)
+    t.join();
+}
+
+void WorkerPool::Submit(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    tasks.push_back(std::move(task));
+  }
+  ready.notify_one();
+}
+
+// Client connection. The event loop owns @input; @pending and @scheduled are
+// shared with the workers and guarded by @lock. At most one worker drains a
+// connection at a time, which keeps responses in request order
+struct QueryServer::Connection {
+  explicit Connection(int fd) : fd(fd), scheduled(false) {}
+  ~Connection() { close(fd); }
+  int fd;
+  std::string input;
+  std::mutex lock;
+  std::deque<std::string> pending;
+  bool scheduled;
+};
+
+QueryServer::QueryServer(const std::string& graph_file,
+  const std::string& socket_path, unsigned int num_workers)
+    : graph_file(graph_file),
+      socket_path(socket_path),
+      graph(Graph::Load(graph_file)),
+      signals(BlockSignals()),
+      pool(num_workers),
+      listen_fd(-1),
+      epoll_fd(-1),
+      signal_fd(-1),
+      bound(false) {
+}
+
+QueryServer::~QueryServer() {
+  connections.clear();
+  if (listen_fd >= 0) close(listen_fd);
+  // Only remove the socket file if it is ours
+  if (bound) unlink(socket_path.c_str());
+  if (epoll_fd >= 0) close(epoll_fd);
+  if (signal_fd >= 0) close(signal_fd);
+}
+
+void QueryServer::Reload(const std::string& filename) {
+  std::lock_guard<std::mutex> guard(reload_lock);
+  std::shared_ptr<const Graph> next(Graph::Load(filename));
+  std::atomic_store(&graph, next);
+  graph_file = filename;
+}
+
+void QueryServer::Run() {
+  // Signals are taken through the event loop
+  signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (signal_fd < 0) throw SystemError("signalfd");
+
+  // Listening socket, replacing a stale socket file if one is left over
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("Error: socket path too long " + socket_path);
+  std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) throw SystemError("socket");
+  RemoveStaleSocket(addr);
+  if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    throw SystemError("cannot bind " + socket_path);
+  bound = true;
+  if (listen(listen_fd, SOMAXCONN) < 0) throw SystemError("listen");
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd < 0) throw SystemError("epoll_create1");
+  for (int fd : {listen_fd, signal_fd}) {
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+      throw SystemError("epoll_ctl");
+  }
+
+  // Event loop
+  epoll_event events[64];
+  for (;;) {
+    int n = epoll_wait(epoll_fd, events, 64, -1);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      throw SystemError("epoll_wait");
+    }
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      if (fd == listen_fd) {
+        Accept();
+      } else if (fd == signal_fd) {
+        if (!HandleSignal()) return;
+      } else {
+        auto it = connections.find(fd);
+        if (it == connections.end()) continue;
+        std::shared_ptr<Connection> conn(it->second);
+        ReadFrom(conn);
+      }
+    }
+  }
+}
+
+void QueryServer::RemoveStaleSocket(const sockaddr_un& addr) {
+  struct stat st;
+  if (lstat(socket_path.c_str(), &st) < 0) {
+    if (errno == ENOENT) return;
+    throw SystemError("cannot stat " + socket_path);
+  }
+  if (!S_ISSOCK(st.st_mode))
+    throw std::runtime_error("Error: " + socket_path + " is not a socket");
+
+  // A socket nobody accepts on was left by a server that died; one that
+  // does is in use
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) throw SystemError("socket");
+  int result = connect(fd, reinterpret_cast<const sockaddr*>(&addr),
+    sizeof(addr));
+  int error = errno;
+  close(fd);
+  if (result == 0)
+    throw std::runtime_error("Error: server already running on " +
+      socket_path);
+  errno = error;
+  if (errno != ECONNREFUSED)
+    throw SystemError("cannot connect to " + socket_path);
+  if (unlink(socket_path.c_str()) < 0 && errno != ENOENT)
+    throw SystemError("cannot remove " + socket_path);
+}
+
+void QueryServer::Accept() {
+  for (;;) {
+    int fd = accept4(listen_fd, nullptr, nullptr,
+      SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) return;
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      close(fd);
+      continue;
+    }
+    connections[fd] = std::make_shared<Connection>(fd);
+  }
+}
+
+void QueryServer::ReadFrom(const std::shared_ptr<Connection>& conn) {
+  char buffer[4096];
+  bool closed = false;
+  for (;;) {
+    ssize_t n = read(conn->fd, buffer, sizeof(buffer));
+    if (n > 0) {
+      conn->input.append(buffer, static_cast<size_t>(n));
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else {
+      closed = (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK));
+      break;
+    }
+  }
+
+  // Queue every complete line, then make sure a worker is on it
+  std::vector<std::string> lines;
+  size_t start = 0, end;
+  while ((end = conn->input.find('\n', start)) != std::string::npos) {
+    lines.emplace_back(conn->input, start, end - start);
+    start = end + 1;
+  }
+  conn->input.erase(0, start);
+  if (conn->input.size() > kMaxLineLength) closed = true;
+
+  if (!lines.empty()) {
+    bool schedule = false;
+    {
+      std::lock_guard<std::mutex> guard(conn->lock);
+      for (auto &line : lines) conn->pending.push_back(std::move(line));
+      schedule = !conn->scheduled;
+      conn->scheduled = true;
+    }
+    if (schedule) {
+      std::shared_ptr<Connection> keep(conn);
+      pool.Submit([this, keep]() { Drain(keep); });
+    }
+  }
+
+  // A worker still holding the connection keeps the socket open until its
+  // answers are written
+  if (closed) Close(conn->fd);
+}
+
+void QueryServer::Close(int fd) {
+  epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  connections.erase(fd);
+}
+
+bool QueryServer::HandleSignal() {
+  signalfd_siginfo info;
+  while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+    if (info.ssi_signo != SIGHUP) return false;
+    pool.Submit([this]() {
+      try {
+        std::string filename;
+        {
+          std::lock_guard<std::mutex> guard(reload_lock);
+          filename = graph_file;
+        }
+        Reload(filename);
+      } catch (std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+      }
+    });
+  }
+  return true;
+}
+
+void QueryServer::Drain(const std::shared_ptr<Connection>& conn) {
+  for (;;) {
+    std::deque<std::string> lines;
+    {
+      std::lock_guard<std::mutex> guard(conn->lock);
+      if (conn->pending.empty()) {
+        conn->scheduled = false;
+        return;
+      }
+      lines.swap(conn->pending);
+    }
+
+    std::string response;
+    for (auto const& line : lines)
+      response += Answer(line);
+    if (!WriteAll(conn->fd, response)) {
+      // Peer is gone or too slow. Drop the rest and hang up, which the
+      // event loop sees and closes the connection on
+      shutdown(conn->fd, SHUT_RDWR);
+      std::lock_guard<std::mutex> guard(conn->lock);
+      conn->pending.clear();
+      conn->scheduled = false;
+      return;
+    }
+  }
+}
+
+std::string QueryServer::Answer(const std::string& line) {
+  std::istringstream in(line);
+  std::ostringstream out;
+  std::string command;
+  if (!(in >> command)) return "error: empty request\n";
+
+  try {
+    if (command == "RELOAD") {
+      std::string filename;
+      if (!(in >> filename)) {
+        std::lock_guard<std::mutex> guard(reload_lock);
+        filename = graph_file;
+      }
+      Reload(filename);
+      out << "ok " << std::atomic_load(&graph)->Size() << "\n";
+      return out.str();
+    }
+
+    // Hold on to the graph for the whole search, a reload may replace it
+    std::shared_ptr<const Graph> current = std::atomic_load(&graph);
+    int src, dest;
+    std::string dest_token, extra;
+    if (!ParseInt(command, &src)) {
+      out << "error: unknown request " << command << "\n";
+      return out.str();
+    }
+    if (!(in >> dest_token) || !ParseInt(dest_token, &dest) || in >> extra)
+      return "error: expected \"src dst\"\n";
+    if (!current->IsNodeIndexValid(src)) {
+      out << "error: invalid source vertex number " << src << "\n";
+    } else if (!current->IsNodeIndexValid(dest)) {
+      out << "error: invalid dest vertex number " << dest << "\n";
+    } else {
+      // Each worker keeps its own search state and path buffer, refitted
+      // whenever a reload changes the graph size
+      static thread_local SearchWorkspace workspace;
+      static thread_local ShortestPath shortest_path;
+      current->Dijkstra(static_cast<unsigned int>(src),
+        static_cast<unsigned int>(dest), &workspace, &shortest_path);
+      shortest_path.PrintShortestPath(out);
+    }
+  } catch (std::out_of_range&) {
+    out << "error: vertex number out of range\n";
+  } catch (std::runtime_error& e) {
+    // Library errors already carry an "Error: " prefix meant for the CLI
+    std::string what = e.what();
+    if (what.compare(0, 7, "Error: ") == 0) what.erase(0, 7);
+    out << "error: " << what << "\n";
+  }
+  return out.str();
+}
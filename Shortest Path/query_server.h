@@ -0,0 +1,90 @@
+// written by nsrazdan
+//
+// Long-running shortest path server. Loads a graph once and answers queries
+// over a Unix domain socket. One thread multiplexes clients with epoll and a
+// pool of workers runs the searches.
+//
+// Line protocol, one request per line:
+//   "src dst"         -> shortest path, printed as by the CLI
+//   "RELOAD [file]"   -> load @file (default: current file) and swap it in
+// Errors come back as a line starting with "error: ". SIGHUP reloads the
+// current file, SIGINT and SIGTERM stop the server.
+#ifndef QUERY_SERVER_H_
+#define QUERY_SERVER_H_
+
+#include <signal.h>
+#include <sys/un.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "graph.h"
+
+// Fixed pool of threads running submitted tasks in FIFO order
+class WorkerPool {
+ public:
+  explicit WorkerPool(unsigned int num_workers);
+  ~WorkerPool();
+  // Queue @task to run on some worker
+  void Submit(std::function<void()> task);
+
+ private:
+  std::mutex lock;
+  std::condition_variable ready;
+  std::deque<std::function<void()>> tasks;
+  std::vector<std::thread> workers;
+  bool stopping;
+};
+
+class QueryServer {
+ public:
+  // Load @graph_file, throws std::runtime_error if it cannot be read
+  QueryServer(const std::string& graph_file, const std::string& socket_path,
+    unsigned int num_workers);
+  ~QueryServer();
+  // Listen on the socket and serve until SIGINT or SIGTERM. Throws
+  // std::runtime_error if the socket cannot be set up
+  void Run();
+  // Load @filename and swap it in. Queries already running finish on the old
+  // graph. Throws std::runtime_error and keeps the old graph on failure
+  void Reload(const std::string& filename);
+
+ private:
+  struct Connection;
+
+  std::string graph_file;
+  std::string socket_path;
+  // Current graph. Read and replaced with std::atomic_load/atomic_store
+  std::shared_ptr<const Graph> graph;
+  std::mutex reload_lock;
+  // Blocked signals, set up before the pool so workers inherit the mask
+  sigset_t signals;
+  WorkerPool pool;
+  int listen_fd;
+  int epoll_fd;
+  int signal_fd;
+  // Whether this server made the socket file, and so should remove it
+  bool bound;
+  std::map<int, std::shared_ptr<Connection>> connections;
+
+  static sigset_t BlockSignals();
+  // Remove a socket file at @addr left by a server that is gone. Throws
+  // std::runtime_error if the path is not a socket or a server answers on it
+  void RemoveStaleSocket(const sockaddr_un& addr);
+  // Event loop helpers
+  void Accept();
+  void ReadFrom(const std::shared_ptr<Connection>& conn);
+  void Close(int fd);
+  bool HandleSignal();
+  // Worker side: answer every line queued on @conn, in order
+  void Drain(const std::shared_ptr<Connection>& conn);
+  std::string Answer(const std::string& line);
+};
+
+#endif  // QUERY_SERVER_H_